@@ -0,0 +1,213 @@
+// AdminServer.cpp
+#include <iomanip>
+#include <sstream>
+#include "AdminServer.hpp"
+
+// Длина строки команды: длиннее - разрываем соединение
+#define ADMIN_LINE_MAX 1024
+// Сколько байт отпечатка показывать в списке участников
+#define ADMIN_FINGERPRINT_BYTES 8
+
+// Имена уровней - как в --log-level
+static const char* const LEVEL_NAMES[] = {"error", "info", "debug", "trace"};
+
+/**
+   Одно соединение администратора. Команды выполняются по одной:
+   следующая строка читается только после отправки ответа. Ответ
+   на participants собирается в strand комнаты и возвращается в strand_.
+*/
+class AdminServer::Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(boost::asio::io_service& io_service, RoomRegistry& registry)
+        : socket_(io_service),
+          strand_(io_service),
+          registry_(registry),
+          input_(ADMIN_LINE_MAX)
+    {
+    }
+
+    boost::asio::local::stream_protocol::socket& Socket() {
+        return socket_;
+    }
+
+    void Start() {
+        Read();
+    }
+
+private:
+    void Read() {
+        boost::asio::async_read_until(
+            socket_, input_, '\n',
+            strand_.wrap(boost::bind(&Session::OnRead, shared_from_this(), _1)));
+    }
+
+    void OnRead(const boost::system::error_code& error) {
+        if (error) {
+            // Конец сессии или строка длиннее ADMIN_LINE_MAX
+            if (error != boost::asio::error::eof) {
+                LOG_ERR("Admin read error: " << error.message());
+            }
+            Close();
+            return;
+        }
+
+        std::istream stream(&input_);
+        std::string line;
+        std::getline(stream, line);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        Execute(line);
+    }
+
+    void Execute(const std::string& line) {
+        std::istringstream in(line);
+        std::string command;
+        in >> command;
+        std::ostringstream out;
+
+        if (command.empty()) {
+            Read();
+            return;
+        } else if (command == "rooms") {
+            for (const auto& room : registry_.Rooms()) {
+                out << "room " << room->Id() << " participants " << room->Size() << "\n";
+            }
+            out << "ok\n";
+        } else if (command == "participants") {
+            uint32_t room_id;
+            if (!(in >> room_id)) {
+                out << "error usage: participants ROOM\n";
+            } else {
+                // Несуществующую комнату не создаем
+                for (const auto& room : registry_.Rooms()) {
+                    if (room->Id() == room_id) {
+                        room->Inspect(strand_.wrap(boost::bind(
+                            &Session::OnInspect, shared_from_this(), _1)));
+                        return;
+                    }
+                }
+                out << "error no room " << room_id << "\n";
+            }
+        } else if (command == "get") {
+            Config::Get().Dump(out);
+            out << "log-level " << LEVEL_NAMES[Logger::Level()] << "\n";
+            out << "ok\n";
+        } else if (command == "set") {
+            std::string name;
+            std::string value;
+            if (!(in >> name >> value)) {
+                out << "error usage: set NAME VALUE\n";
+            } else if (Set(name, value)) {
+                LOG_MSG("Admin set " << name << " " << value);
+                out << "ok\n";
+            } else {
+                out << "error bad parameter " << name << " " << value << "\n";
+            }
+        } else if (command == "stats") {
+            Metrics::Get().Dump(out);
+            out << "ok\n";
+        } else if (command == "help") {
+            out << "rooms\n"
+                << "participants ROOM\n"
+                << "get\n"
+                << "set NAME VALUE\n"
+                << "stats\n"
+                << "ok\n";
+        } else {
+            out << "error unknown command " << command << "\n";
+        }
+        Reply(out.str());
+    }
+
+    static bool Set(const std::string& name, const std::string& value) {
+        if (name == "log-level") {
+            int level;
+            if (!Logger::ParseLevel(value, level)) {
+                return false;
+            }
+            Logger::SetLevel(level);
+            return true;
+        }
+        return Config::Get().Set(name, value);
+    }
+
+    void OnInspect(const std::vector<ChatRoom::MemberInfo>& members) {
+        std::ostringstream out;
+        for (const auto& member : members) {
+            out << "transport=" << member.stats.transport
+                << " worker=" << member.stats.worker
+                << " queued_frames=" << member.stats.queued_frames
+                << " queued_bytes=" << member.stats.queued_bytes
+                << " fingerprint=";
+            if (member.registered) {
+                out << std::hex << std::setfill('0');
+                for (std::size_t i = 0; i < ADMIN_FINGERPRINT_BYTES; ++i) {
+                    out << std::setw(2) << static_cast<int>(member.fingerprint[i]);
+                }
+                out << std::dec;
+            } else {
+                out << "-";
+            }
+            out << "\n";
+        }
+        out << "ok\n";
+        Reply(out.str());
+    }
+
+    void Reply(std::string text) {
+        reply_ = std::move(text);
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(reply_),
+            strand_.wrap(boost::bind(&Session::OnWrite, shared_from_this(), _1)));
+    }
+
+    void OnWrite(const boost::system::error_code& error) {
+        if (error) {
+            Close();
+            return;
+        }
+        Read();
+    }
+
+    void Close() {
+        boost::system::error_code ignored;
+        socket_.shutdown(boost::asio::local::stream_protocol::socket::shutdown_both,
+                         ignored);
+        socket_.close(ignored);
+    }
+
+    boost::asio::local::stream_protocol::socket socket_;
+    boost::asio::io_service::strand strand_;
+    RoomRegistry& registry_;
+    boost::asio::streambuf input_;
+    std::string reply_;
+};
+
+AdminServer::AdminServer(boost::asio::io_service& io_service, RoomRegistry& registry,
+                         const boost::asio::local::stream_protocol::endpoint& endpoint)
+    : io_service_(io_service),
+      registry_(registry),
+      acceptor_(io_service, endpoint)
+{
+    Accept();
+}
+
+void AdminServer::Accept() {
+    std::shared_ptr<Session> session(new Session(io_service_, registry_));
+    acceptor_.async_accept(
+        session->Socket(), boost::bind(&AdminServer::OnAccept, this, session, _1));
+}
+
+void AdminServer::OnAccept(std::shared_ptr<Session> session,
+                           const boost::system::error_code& error)
+{
+    if (!error) {
+        LOG_MSG("Admin connected");
+        session->Start();
+    } else {
+        LOG_ERR("Admin accept error: " << error.message());
+    }
+
+    Accept();
+}
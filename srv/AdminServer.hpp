@@ -0,0 +1,45 @@
+// AdminServer.hpp
+#ifndef ADMINSERVER_HPP
+#define ADMINSERVER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "RoomRegistry.hpp"
+#include "Config.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+/**
+   Управляющий unix-сокет администратора. В отличие от StatsServer
+   соединение не закрывается после ответа: команды идут строками,
+   ответ на каждую - несколько строк и в конце "ok" или "error причина".
+     rooms                  комнаты и число участников
+     participants ROOM      участники комнаты и глубина их очередей
+     get                    текущие значения настраиваемых параметров
+     set NAME VALUE         поменять параметр (имена - как в Config::Set,
+                            плюс log-level)
+     stats                  счетчики сервера, как у StatsServer
+     help                   список команд
+   Доступ к сокету ограничивается правами на файл.
+*/
+class AdminServer {
+public:
+    AdminServer(boost::asio::io_service& io_service, RoomRegistry& registry,
+                const boost::asio::local::stream_protocol::endpoint& endpoint);
+
+private:
+    class Session;
+
+    void Accept();
+    void OnAccept(std::shared_ptr<Session> session,
+                  const boost::system::error_code& error);
+
+    boost::asio::io_service& io_service_;
+    RoomRegistry& registry_;
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+};
+
+#endif // ADMINSERVER_HPP
@@ -0,0 +1,440 @@
+// Bench.cpp
+#include <unistd.h>
+#include "Bench.hpp"
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void PutLE(unsigned char* dst, uint64_t value, std::size_t cnt) {
+    for (std::size_t i = 0; i < cnt; ++i) {
+        dst[i] = static_cast<unsigned char>((value >> (i * 8)) & 0xFF);
+    }
+}
+
+static uint64_t GetLE(const unsigned char* src, std::size_t cnt) {
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < cnt; ++i) {
+        value |= static_cast<uint64_t>(src[i]) << (i * 8);
+    }
+    return value;
+}
+
+// xorshift64: быстрый генератор для размеров и заполнения payload
+static uint64_t NextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// Payload кадра бенчмарка размером size с offset в frame:
+// [BENCH_HDR][псевдослучайное заполнение]
+static void FillPayload(std::vector<unsigned char>& frame, std::size_t offset,
+                        uint64_t& seed, uint32_t run_id, uint32_t id)
+{
+    for (std::size_t i = offset + BENCH_HDR_SIZE; i < frame.size(); i += 8) {
+        PutLE(&frame[i], NextRandom(seed), std::min<std::size_t>(8, frame.size() - i));
+    }
+    PutLE(&frame[offset], BENCH_MAGIC, 4);
+    PutLE(&frame[offset + 4], run_id, 4);
+    PutLE(&frame[offset + 8], id, 4);
+    PutLE(&frame[offset + 12], NowNs(), 8);
+}
+
+// Учитывает принятый payload; true - это кадр отправителя id
+// из текущего запуска
+static bool RecordPayload(BenchStats& stats, uint32_t run_id, uint32_t id,
+                          const unsigned char* payload, std::size_t size)
+{
+    if (size < BENCH_HDR_SIZE
+        || GetLE(&payload[0], 4) != BENCH_MAGIC
+        || GetLE(&payload[4], 4) != run_id) {
+        return false;
+    }
+    // Кадр текущего запуска (не из истории комнаты): задержка доставки
+    if (stats.measuring.load(std::memory_order_relaxed)) {
+        stats.latency_ns.Record(NowNs() - GetLE(&payload[12], 8));
+    }
+    return GetLE(&payload[8], 4) == id;
+}
+
+BenchSession::BenchSession(boost::asio::io_service& io_service, BenchStats& stats,
+                           uint32_t run_id, uint32_t id, uint32_t room_id,
+                           bool sender, const BenchLoad& load)
+    : socket_(io_service),
+      stats_(stats),
+      run_id_(run_id),
+      id_(id),
+      room_id_(room_id),
+      header_size_(0),
+      payload_offset_(0),
+      sender_(sender),
+      load_(load),
+      seed_((static_cast<uint64_t>(run_id) << 32 | id) * 0x9e3779b97f4a7c15ull | 1),
+      timer_(io_service),
+      read_msg_(2)
+{
+    load_.min_size = std::max<std::size_t>(load_.min_size, BENCH_HDR_SIZE);
+    load_.max_size = std::max(load_.max_size, load_.min_size);
+}
+
+void BenchSession::Start(const tcp::endpoint& endpoint) {
+    socket_.async_connect(
+        endpoint, boost::bind(&BenchSession::OnConnect, shared_from_this(), _1));
+}
+
+void BenchSession::OnConnect(const boost::system::error_code& error) {
+    if (error) {
+        LOG_TXT("Connect failed: " << error.message());
+        stats_.errors++;
+        return;
+    }
+
+    socket_.set_option(tcp::no_delay(true));
+    stats_.connected++;
+
+    ReadHeader();
+
+    // В v2 сессия сразу заявляет о формате кадром JOIN, даже в комнату
+    // по умолчанию: иначе молчащий получатель так и получал бы кадры v1
+    if (room_id_ != 0 || load_.v2) {
+        std::vector<unsigned char> join(HeaderSize());
+        SealFrame(join, ROOM_JOIN);
+        Send(std::move(join));
+    }
+
+    if (!sender_) {
+        return;
+    }
+    if (load_.rate > 0) {
+        // Разносим первые кадры отправителей по интервалу, чтобы
+        // все они не приходили на сервер одной пачкой
+        int64_t interval = static_cast<int64_t>(1e9 / load_.rate);
+        timer_.expires_after(std::chrono::nanoseconds(
+            NextRandom(seed_) % std::max<int64_t>(interval, 1)));
+        timer_.async_wait(
+            boost::bind(&BenchSession::OnTick, shared_from_this(), _1));
+    } else {
+        for (std::size_t i = 0; i < load_.window; ++i) {
+            SendFrame();
+        }
+    }
+}
+
+void BenchSession::OnTick(const boost::system::error_code& error) {
+    if (error || !socket_.is_open()) {
+        return;
+    }
+
+    // Если сокет не успевает, такт пропускается, а не копится в памяти
+    if (write_msgs_.size() < BENCH_MAX_BACKLOG) {
+        SendFrame();
+    }
+
+    timer_.expires_at(timer_.expiry() + std::chrono::nanoseconds(
+                          static_cast<int64_t>(1e9 / load_.rate)));
+    timer_.async_wait(boost::bind(&BenchSession::OnTick, shared_from_this(), _1));
+}
+
+std::size_t BenchSession::HeaderSize() const {
+    if (load_.v2) {
+        return FRAME_V2_HEADER_SIZE;
+    }
+    return room_id_ != 0 ? ROOM_HEADER_SIZE : 2;
+}
+
+void BenchSession::SealFrame(std::vector<unsigned char>& frame, uint8_t op) {
+    std::size_t offset = HeaderSize();
+    std::size_t size = frame.size() - offset;
+    if (load_.v2) {
+        EncodeFrameV2Header(frame.data(), op, room_id_, frame.data() + offset, size);
+    } else if (room_id_ != 0) {
+        PutLE(&frame[0], size | ROOM_FRAME_FLAG, 2);
+        frame[2] = op;
+        PutLE(&frame[3], room_id_, 4);
+    } else {
+        PutLE(&frame[0], size, 2);
+    }
+}
+
+void BenchSession::ReadHeader() {
+    // Первые два байта - либо magic v2, либо длина кадра v1: до первого
+    // кадра от клиента сервер отвечает в v1 (история комнаты при входе)
+    read_msg_.resize(2);
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(read_msg_.data(), 2),
+        boost::bind(&BenchSession::HeaderHandler, shared_from_this(), _1));
+}
+
+void BenchSession::HeaderHandler(const boost::system::error_code& error) {
+    if (error) {
+        stats_.errors++;
+        timer_.cancel();
+        return;
+    }
+
+    if (read_msg_.size() == 2 && IsFrameV2(read_msg_.data())) {
+        // Дочитываем остаток заголовка v2
+        read_msg_.resize(FRAME_V2_HEADER_SIZE);
+        boost::asio::async_read(
+            socket_, boost::asio::buffer(read_msg_.data() + 2, FRAME_V2_HEADER_SIZE - 2),
+            boost::bind(&BenchSession::HeaderHandler, shared_from_this(), _1));
+        return;
+    }
+
+    std::size_t body_length;
+    if (read_msg_.size() == FRAME_V2_HEADER_SIZE) {
+        FrameV2Header header;
+        if (!DecodeFrameV2Header(read_msg_.data(), header)) {
+            stats_.errors++;
+            timer_.cancel();
+            socket_.close();
+            return;
+        }
+        body_length = header.length;
+        // Кадры рассылки приходят с номером перед сообщением
+        payload_offset_ = header.op == ROOM_SEQ_MSG ? FRAME_SEQ_SIZE : 0;
+    } else {
+        uint16_t header =
+            (static_cast<uint16_t>(read_msg_[1]) << 8) |
+            static_cast<uint16_t>(read_msg_[0]);
+        bool room_frame = (header & ROOM_FRAME_FLAG) != 0;
+        payload_offset_ = room_frame ? ROOM_FIELDS_SIZE : 0;
+        body_length = (header & FRAME_LENGTH_MASK) + payload_offset_;
+    }
+    header_size_ = read_msg_.size();
+    read_msg_.resize(body_length);
+
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(read_msg_.data(), body_length),
+        boost::bind(&BenchSession::ReadHandler, shared_from_this(), _1));
+}
+
+void BenchSession::ReadHandler(const boost::system::error_code& error) {
+    if (error) {
+        stats_.errors++;
+        timer_.cancel();
+        return;
+    }
+
+    stats_.frames_received++;
+    stats_.bytes_received += read_msg_.size() + header_size_;
+
+    // Свой кадр вернулся - в замкнутом цикле отправляем следующий
+    if (RecordPayload(stats_, run_id_, id_, read_msg_.data() + payload_offset_,
+                      read_msg_.size() - payload_offset_)
+        && load_.rate <= 0) {
+        SendFrame();
+    }
+
+    ReadHeader();
+}
+
+void BenchSession::SendFrame() {
+    std::size_t size = load_.min_size
+        + NextRandom(seed_) % (load_.max_size - load_.min_size + 1);
+
+    // [заголовок][BENCH_HDR][псевдослучайное заполнение]
+    std::size_t offset = HeaderSize();
+    std::vector<unsigned char> frame(offset + size);
+    FillPayload(frame, offset, seed_, run_id_, id_);
+    SealFrame(frame, ROOM_MSG);
+
+    stats_.frames_sent++;
+    Send(std::move(frame));
+}
+
+void BenchSession::Send(std::vector<unsigned char> frame) {
+    bool write_in_progress = !write_msgs_.empty();
+    write_msgs_.push_back(std::move(frame));
+
+    if (!write_in_progress) {
+        boost::asio::async_write(
+            socket_,
+            boost::asio::buffer(write_msgs_.front().data(),
+                                write_msgs_.front().size()),
+            boost::bind(&BenchSession::WriteHandler, shared_from_this(), _1));
+    }
+}
+
+void BenchSession::WriteHandler(const boost::system::error_code& error) {
+    if (error) {
+        stats_.errors++;
+        timer_.cancel();
+        return;
+    }
+
+    write_msgs_.pop_front();
+    if (!write_msgs_.empty()) {
+        boost::asio::async_write(
+            socket_,
+            boost::asio::buffer(write_msgs_.front().data(),
+                                write_msgs_.front().size()),
+            boost::bind(&BenchSession::WriteHandler, shared_from_this(), _1));
+    }
+}
+
+BenchShmSession::BenchShmSession(boost::asio::io_service& io_service, BenchStats& stats,
+                                 uint32_t run_id, uint32_t id, uint32_t room_id,
+                                 bool sender, const BenchLoad& load)
+    : io_service_(io_service),
+      stats_(stats),
+      run_id_(run_id),
+      id_(id),
+      room_id_(room_id),
+      sender_(sender),
+      load_(load),
+      seed_((static_cast<uint64_t>(run_id) << 32 | id) * 0x9e3779b97f4a7c15ull | 1),
+      failed_(false),
+      event_(io_service),
+      event_count_(0),
+      waiting_(false),
+      pump_posted_(false),
+      timer_(io_service)
+{
+    load_.min_size = std::max<std::size_t>(load_.min_size, BENCH_HDR_SIZE);
+    load_.max_size = std::max(load_.max_size, load_.min_size);
+}
+
+void BenchShmSession::Start(const std::string& path) {
+    // Дальше сессия живет только в потоке своего io_service
+    io_service_.post(boost::bind(&BenchShmSession::Connect, shared_from_this(), path));
+}
+
+void BenchShmSession::Connect(const std::string& path) {
+    // Подключение к unix-сокету локальное и мгновенное, ждать его не нужно
+    try {
+        client_.Connect(path);
+    } catch (std::exception& e) {
+        LOG_TXT("Shm connect failed: " << e.what());
+        stats_.errors++;
+        return;
+    }
+    event_.assign(::dup(client_.EventFd()));
+    stats_.connected++;
+
+    std::vector<unsigned char> join(FRAME_V2_HEADER_SIZE);
+    EncodeFrameV2Header(join.data(), ROOM_JOIN, room_id_, nullptr, 0);
+    Send(std::move(join));
+
+    if (!sender_) {
+        return;
+    }
+    if (load_.rate > 0) {
+        int64_t interval = static_cast<int64_t>(1e9 / load_.rate);
+        timer_.expires_after(std::chrono::nanoseconds(
+            NextRandom(seed_) % std::max<int64_t>(interval, 1)));
+        timer_.async_wait(
+            boost::bind(&BenchShmSession::OnTick, shared_from_this(), _1));
+    } else {
+        for (std::size_t i = 0; i < load_.window; ++i) {
+            SendFrame();
+        }
+    }
+}
+
+void BenchShmSession::OnTick(const boost::system::error_code& error) {
+    if (error || failed_) {
+        return;
+    }
+    if (write_msgs_.size() < BENCH_MAX_BACKLOG) {
+        SendFrame();
+    }
+    timer_.expires_at(timer_.expiry() + std::chrono::nanoseconds(
+                          static_cast<int64_t>(1e9 / load_.rate)));
+    timer_.async_wait(boost::bind(&BenchShmSession::OnTick, shared_from_this(), _1));
+}
+
+void BenchShmSession::OnEvent(const boost::system::error_code& error) {
+    waiting_ = false;
+    if (error) {
+        Fail();
+        return;
+    }
+    Pump();
+}
+
+void BenchShmSession::Pump() {
+    // Кадры, отправленные из HandleFrame, уйдут в этом же вызове
+    pump_posted_ = true;
+    if (failed_) {
+        return;
+    }
+    try {
+        std::size_t size;
+        while (const unsigned char* frame = client_.Receive(size)) {
+            HandleFrame(frame, size);
+            client_.Release(size);
+        }
+        while (!write_msgs_.empty()
+               && client_.Send(write_msgs_.front().data(), write_msgs_.front().size())) {
+            write_msgs_.pop_front();
+        }
+        pump_posted_ = false;
+
+        std::size_t space = write_msgs_.empty() ? 0 : write_msgs_.front().size();
+        if (!client_.PrepareWait(space)) {
+            // Пока разбирали, пришло еще: продолжаем после других сессий потока
+            pump_posted_ = true;
+            io_service_.post(boost::bind(&BenchShmSession::Pump, shared_from_this()));
+            return;
+        }
+    } catch (std::exception& e) {
+        LOG_TXT("Shm session failed: " << e.what());
+        Fail();
+        return;
+    }
+
+    if (!waiting_) {
+        waiting_ = true;
+        event_.async_read_some(
+            boost::asio::buffer(&event_count_, sizeof(event_count_)),
+            boost::bind(&BenchShmSession::OnEvent, shared_from_this(), _1));
+    }
+}
+
+void BenchShmSession::HandleFrame(const unsigned char* frame, std::size_t size) {
+    FrameV2Header header;
+    DecodeFrameV2Header(frame, header);
+    stats_.frames_received++;
+    stats_.bytes_received += size;
+
+    std::size_t offset = FRAME_V2_HEADER_SIZE
+        + (header.op == ROOM_SEQ_MSG ? FRAME_SEQ_SIZE : 0);
+    if (RecordPayload(stats_, run_id_, id_, frame + offset, size - offset)
+        && load_.rate <= 0) {
+        SendFrame();
+    }
+}
+
+void BenchShmSession::SendFrame() {
+    std::size_t size = load_.min_size
+        + NextRandom(seed_) % (load_.max_size - load_.min_size + 1);
+    std::vector<unsigned char> frame(FRAME_V2_HEADER_SIZE + size);
+    FillPayload(frame, FRAME_V2_HEADER_SIZE, seed_, run_id_, id_);
+    EncodeFrameV2Header(frame.data(), ROOM_MSG, room_id_,
+                        frame.data() + FRAME_V2_HEADER_SIZE, size);
+
+    stats_.frames_sent++;
+    Send(std::move(frame));
+}
+
+void BenchShmSession::Send(std::vector<unsigned char> frame) {
+    write_msgs_.push_back(std::move(frame));
+    if (!pump_posted_) {
+        pump_posted_ = true;
+        io_service_.post(boost::bind(&BenchShmSession::Pump, shared_from_this()));
+    }
+}
+
+void BenchShmSession::Fail() {
+    if (!failed_) {
+        failed_ = true;
+        stats_.errors++;
+        timer_.cancel();
+        boost::system::error_code ignored;
+        event_.close(ignored);
+    }
+}
@@ -0,0 +1,157 @@
+// Bench.hpp
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "Protocol.hpp"
+#include "FrameV2.hpp"
+#include "Histogram.hpp"
+#include "ShmClient.hpp"
+#include "Log.hpp"
+#include "defs.hpp"
+
+using boost::asio::ip::tcp;
+
+// Заголовок синтетического payload нагрузочного клиента:
+// - 4 байта BENCH_MAGIC
+// - 4 байта идентификатор запуска
+// - 4 байта идентификатор отправителя
+// - 8 байт время отправки (steady_clock, нс)
+#define BENCH_MAGIC 0x434e4243
+#define BENCH_HDR_SIZE 20
+// Сколько неотправленных кадров копит отправитель с заданным темпом,
+// прежде чем начать пропускать такты
+#define BENCH_MAX_BACKLOG 64
+// Сколько сессий подключается одновременно
+#define BENCH_CONNECT_WINDOW 256
+
+/**
+   Общие счетчики всех сессий нагрузочного клиента.
+   Задержка доставки (от отправки кадра до его приема каждой сессией)
+   пишется в latency_ns только пока measuring выставлен.
+*/
+struct BenchStats {
+    std::atomic<uint64_t> connected{0};
+    std::atomic<uint64_t> frames_sent{0};
+    std::atomic<uint64_t> frames_received{0};
+    std::atomic<uint64_t> bytes_received{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<bool> measuring{false};
+    Histogram latency_ns;
+};
+
+/**
+   Параметры нагрузки одной сессии
+*/
+struct BenchLoad {
+    // Кадров в полете у отправителя при rate == 0 (замкнутый цикл)
+    std::size_t window;
+    // Кадров в секунду у отправителя, 0 - замкнутый цикл по window
+    double rate;
+    // Размер payload выбирается равномерно из [min_size, max_size]
+    std::size_t min_size;
+    std::size_t max_size;
+    // Кадры v2; иначе - старые кадры с двумя байтами длины
+    bool v2;
+};
+
+/**
+   Одна симулируемая сессия. Отправитель либо держит в полете window
+   кадров: получив обратно свой кадр (сервер рассылает всем, включая
+   автора), отправляет следующий; либо шлет кадры с постоянным темпом
+   rate по таймеру, не дожидаясь эха. Остальные сессии только принимают.
+   Payload синтетический: заголовок бенчмарка и псевдослучайные байты,
+   RSA не нужен.
+   Сессия с room_id != 0 входит в эту комнату и шлет кадры с комнатой.
+   По умолчанию кадры v2, с load.v2 == false - старые (с флагом комнаты
+   в длине или без комнаты), которым сервер дописывает синхромаркер.
+*/
+class BenchSession : public std::enable_shared_from_this<BenchSession> {
+public:
+    BenchSession(boost::asio::io_service& io_service, BenchStats& stats,
+                 uint32_t run_id, uint32_t id, uint32_t room_id,
+                 bool sender, const BenchLoad& load);
+    void Start(const tcp::endpoint& endpoint);
+
+private:
+    void OnConnect(const boost::system::error_code& error);
+    // Размер заголовка исходящего кадра и его заполнение:
+    // frame - заголовок, за ним payload
+    std::size_t HeaderSize() const;
+    void SealFrame(std::vector<unsigned char>& frame, uint8_t op);
+    void ReadHeader();
+    void HeaderHandler(const boost::system::error_code& error);
+    void ReadHandler(const boost::system::error_code& error);
+    void SendFrame();
+    void OnTick(const boost::system::error_code& error);
+    void Send(std::vector<unsigned char> frame);
+    void WriteHandler(const boost::system::error_code& error);
+
+    tcp::socket socket_;
+    BenchStats& stats_;
+    uint32_t run_id_;
+    uint32_t id_;
+    uint32_t room_id_;
+    // Размер заголовка принятого кадра и смещение payload в read_msg_
+    std::size_t header_size_;
+    std::size_t payload_offset_;
+    bool sender_;
+    BenchLoad load_;
+    uint64_t seed_;
+    boost::asio::steady_timer timer_;
+    std::vector<unsigned char> read_msg_;
+    std::deque<std::vector<unsigned char>> write_msgs_;
+};
+
+/**
+   Та же сессия, но через локальный транспорт сервера (--shm-socket):
+   кадры v2 идут через кольца ShmClient, а ждет сессия только на его
+   eventfd, когда ей нечего читать или некуда писать.
+*/
+class BenchShmSession : public std::enable_shared_from_this<BenchShmSession> {
+public:
+    BenchShmSession(boost::asio::io_service& io_service, BenchStats& stats,
+                    uint32_t run_id, uint32_t id, uint32_t room_id,
+                    bool sender, const BenchLoad& load);
+    void Start(const std::string& path);
+
+private:
+    void Connect(const std::string& path);
+    void OnTick(const boost::system::error_code& error);
+    void OnEvent(const boost::system::error_code& error);
+    // Разбирает все пришедшие кадры, отправляет все, что помещается,
+    // и засыпает на eventfd, если делать больше нечего
+    void Pump();
+    void HandleFrame(const unsigned char* frame, std::size_t size);
+    void SendFrame();
+    void Send(std::vector<unsigned char> frame);
+    void Fail();
+
+    boost::asio::io_service& io_service_;
+    BenchStats& stats_;
+    uint32_t run_id_;
+    uint32_t id_;
+    uint32_t room_id_;
+    bool sender_;
+    BenchLoad load_;
+    uint64_t seed_;
+    bool failed_;
+    ShmClient client_;
+    boost::asio::posix::stream_descriptor event_;
+    uint64_t event_count_;
+    // Взведено чтение eventfd
+    bool waiting_;
+    // Pump запланирован или идет: новые кадры он отправит сам
+    bool pump_posted_;
+    boost::asio::steady_timer timer_;
+    std::deque<std::vector<unsigned char>> write_msgs_;
+};
+
+#endif // BENCH_HPP
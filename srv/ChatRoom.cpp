@@ -1,55 +1,367 @@
 #include "ChatRoom.hpp"
+#include "Federation.hpp"
+#include "Tracer.hpp"
+
+ChatRoom::ChatRoom(IoServicePool& pool, std::size_t home, uint32_t room_id,
+                   const std::string& log_dir, Federation* federation)
+    : id_(room_id),
+      federation_(federation),
+      strand_(pool.GetIoService(home)),
+      size_(0),
+      draining_(false)
+{
+    try {
+        log_.reset(new RoomLog(log_dir, Config::Get().history));
+    } catch (std::exception& e) {
+        LOG_MSG("Room " << room_id << " runs without history: " << e.what());
+    }
+    for (std::size_t i = 0; i < pool.Size(); ++i) {
+        shards_.emplace_back(new RoomShard(pool.GetIoService(i), i == home));
+    }
+}
+
+uint32_t ChatRoom::Id() const {
+    return id_;
+}
 
 void ChatRoom::Enter(
-    std::shared_ptr<Participant> participant, const std::string& nickname)
+    std::shared_ptr<Participant> participant, const std::string& nickname,
+    uint64_t last_seq)
+{
+    Schedule(Task{TaskEnter, std::move(participant), SharedFrame(), nickname,
+                  Fingerprint(), last_seq, false});
+}
+
+void ChatRoom::Leave(std::shared_ptr<Participant> participant) {
+    Schedule(Task{TaskLeave, std::move(participant), SharedFrame(), std::string(),
+                  Fingerprint(), 0, false});
+}
+
+void ChatRoom::Broadcast(const unsigned char* msg, std::size_t size, bool sync_marker) {
+    LOG_BYTES("Broadcasting message", msg, size);
+
+    // Разошлет владелец, кадр вернется и к этому узлу через Receive
+    if (federation_ && !federation_->Owns(id_)) {
+        federation_->Forward(id_, msg, size, sync_marker);
+        return;
+    }
+
+    // Кадр собирается один раз, еще в потоке отправителя
+    SharedFrame frame = Frame::Make(id_, msg, size, sync_marker, Tracer::Sample());
+    Schedule(Task{TaskBroadcast, std::shared_ptr<Participant>(), std::move(frame),
+                  std::string(), Fingerprint(), 0, true});
+}
+
+void ChatRoom::Register(std::shared_ptr<Participant> participant,
+                        const Fingerprint& fingerprint)
+{
+    Schedule(Task{TaskRegister, std::move(participant), SharedFrame(),
+                  std::string(), fingerprint, 0, false});
+}
+
+void ChatRoom::Route(const Fingerprint& recipient, const unsigned char* msg,
+                     std::size_t size, bool sync_marker)
+{
+    if (federation_ && !federation_->Owns(id_)) {
+        federation_->ForwardRouted(id_, recipient, msg, size, sync_marker);
+        return;
+    }
+
+    SharedFrame frame = Frame::Make(id_, msg, size, sync_marker, Tracer::Sample());
+    Schedule(Task{TaskRoute, std::shared_ptr<Participant>(), std::move(frame),
+                  std::string(), recipient, 0, true});
+}
+
+void ChatRoom::Receive(const unsigned char* msg, std::size_t size, bool sync_marker,
+                       bool forwarded, uint64_t seq)
 {
-    LOG_MSG("Participant entered with nickname: " << nickname);
-    participants_.insert(participant);
+    SharedFrame frame = Frame::Make(id_, msg, size, sync_marker);
+    Schedule(Task{TaskBroadcast, std::shared_ptr<Participant>(), std::move(frame),
+                  std::string(), Fingerprint(), seq, forwarded});
+}
+
+void ChatRoom::ReceiveRouted(const Fingerprint& recipient, const unsigned char* msg,
+                             std::size_t size, bool sync_marker, bool forwarded)
+{
+    SharedFrame frame = Frame::Make(id_, msg, size, sync_marker);
+    Schedule(Task{TaskRoute, std::shared_ptr<Participant>(), std::move(frame),
+                  std::string(), recipient, 0, forwarded});
+}
+
+int64_t ChatRoom::ChargeIngress(std::size_t size) {
+    Config& config = Config::Get();
+    std::size_t frame_rate = config.room_frames_per_sec.load(std::memory_order_relaxed);
+    std::size_t byte_rate = config.room_bytes_per_sec.load(std::memory_order_relaxed);
+    if (frame_rate == 0 && byte_rate == 0) {
+        return 0;
+    }
+
+    int64_t now = Metrics::NowNs();
+    return std::max(ingress_frames_.Take(1, frame_rate, now),
+                    ingress_bytes_.Take(size, byte_rate, now));
+}
+
+void ChatRoom::Schedule(Task task) {
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        schedule = inbox_.empty();
+        inbox_.push_back(std::move(task));
+    }
+
+    // Иначе RunTasks уже запланирован и заберет задачу вместе с прочими
+    if (schedule) {
+        strand_.post(MakeAllocHandler(
+            tasks_memory_, boost::bind(&ChatRoom::RunTasks, this)));
+    }
+}
+
+void ChatRoom::RunTasks() {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        inbox_.swap(running_);
+    }
+
+    for (auto& task : running_) {
+        switch (task.kind) {
+        case TaskEnter:
+            EnterImpl(task.participant, task.nickname, task.seq);
+            break;
+        case TaskLeave:
+            LeaveImpl(task.participant);
+            break;
+        case TaskBroadcast:
+            BroadcastImpl(task.frame, task.relay, task.seq);
+            break;
+        case TaskRegister:
+            RegisterImpl(task.participant, task.fingerprint);
+            break;
+        case TaskRoute:
+            RouteImpl(task.frame, task.fingerprint, task.relay);
+            break;
+        }
+    }
+    // Емкость векторов сохраняется, память больше не выделяется
+    running_.clear();
+}
+
+void ChatRoom::Replay(std::shared_ptr<Participant> participant,
+                      uint64_t from, uint64_t to)
+{
+    strand_.dispatch(
+        boost::bind(&ChatRoom::ReplayImpl, this, participant, from, to));
+}
+
+void ChatRoom::EnterImpl(
+    std::shared_ptr<Participant> participant, const std::string& nickname,
+    uint64_t last_seq)
+{
+    LOG_MSG("Participant entered room " << id_ << " with nickname: " << nickname);
+    if (draining_) {
+        // Комнату уже обслуживает новый процесс
+        participant->Drain();
+        return;
+    }
+    if (participants_.insert(participant).second) {
+        size_.store(participants_.size(), std::memory_order_relaxed);
+        ShardOf(participant).Add(participant);
+        // Первому участнику на узле нужна рассылка комнаты от владельца
+        if (federation_ && participants_.size() == 1) {
+            federation_->Join(id_);
+        }
+    }
     name_table_[participant] = nickname;
-    std::for_each(recent_msgs_.begin(), recent_msgs_.end(),
-                  boost::bind(&Participant::OnMessage, participant, _1));
+
+    // Последние history_recent кадров из журнала, а после обрыва связи -
+    // только пропущенные из них: повторно присланный вход в ту же
+    // комнату лишь дополучает пропуск. last_seq прислал клиент: номер
+    // не меньше next - пропуска нет (и last_seq + 1 не переполнится)
+    uint64_t next = log_ ? log_->NextSeq() : 0;
+    uint64_t recent = Config::Get().history_recent.load(std::memory_order_relaxed);
+    if (last_seq < next) {
+        uint64_t from = std::max(next - std::min(recent, next), last_seq + 1);
+        if (from < next) {
+            ReplayImpl(participant, from, next);
+        }
+    }
+
     LOG_MSG("Participant added. Total participants: " << participants_.size());
 }
 
-void ChatRoom::Leave(std::shared_ptr<Participant> participant) {
+void ChatRoom::LeaveImpl(std::shared_ptr<Participant> participant) {
     LOG_MSG("Participant leaving");
-    participants_.erase(participant);
+    if (participants_.erase(participant) > 0) {
+        size_.store(participants_.size(), std::memory_order_relaxed);
+        ShardOf(participant).Remove(participant);
+        if (federation_ && participants_.empty()) {
+            federation_->Leave(id_);
+        }
+    }
     name_table_.erase(participant);
+
+    auto registered = fingerprints_.find(participant);
+    if (registered != fingerprints_.end()) {
+        auto range = addressees_.equal_range(registered->second);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == participant) {
+                addressees_.erase(it);
+                break;
+            }
+        }
+        fingerprints_.erase(registered);
+    }
     LOG_MSG("Participant removed. Total participants: " << participants_.size());
 }
 
-void ChatRoom::Broadcast(const std::vector<unsigned char>& msg,
-                         std::shared_ptr<Participant> participant)
-{
-    std::string dbgstr(msg.begin(), msg.end());
-    LOG_VEC("Broadcasting message", msg);
+void ChatRoom::BroadcastImpl(SharedFrame frame, bool relay, uint64_t owner_seq) {
+    // Добавление сообщения в журнал комнаты, номер кадра - его номер в журнале.
+    // Кадр от владельца комнаты (не relay) пишется под номером из его
+    // журнала, а без номера не пишется: своей нумерации у копии нет.
+    // После Drain журнал ведет новый процесс, кадр уходит без номера,
+    // как и в комнате без журнала
+    uint64_t seq = 0;
+    if (log_ && !draining_) {
+        if (relay) {
+            seq = log_->Append(frame->Payload(), frame->PayloadSize(), frame->SyncMarker());
+        } else if (owner_seq != 0) {
+            seq = log_->Append(frame->Payload(), frame->PayloadSize(), frame->SyncMarker(),
+                               owner_seq);
+        }
+    }
+    if (seq != 0) {
+        frame->AssignSeq(seq);
+    }
 
-    uint16_t msg_len = static_cast<uint16_t>(msg.size());
-    char len_bytes[2];
-    len_bytes[0] = static_cast<unsigned char>(msg_len & 0xFF); // младший байт
-    len_bytes[1] = static_cast<unsigned char>((msg_len >> 8) & 0xFF); // старший
+    LOG_MSG("Broadcasting to " << participants_.size() << " participants");
 
-    // Создаем новый вектор для сообщения с длиной в начале
-    std::vector<unsigned char> bcast;
-    bcast.insert(bcast.end(), len_bytes, len_bytes + 2);
-    bcast.insert(bcast.end(), msg.begin(), msg.end());
+    Metrics& metrics = Metrics::Get();
+    int64_t now = Metrics::NowNs();
+    metrics.RecordReadToBroadcast(now - frame->ReadNs());
+    metrics.RecordBroadcast(participants_.size());
+    frame->MarkBroadcast(now);
+    if (frame->TraceId() != 0) {
+        Tracer::Span("read->broadcast", frame->TraceId(), id_, 0, frame->ReadNs(), now);
+    }
 
-    // Debug print
-    LOG_ERR("bcast size:" << msg_len);
-    LOG_HEX("bcast size in hex", msg_len, 2);
-    LOG_VEC("bcast", bcast);
+    // Рассылка сообщения всем участникам: кадр передается шардам,
+    // и каждый раздает указатель на него своим участникам
+    for (auto& shard : shards_) {
+        if (shard->Size() > 0) {
+            shard->Deliver(frame);
+        }
+    }
+    if (relay && federation_) {
+        federation_->Relay(id_, frame);
+    }
+}
 
-    // Добавление сообщения в историю
-    recent_msgs_.push_back(bcast);
-    while (recent_msgs_.size() > max_recent_msgs) {
-        recent_msgs_.pop_front();
+void ChatRoom::RegisterImpl(std::shared_ptr<Participant> participant,
+                            const Fingerprint& fingerprint)
+{
+    // Регистрация только для участников комнаты и только одна
+    if (participants_.count(participant) == 0
+        || !fingerprints_.emplace(participant, fingerprint).second) {
+        return;
     }
+    addressees_.emplace(fingerprint, participant);
+    LOG_MSG("Participant registered for routed frames in room " << id_);
+}
 
-    LOG_MSG("Broadcasting to " << participants_.size() << " participants");
+void ChatRoom::RouteImpl(SharedFrame frame, const Fingerprint& recipient, bool relay) {
+    Metrics& metrics = Metrics::Get();
+    int64_t now = Metrics::NowNs();
+    metrics.RecordReadToBroadcast(now - frame->ReadNs());
+    frame->MarkBroadcast(now);
+    if (frame->TraceId() != 0) {
+        Tracer::Span("read->broadcast", frame->TraceId(), id_, 0, frame->ReadNs(), now);
+    }
+
+    auto range = addressees_.equal_range(recipient);
+    std::size_t recipients = 0;
+    for (auto it = range.first; it != range.second; ++it) {
+        // Через шард получателя, как и рассылка: иначе адресный кадр
+        // обгонял бы кадры, еще стоящие в очереди шарда
+        ShardOf(it->second).DeliverTo(it->second, frame);
+        ++recipients;
+    }
+    metrics.RecordRouted(recipients);
+    // Получатель может быть и на других узлах
+    if (relay && federation_) {
+        federation_->RelayRouted(id_, recipient, frame);
+    }
+}
+
+void ChatRoom::ReplayImpl(std::shared_ptr<Participant> participant,
+                          uint64_t from, uint64_t to)
+{
+    // Кадры копируются из mmap журнала и уходят участнику одной пачкой
+    if (!log_) {
+        return;
+    }
+    std::vector<SharedFrame> frames;
+    log_->Replay(from, to,
+                [this, &frames](uint64_t seq, const unsigned char* payload,
+                                std::size_t size, bool sync_marker) {
+                    frames.push_back(Frame::Make(id_, payload, size, sync_marker));
+                    frames.back()->AssignSeq(seq);
+                });
+    if (!frames.empty()) {
+        participant->OnMessages(frames);
+    }
+}
+
+std::size_t ChatRoom::Size() const {
+    return size_.load(std::memory_order_relaxed);
+}
+
+void ChatRoom::Inspect(InspectHandler handler) {
+    // Редкий запрос администратора: обычный post, без пачек и пулов
+    // Комнату могут выселить, пока запрос ждет strand
+    auto self = shared_from_this();
+    strand_.post([this, self, handler]() {
+        std::vector<MemberInfo> members;
+        members.reserve(participants_.size());
+        for (const auto& participant : participants_) {
+            auto registered = fingerprints_.find(participant);
+            MemberInfo info{participant->Stats(),
+                            registered != fingerprints_.end(), Fingerprint()};
+            if (info.registered) {
+                info.fingerprint = registered->second;
+            }
+            members.push_back(info);
+        }
+        handler(members);
+    });
+}
+
+void ChatRoom::Evict(std::function<bool()> remove) {
+    auto self = shared_from_this();
+    strand_.post([this, self, remove]() {
+        // Пока выселение ждало strand, в комнату могли войти снова
+        if (participants_.empty() && remove()) {
+            log_.reset();
+            // RunTasks шардов держит сырой указатель: комната живет,
+            // пока каждый шард не разберет уже поставленные задачи
+            for (auto& shard : shards_) {
+                shard->Retire(self);
+            }
+        }
+    });
+}
+
+void ChatRoom::Drain(std::function<void()> done) {
+    auto self = shared_from_this();
+    strand_.post([this, self, done]() {
+        draining_ = true;
+        for (const auto& participant : participants_) {
+            participant->Drain();
+        }
+        done();
+    });
+}
 
-    // Рассылка сообщения всем участникам
-    std::for_each(participants_.begin(), participants_.end(),
-                  boost::bind(&Participant::OnMessage, _1, std::ref(bcast)));
+RoomShard& ChatRoom::ShardOf(const std::shared_ptr<Participant>& participant) {
+    return *shards_[participant->Worker() % shards_.size()];
 }
 
 std::string ChatRoom::GetNickname(std::shared_ptr<Participant> participant) {
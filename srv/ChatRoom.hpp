@@ -6,26 +6,164 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include "Participant.hpp"
+#include "RoomLog.hpp"
+#include "Config.hpp"
+#include "Metrics.hpp"
 #include "Protocol.hpp"
 #include "Utils.hpp"
 #include "Message.hpp"
+#include "HandlerAllocator.hpp"
+#include "TokenBucket.hpp"
+#include "RoomShard.hpp"
+#include "IoServicePool.hpp"
 
-class ChatRoom {
+class Federation;
+
+// Состояние комнаты защищено собственным strand: Enter, Leave и Broadcast
+// можно вызывать из любого потока, сами изменения выполняются в strand_.
+// Вызовы копятся во входящих под мьютексом и разбираются RunTasks
+// в strand_ пачками, в порядке поступления: один post на пачку
+// вместо выделения памяти под обработчик на каждый кадр.
+// Кадр комнаты уходит участникам через шарды (RoomShard), по одному
+// на рабочий поток: рассылка большой комнате идет во всех потоках
+// параллельно, а не занимает поток комнаты целиком.
+// В федерации (Federation.hpp) рассылкой комнаты занимается ее узел-
+// владелец: на остальных узлах Broadcast и Route только пересылают
+// сообщение ему, а в комнату кадры приходят от него через Receive.
+class ChatRoom : public std::enable_shared_from_this<ChatRoom> {
 public:
-    void Enter(std::shared_ptr<Participant> participant, const std::string& nickname);
+    // Участник комнаты глазами админ-сокета
+    struct MemberInfo {
+        ParticipantStats stats;
+        bool registered;
+        Fingerprint fingerprint;
+    };
+    typedef std::function<void(const std::vector<MemberInfo>&)> InspectHandler;
+
+    // Комната живет в потоке home пула, история хранится в журнале
+    // в каталоге log_dir; federation - nullptr, если узел один.
+    // Журнал, который не открылся, не мешает комнате: она работает
+    // без истории, кадры рассылаются без номеров
+    ChatRoom(IoServicePool& pool, std::size_t home, uint32_t room_id,
+             const std::string& log_dir, Federation* federation);
+    uint32_t Id() const;
+    // Вошедший получает последние history_recent кадров истории, а если
+    // указан last_seq (номер последнего кадра, полученного до обрыва
+    // связи), - только кадры после него, но тоже не больше history_recent
+    void Enter(std::shared_ptr<Participant> participant, const std::string& nickname,
+               uint64_t last_seq = 0);
     void Leave(std::shared_ptr<Participant> participant);
-    void Broadcast(
-        const std::vector<unsigned char>& msg, std::shared_ptr<Participant> participant);
+    // Кадр уходит всем участникам, в том числе отправителю.
+    // sync_marker - отправитель v1 прислал после msg синхромаркер (см. Frame)
+    void Broadcast(const unsigned char* msg, std::size_t size, bool sync_marker);
+    // Участник получает кадры, адресованные отпечатку его ключа
+    void Register(std::shared_ptr<Participant> participant,
+                  const Fingerprint& fingerprint);
+    // Кадр уходит только участникам с отпечатком recipient
+    // и не попадает в историю: она рассылается всем входящим
+    void Route(const Fingerprint& recipient, const unsigned char* msg, std::size_t size,
+               bool sync_marker);
+    // Списывает входящий кадр из ведер комнаты (можно из любого
+    // потока). Возвращает, сколько наносекунд отправителю не читать
+    // дальше, 0 - комната не перегружена
+    int64_t ChargeIngress(std::size_t size);
+    // Кадр от соседнего узла. forwarded - сообщение, пересланное этому
+    // узлу как владельцу: оно рассылается как свое и уходит подписчикам.
+    // Иначе это рассылка владельца, она достается только своим участникам
+    // и пишется в журнал под номером seq из журнала владельца (0 - кадр
+    // без номера, в журнал не пишется): клиент, переподключившийся
+    // к другому узлу, продолжит с того же номера. sync_marker - как
+    // в Broadcast, его передает узел, принявший сообщение от клиента
+    void Receive(const unsigned char* msg, std::size_t size, bool sync_marker,
+                 bool forwarded, uint64_t seq = 0);
+    void ReceiveRouted(const Fingerprint& recipient, const unsigned char* msg,
+                       std::size_t size, bool sync_marker, bool forwarded);
+    // Отправляет участнику кадры истории с номерами из [from, to)
+    void Replay(std::shared_ptr<Participant> participant, uint64_t from, uint64_t to);
+    // Число участников, можно читать из любого потока
+    std::size_t Size() const;
+    // Снимок участников: handler вызывается в strand_ комнаты
+    void Inspect(InspectHandler handler);
+    // Выселение пустой комнаты (RoomRegistry::Release): в strand_, если
+    // участников нет, remove снимает комнату с реестра, и тогда журнал
+    // закрывается. Шарды держат комнату, пока не выполнят свои задачи
+    void Evict(std::function<bool()> remove);
+    // Перезапуск: журнал больше не пишется, участники и все, кто войдет
+    // позже, отключаются (Participant::Drain). done вызывается
+    // в strand_, когда журнал уже не тронет ни один кадр
+    void Drain(std::function<void()> done);
+    // Вызывать только из strand_ комнаты
     std::string GetNickname(std::shared_ptr<Participant> participant);
 
 private:
-    enum { max_recent_msgs = 100 };
+    enum TaskKind {
+        TaskEnter,
+        TaskLeave,
+        TaskBroadcast,
+        TaskRegister,
+        TaskRoute
+    };
+
+    struct Task {
+        TaskKind kind;
+        std::shared_ptr<Participant> participant;
+        SharedFrame frame;
+        std::string nickname;
+        // Отпечаток участника (TaskRegister) или получателя (TaskRoute)
+        Fingerprint fingerprint;
+        // Последний полученный участником кадр (TaskEnter) или номер
+        // кадра в журнале владельца комнаты (TaskBroadcast от него)
+        uint64_t seq;
+        // Отправить разосланный кадр узлам-подписчикам федерации
+        bool relay;
+    };
+
+    void Schedule(Task task);
+    void RunTasks();
+    void EnterImpl(std::shared_ptr<Participant> participant, const std::string& nickname,
+                   uint64_t last_seq);
+    void LeaveImpl(std::shared_ptr<Participant> participant);
+    void BroadcastImpl(SharedFrame frame, bool relay, uint64_t owner_seq);
+    void RegisterImpl(std::shared_ptr<Participant> participant,
+                      const Fingerprint& fingerprint);
+    void RouteImpl(SharedFrame frame, const Fingerprint& recipient, bool relay);
+    void ReplayImpl(std::shared_ptr<Participant> participant, uint64_t from, uint64_t to);
+    RoomShard& ShardOf(const std::shared_ptr<Participant>& participant);
+
+    uint32_t id_;
+    Federation* federation_;
+    boost::asio::io_service::strand strand_;
     std::unordered_set<std::shared_ptr<Participant>> participants_;
+    // participants_.size() для чтения из чужих потоков
+    std::atomic<std::size_t> size_;
+    // Те же участники, разложенные по рабочим потокам для рассылки
+    std::vector<std::unique_ptr<RoomShard>> shards_;
     std::unordered_map<std::shared_ptr<Participant>, std::string> name_table_;
-    std::deque<std::vector<unsigned char>> recent_msgs_;
+    // Адресная доставка: участники по отпечатку (у одного ключа может
+    // быть несколько сессий) и обратная таблица для Leave
+    std::unordered_multimap<Fingerprint, std::shared_ptr<Participant>,
+                            FingerprintHash> addressees_;
+    std::unordered_map<std::shared_ptr<Participant>, Fingerprint> fingerprints_;
+    // nullptr - комната без истории
+    std::unique_ptr<RoomLog> log_;
+    // Журнал передан новому процессу
+    bool draining_;
+    // Входящие кадры всех участников комнаты, по числу и по байтам
+    TokenBucket ingress_frames_;
+    TokenBucket ingress_bytes_;
+
+    std::mutex inbox_mutex_;
+    std::vector<Task> inbox_;
+    std::vector<Task> running_;
+    HandlerMemory tasks_memory_;
 };
 
 #endif // CHATROOM_HPP
@@ -4,12 +4,31 @@
 std::string client_private_key_file;
 std::vector<std::string> recipient_public_key_files;
 
+// Длина сообщения v1 без синхромаркера в конце, если он там есть
+static std::size_t WithoutSyncMarker(const unsigned char* msg, std::size_t size) {
+    if (size < SYNC_MARKER_SIZE) {
+        return size;
+    }
+    for (std::size_t i = size - SYNC_MARKER_SIZE; i < size; ++i) {
+        if (msg[i] != 0) {
+            return size;
+        }
+    }
+    return size - SYNC_MARKER_SIZE;
+}
+
 Client::Client(const std::array<char, MAX_NICKNAME>& nickname,
                boost::asio::io_service& io_service,
                tcp::resolver::iterator endpoint_iterator)
     : io_service_(io_service),
+      endpoint_iterator_(endpoint_iterator),
       socket_(io_service),
-      read_timeout_timer_(io_service)
+      read_size_(0),
+      v2_seen_(false),
+      last_seq_(0),
+      reconnecting_(false),
+      read_timeout_timer_(io_service),
+      reconnect_timer_(io_service)
 {
     LOG_ERR("Initializing async connect");
     LOG_ERR("Io_service initialized");
@@ -35,6 +54,10 @@ Client::Client(const std::array<char, MAX_NICKNAME>& nickname,
     if (!client_private_key_) {
         abort();
     }
+    // Отпечаток считается по публичной части закрытого ключа
+    if (!Crypt::GetPubKeyFingerprint(client_private_key_, own_fingerprint_)) {
+        abort();
+    }
 
     // Загружаем публичные ключи получателей
     if (!recipient_public_key_files.empty()) {
@@ -44,6 +67,9 @@ Client::Client(const std::array<char, MAX_NICKNAME>& nickname,
             recipient_public_keys.push_back(public_key);
             std::string fingerprint = Crypt::GetPubKeyFingerprint(public_key);
             recipient_public_keys_fingerprints.push_back(fingerprint);
+            Fingerprint address;
+            Crypt::GetPubKeyFingerprint(public_key, address);
+            recipient_fingerprints_.push_back(address);
         }
     }
 
@@ -73,67 +99,63 @@ void Client::OnConnect(const boost::system::error_code& error) {
         // boost::asio::async_write(socket_,
         //                          boost::asio::buffer(nickname_, nickname_.size()),
         //                          boost::bind(&Client::ReadHandler, this, _1));
+        // Все, что не ушло в оборванное соединение, уходит заново
+        // целиком (недописанный кадр - тоже), но после ROOM_HELLO
+        // и ROOM_RESUME: сервер должен сначала узнать, кто мы
+        std::deque<std::vector<unsigned char>> unsent;
+        if (reconnecting_) {
+            unsent.swap(write_msgs_);
+            reconnecting_ = false;
+        }
+        // Сервер будет присылать нам только адресованные нам кадры
+        SendHello();
+        if (!unsent.empty()) {
+            LOG_MSG("Connection restored, resending " << unsent.size() << " messages");
+            write_msgs_.insert(write_msgs_.end(), std::make_move_iterator(unsent.begin()),
+                               std::make_move_iterator(unsent.end()));
+        }
         // Сразу начинаем чтение сообщений после установления соединения
-        // читаем сначала 2 байта заголовка
-        read_msg_.resize(2);
-        boost::asio::async_read(socket_,
-                                boost::asio::buffer(read_msg_.data(), 2),
-                                boost::bind(&Client::HeaderHandler, this, _1));
+        ReadSome();
+    } else if (reconnecting_) {
+        LOG_ERR("Reconnect failed: " << error.message());
+        Recover();
     } else {
         std::cerr << "\nOnConnect: Connection failed: " << error.message() << std::endl;
         CloseImpl();
     }
 }
 
-void Client::FindSyncMarker() {
-    // Буфер для одного байта
-    auto buffer = std::make_shared<std::vector<unsigned char>>(1);
-    // Начинаем чтение одного байта асинхронно
-    boost::asio::async_read(
-        socket_,
-        boost::asio::buffer(*buffer, 1),
-        [this, buffer](const boost::system::error_code& error, std::size_t) {
-            if (!error) {
-                // Проверяем нулевой байт и обновляем счетчик
-                if ((*buffer)[0] == 0x00) {
-                    ++zero_byte_count_;
-                } else {
-                    zero_byte_count_ = 0;
-                }
-
-                // Проверяем, достигли ли мы 32 нулевых байт подряд
-                if (zero_byte_count_ >= 32) {
-                    zero_byte_count_ = 0;
-                    LOG_ERR("Sync marker found, resuming normal operation");
-                    // Считываем длину следующего сообщения
-                    read_msg_.resize(2);
-                    boost::asio::async_read(
-                        socket_,
-                        boost::asio::buffer(read_msg_.data(), 2),
-                        boost::bind(&Client::HeaderHandler, this, _1));
-                } else {
-                    // Продолжаем поиск маркера
-                    FindSyncMarker();
-                }
-            } else {
-                LOG_ERR("Error during sync marker search: " + error.message());
-                CloseImpl();
-            }
-        });
-}
-
-bool Client::checkSyncMarkerInQueue() {
-    // Проверяем наличие 32 нулевых байт подряд в очереди
-    int zero_count = 0;
-    for (auto byte : read_queue_) {
-        if (byte == 0x00) {
-            zero_count++;
-            if (zero_count >= SYNC_MARKER_SIZE) return true;
-        } else {
-            zero_count = 0;
+void Client::SendHello() {
+    // [заголовок v2 ROOM_HELLO, room 0][отпечаток]; по первому кадру v2
+    // сервер и сам начинает отвечать кадрами v2
+    std::vector<unsigned char> hello(FRAME_V2_HEADER_SIZE);
+    hello.insert(hello.end(), own_fingerprint_.begin(), own_fingerprint_.end());
+    EncodeFrameV2Header(hello.data(), ROOM_HELLO, DEFAULT_ROOM,
+                        hello.data() + FRAME_V2_HEADER_SIZE, FINGERPRINT_SIZE);
+
+    // Вслед - номер последнего полученного кадра: сервер пришлет
+    // только пропущенные кадры истории, а не последние целиком
+    if (last_seq_ != 0) {
+        std::size_t resume = hello.size();
+        hello.resize(resume + FRAME_V2_HEADER_SIZE + FRAME_SEQ_SIZE);
+        unsigned char* seq = hello.data() + resume + FRAME_V2_HEADER_SIZE;
+        for (std::size_t i = 0; i < FRAME_SEQ_SIZE; ++i) {
+            seq[i] = static_cast<unsigned char>((last_seq_ >> (i * 8)) & 0xFF);
         }
+        EncodeFrameV2Header(hello.data() + resume, ROOM_RESUME, DEFAULT_ROOM,
+                            seq, FRAME_SEQ_SIZE);
+    }
+
+    // Раньше всех сообщений, но не перед тем, что уже пишется
+    bool write_in_progress = !write_msgs_.empty();
+    write_msgs_.insert(write_in_progress ? write_msgs_.begin() + 1 : write_msgs_.begin(),
+                       std::move(hello));
+    if (!write_in_progress) {
+        boost::asio::async_write(
+            socket_,
+            boost::asio::buffer(write_msgs_.front().data(), write_msgs_.front().size()),
+            boost::bind(&Client::WriteHandler, this, _1));
     }
-    return false;
 }
 
 void Client::HandleDataTimeout(const boost::system::error_code& error) {
@@ -171,173 +193,154 @@ void Client::Recover() {
         LOG_ERR("Error closing socket: " + ec.message());
     }
 
-    // Очистка всех буферов и очередей
-    read_queue_.clear();
-    std::vector<unsigned char>().swap(read_msg_); // Освобождение памяти
-
-    // Переподключение или повторная инициализация, если необходимо
-    // boost::asio::ip::tcp::resolver resolver(io_service_);
-    // auto endpoint_iterator = resolver.resolve({server_ip, server_port});
-    // socket_.open(endpoint_iterator->endpoint().protocol(), ec);
-    // if (!ec) {
-    //     socket_.async_connect(*endpoint_iterator,
-    //                           boost::bind(&Client::OnConnect, this, _1));
-    // } else {
-    //     LOG_ERR("Error re-opening socket: " + ec.message());
-    // }
+    // Очистка буфера приема
+    read_size_ = 0;
+    std::vector<unsigned char>().swap(read_buf_); // Освобождение памяти
+    read_timeout_timer_.cancel();
 
-    // Уведомление пользователя или системы, если необходимо
-    // Можно реализовать отправку уведомления через другие механизмы
+    // Переподключение: новое соединение снова начинается с v1,
+    // пока сервер не получит от нас кадр v2
+    reconnecting_ = true;
+    v2_seen_ = false;
+    reconnect_timer_.expires_from_now(boost::posix_time::seconds(RECONNECT_DELAY));
+    reconnect_timer_.async_wait(boost::bind(&Client::Reconnect, this, _1));
 }
 
-
-void Client::HeaderHandler(const boost::system::error_code& error) {
-    if (!error) {
-        // В данный момент мы знаем, что 2 байта длины пакета прочитаны
-        // и находятся в поле класса read_msg_
-        // Формируем два байта длины
-        uint16_t need_read_size =
-            (static_cast<uint16_t>(read_msg_[1]) << 8) |
-            static_cast<uint16_t>(read_msg_[0]);
-
-        LOG_HEX("need read (pack_sync_size-2) (hex)", need_read_size, 2);
-
-        // Добавляем прочитанные байты длины в очередь чтения
-        read_queue_.push_back(read_msg_[0]);
-        read_queue_.push_back(read_msg_[1]);
-
-        // Проверяем, не содержит ли очередь синхромаркер
-        if (checkSyncMarkerInQueue()) {
-            // Если очередь содержит синхромаркер, которого мы не ожидаем,
-            // то переходим к Recover
-            LOG_ERR("Error: Sync marker spotted");
-            Recover();
-            return;
-        }
-
-        // Проверка длины полученного сообщения
-        if (need_read_size < MIN_PACK_SIZE) {
-            // Слишком маленькая длина
-            LOG_HEX("Error: Message length is too SMALL (hex)", need_read_size, 2);
-            LOG_HEX("Expected (hex)", MIN_PACK_SIZE, 2);
-            Recover();
-        } else if (need_read_size > MAX_PACK_SIZE) {
-            // Слишком большая длина
-            LOG_HEX("Error: Message length is too LARGE (hex) ", need_read_size, 2);
-            LOG_HEX("Expected (hex)", MAX_PACK_SIZE, 2);
-            Recover();
-            return;
-        }
-
-        // Если мы тут, то все в порядке
-        // Обрезаем очередь до последних READ_QUEUE_SIZE элементов
-        if (read_queue_.size() > READ_QUEUE_SIZE) {
-            read_queue_.erase(
-                read_queue_.begin(),
-                read_queue_.begin() + (read_queue_.size() - READ_QUEUE_SIZE));
-        }
-
-        // Подготавливаем размер буфера для чтения данных сообщения
-        read_msg_.resize(need_read_size);
-
-        // Запускаем таймер ожидания данных (мы получили длину, ждем остальное)
-        read_timeout_timer_.expires_from_now(
-            boost::posix_time::seconds(boost::posix_time::seconds(READ_TIMEOUT)));
-        read_timeout_timer_.async_wait(
-            boost::bind(&Client::HandleDataTimeout, this, _1));
-
-        // Читаем остальные данные асинхронно
-        // _1 будет заменён на объект boost::system::error_code,
-        //     который предоставляет информацию об ошибке (или её отсутствии).
-        // _2 будет заменён на размер данных (тип std::size_t),
-        //     указывающий, сколько байт было успешно прочитано.
-        boost::asio::async_read(socket_,
-                                boost::asio::buffer(read_msg_.data(), need_read_size),
-                                boost::bind(&Client::ReadHandler, this, _1, _2));
-    } else {
-		LOG_MSG("Close in HeaderHandler");
-        CloseImpl();
+void Client::Reconnect(const boost::system::error_code& error) {
+    if (error) {
+        return;
     }
+    LOG_ERR("Reconnecting, last frame " << last_seq_);
+    boost::asio::async_connect(socket_, endpoint_iterator_,
+                               boost::bind(&Client::OnConnect, this, _1));
 }
 
 
+void Client::ReadSome() {
+    // Читаем сколько пришло, сразу за непрочитанным хвостом
+    read_buf_.resize(READ_BUFFER_SIZE);
+    socket_.async_read_some(
+        boost::asio::buffer(read_buf_.data() + read_size_,
+                            read_buf_.size() - read_size_),
+        boost::bind(&Client::ReadHandler, this, _1, _2));
+}
+
 void Client::ReadHandler(
     const boost::system::error_code& error,
     size_t bytes_readed)
 {
     if (error) {
-        // Если случилась ошибка - закрываем сокет и выходим
+        // Сокет закрыли мы сами - выходим, иначе связь оборвалась
+        // и ее нужно восстановить
         LOG_ERR("Error reading message: " << error.message());
-        CloseImpl();
+        if (error != boost::asio::error::operation_aborted) {
+            Recover();
+        }
         return;
     }
+    read_size_ += bytes_readed;
+
+    const unsigned char* begin = read_buf_.data();
+    const unsigned char* end = begin + read_size_;
+    const unsigned char* frame = begin;
+    while (end - frame >= static_cast<std::ptrdiff_t>(FRAME_V2_HEADER_SIZE)
+           || (!v2_seen_ && end - frame >= 2 && !IsFrameV2(frame))) {
+        // До первого кадра v2 сервер еще не знает нашего формата и шлет
+        // кадры v1 (например, историю комнаты): [длина][payload][маркер].
+        // Кадр v1 не начинается с magic: старший байт длины не бывает 0xF2
+        if (!v2_seen_ && !IsFrameV2(frame)) {
+            std::size_t length = (frame[0] | (frame[1] << 8)) & FRAME_LENGTH_MASK;
+            if (length > MAX_PACK_SIZE + SYNC_MARKER_SIZE) {
+                LOG_ERR("Error: Message length is too LARGE: " << length);
+                CloseImpl();
+                return;
+            }
+            if (static_cast<std::size_t>(end - frame) < 2 + length) {
+                break;
+            }
+            // Маркер есть только у сообщений, отправленных с ним
+            if (length > 0) {
+                HandleMessage(frame + 2, WithoutSyncMarker(frame + 2, length));
+            }
+            frame += 2 + length;
+            continue;
+        }
 
-    // Проверяем, соответствует ли количество прочитанных байт ожидаемому
-    if (bytes_readed != read_msg_.size()) {
-        LOG_ERR("Error: Mismatch in the number of bytes read. Expected: "
-                + std::to_string(read_msg_.size()) + ", Read: "
-                + std::to_string(bytes_readed));
-        Recover();
-        return;
+        // Дальше все, что не начинается с magic, - мусор после сбоя:
+        // пропускаем его одним проходом memchr, а не по байту
+        FrameV2Header header;
+        if (!DecodeFrameV2Header(frame, header)) {
+            LOG_ERR("Frame v2 header expected, resync");
+            frame = FindFrameV2(frame + 1, end);
+            continue;
+        }
+        if (end - frame < static_cast<std::ptrdiff_t>(FRAME_V2_HEADER_SIZE + header.length)) {
+            break;
+        }
+        const unsigned char* payload = frame + FRAME_V2_HEADER_SIZE;
+        if (!CheckFrameV2Crc(frame, header, payload)) {
+            LOG_ERR("Frame v2 crc mismatch, resync");
+            frame = FindFrameV2(frame + 1, end);
+            continue;
+        }
+        v2_seen_ = true;
+        if (header.op == ROOM_MSG) {
+            HandleMessage(payload, header.length);
+        } else if (header.op == ROOM_SEQ_MSG && header.length >= FRAME_SEQ_SIZE) {
+            // Номер запоминаем, чтобы после обрыва не получать кадр снова
+            uint64_t seq = 0;
+            for (std::size_t i = 0; i < FRAME_SEQ_SIZE; ++i) {
+                seq |= static_cast<uint64_t>(payload[i]) << (i * 8);
+            }
+            if (seq <= last_seq_) {
+                LOG_ERR("Duplicate frame " << seq << " skipped");
+            } else {
+                last_seq_ = seq;
+                HandleMessage(payload + FRAME_SEQ_SIZE, header.length - FRAME_SEQ_SIZE);
+            }
+        }
+        frame = payload + header.length;
     }
 
-    // Отменяем таймер, поскольку данные были успешно прочитаны
-    read_timeout_timer_.cancel();
-
-    // Тут мы уже получаем само сообщение, без его длины
-    // потому что длина была отрезана в HeaderHandler,
-    // но sync_marker в конце присутствует
-    std::vector<unsigned char> received_msg(read_msg_.begin(), read_msg_.end());
+    // Хвост неполного кадра переносим в начало буфера
+    read_size_ = end - frame;
+    std::memmove(read_buf_.data(), frame, read_size_);
 
-    uint16_t received_msg_size = received_msg.size();
-
-    // Debug print
-    LOG_HEX("Received message size in hex", received_msg_size, 2);
-    LOG_VEC("Received message", received_msg);
-
-
-    if (read_msg_.size() < SYNC_MARKER_SIZE) {
-        // По идее, сообщение не может быть размером меньше чем sync_marker
-        // но если в будущем это изменится, то проверка пригодится
-        LOG_ERR("Sync marker not found or not in the correct position.");
-        Recover();
+    // Пока висит неполный кадр, ждем его остаток не дольше READ_TIMEOUT
+    if (read_size_ > 0) {
+        read_timeout_timer_.expires_from_now(boost::posix_time::seconds(READ_TIMEOUT));
+        read_timeout_timer_.async_wait(
+            boost::bind(&Client::HandleDataTimeout, this, _1));
+    } else {
+        read_timeout_timer_.cancel();
     }
 
-    // Проверяем наличие синхромаркера в конце сообщения
-    bool sync_marker_found = true;
-    for (size_t i = read_msg_.size() - SYNC_MARKER_SIZE; i < read_msg_.size(); i++)
-    {
-        if (read_msg_[i] != 0) {
-            sync_marker_found = false;
-            break;
-        }
-    }
-    if (!sync_marker_found) {
-        LOG_ERR("Sync marker not found or not in the correct position.");
-        Recover();
-        return;
-    }
+    ReadSome();
+}
 
-    // Перед декодированием надо отрезать sync_marker
-    received_msg.resize(received_msg.size() - SYNC_MARKER_SIZE);
+void Client::HandleMessage(const unsigned char* payload, std::size_t size) {
+    std::vector<unsigned char> received_msg(payload, payload + size);
 
+    // Debug print
+    LOG_HEX("Received message size in hex", static_cast<uint16_t>(size), 2);
+    LOG_VEC("Received message", received_msg);
 
     // Для каждого из известных нам абонентов
     for (auto i = 0; i < recipient_public_keys.size(); ++i) {
-        std::string decrypted_msg =
-            Crypt::decipher(client_private_key_, recipient_public_keys[i],
-                            received_msg);
+        // В комнате бывают и чужие, не зашифрованные нам кадры
+        std::string decrypted_msg;
+        try {
+            decrypted_msg = Crypt::decipher(client_private_key_,
+                                            recipient_public_keys[i], received_msg);
+        } catch (const std::exception& e) {
+            LOG_ERR("Cannot decipher message: " << e.what());
+        }
         if (decrypted_msg.empty()) {
             LOG_ERR("Received message is not for me");
         } else {
             LOG_MSG(decrypted_msg);
         }
     }
-    // Снова начинаем чтение заголовка следующего сообщения
-    read_msg_.resize(2); // готовим буфер для чтения следующего заголовка
-    boost::asio::async_read(socket_,
-                            boost::asio::buffer(read_msg_.data(), 2),
-                            boost::bind(&Client::HeaderHandler, this, _1));
 }
 
 void Client::WriteImpl(std::vector<unsigned char> msg) {
@@ -348,9 +351,6 @@ void Client::WriteImpl(std::vector<unsigned char> msg) {
     // Строка нужна для передачи криптору
     std::string msg_str(msg.begin(), msg.end());
 
-    // sync_marker : 32 нулевых байта
-    std::vector<unsigned char> sync_marker(32, 0);
-
     // Для каждого из ключей получателей..
     for (auto i = 0; i < recipient_public_keys.size(); ++i) {
         // Шифрование
@@ -364,34 +364,25 @@ void Client::WriteImpl(std::vector<unsigned char> msg) {
         LOG_HEX("encrypted_msg_size [envelope_chunk_size[envelope]] (hex)",
                 encrypted_msg_size, 2);
 
-        // Инициализация вектора packed_msg данными из encrypted_msg
-        std::vector<unsigned char> packed_msg(
-            encrypted_msg.begin(), encrypted_msg.end());
-
-        // Вставка синхромаркера в конец packed_msg
-        // [envelope_chunk_size[envelope]]+[sync_marker]
-        packed_msg.insert(packed_msg.end(), sync_marker.begin(), sync_marker.end());
+        // Место под заголовок v2, затем адрес получателя: сервер
+        // отдаст кадр только ему
+        // [header][fingerprint]+[envelope_chunk_size[envelope]]
+        std::vector<unsigned char> packed_msg(FRAME_V2_HEADER_SIZE);
+        packed_msg.insert(packed_msg.end(), recipient_fingerprints_[i].begin(),
+                          recipient_fingerprints_[i].end());
+        packed_msg.insert(packed_msg.end(), encrypted_msg.begin(), encrypted_msg.end());
 
-        // Вычисляем размер [envelope_chunk_size[envelope]]+[sync_marker]
-        uint16_t pack_sync_size =
-            static_cast<uint16_t>(packed_msg.size());
-
-        // Помещаем длину вперед
-        unsigned char len_bytes[2];
-        len_bytes[0] = // младший байт первым
-            static_cast<unsigned char>(pack_sync_size & 0xFF);
-        len_bytes[1] = // старший байт вторым
-            static_cast<unsigned char>((pack_sync_size >> 8) & 0xFF);
-        // Вставка двух байтов длины в начало packed_msg
-        // [pack_sync_size[[envelope_chunk_size[envelope]]+[sync_marker]]]
-        packed_msg.insert(packed_msg.begin(), len_bytes, len_bytes + 2);
+        // Заголовок с длиной и crc32c всего, что за ним
+        EncodeFrameV2Header(packed_msg.data(), ROOM_ROUTED, DEFAULT_ROOM,
+                            packed_msg.data() + FRAME_V2_HEADER_SIZE,
+                            packed_msg.size() - FRAME_V2_HEADER_SIZE);
 
         // Вычисляем длину packed_msg_size
-        // [pack_sync_size[[envelope_chunk_size[envelope]]+[sync_marker]]]
+        // [header][fingerprint]+[envelope_chunk_size[envelope]]
         uint16_t packed_msg_size = static_cast<uint16_t>(packed_msg.size());
 
         // Debug print packed msg size
-        LOG_HEX("packed_msg_size = [pack_sync_size[[envelope_chunk_size[envelope]]+[sync_marker]]] (hex)", packed_msg_size, 2);
+        LOG_HEX("packed_msg_size = [header][fingerprint]+[envelope_chunk_size[envelope]] (hex)", packed_msg_size, 2);
         LOG_VEC("packed_msg", packed_msg);
 
         // Теперь добавляем packed_msg в очередь сообщений на отправку
@@ -402,7 +393,8 @@ void Client::WriteImpl(std::vector<unsigned char> msg) {
     // сообщения в сокет. Когда асинхронная запись завершится, вызывается
     // функция-обработчик WriteHandler. Она проверит есть ли еще что-то
     // в очереди, и если есть - отправит сообщения асинхронно.
-    if (!write_in_progress) {
+    // Пока связь восстанавливается, сообщения только копятся в очереди
+    if (!write_in_progress && !reconnecting_) {
         boost::asio::async_write(
             socket_,
             boost::asio::buffer(write_msgs_.front().data(), write_msgs_.front().size()),
@@ -425,6 +417,9 @@ void Client::WriteHandler(const boost::system::error_code& error) {
 									write_msgs_.front().size()),
                 boost::bind(&Client::WriteHandler, this, _1));
         }
+    } else if (error == boost::asio::error::operation_aborted || reconnecting_) {
+        // Запись прервал Recover: очередь отправится после переподключения
+        LOG_ERR("Write interrupted: " << error.message());
     } else {
         LOG_ERR("Error writing message: " << error.message());
         CloseImpl();
@@ -3,6 +3,7 @@
 #define CLIENT_HPP
 
 #include <deque>
+#include <iterator>
 #include <array>
 #include <iostream>
 #include <optional>
@@ -19,6 +20,7 @@
 #include <openssl/rand.h>
 #include <boost/bind.hpp>
 #include "Protocol.hpp"
+#include "FrameV2.hpp"
 #include "Message.hpp"
 #include "Crypt.hpp"
 #include "Utils.hpp"
@@ -40,26 +42,42 @@ public:
 
 private:
     void OnConnect(const boost::system::error_code& error);
-    void FindSyncMarker();
-    bool checkSyncMarkerInQueue();
+    // Регистрирует на сервере отпечаток своего ключа (ROOM_HELLO),
+    // после переподключения - и запрашивает пропущенное (ROOM_RESUME)
+    void SendHello();
     void HandleDataTimeout(const boost::system::error_code& error);
+    // Закрывает соединение и через RECONNECT_DELAY подключается заново
     void Recover();
-    void HeaderHandler(const boost::system::error_code& error);
+    void Reconnect(const boost::system::error_code& error);
+    void ReadSome();
+    // Разбирает все целые кадры v2 в буфере приема
     void ReadHandler(const boost::system::error_code& error, size_t bytes_readed);
+    void HandleMessage(const unsigned char* payload, std::size_t size);
     void WriteImpl(std::vector<unsigned char> msg);
     void WriteHandler(const boost::system::error_code& error);
     void CloseImpl();
 
     boost::asio::io_service& io_service_;
+    tcp::resolver::iterator endpoint_iterator_;
     tcp::socket socket_;
-    std::vector<unsigned char> read_msg_;
+    // Буфер приема: read_size_ байт еще не разобраны (хвост неполного кадра)
+    std::vector<unsigned char> read_buf_;
+    std::size_t read_size_;
+    // Пришел первый кадр v2: дальше сервер пишет только v2
+    bool v2_seen_;
+    // Номер последнего полученного кадра комнаты, 0 - еще не было
+    uint64_t last_seq_;
+    // Соединение восстанавливается после обрыва
+    bool reconnecting_;
     std::deque<std::vector<unsigned char>> write_msgs_;
     std::array<char, MAX_NICKNAME> nickname_;
     EVP_PKEY* client_private_key_;
     std::vector<EVP_PKEY*> recipient_public_keys;
     std::vector<std::string> recipient_public_keys_fingerprints;
-    size_t zero_byte_count_;
+    // Те же отпечатки байтами - адреса кадров ROOM_ROUTED
+    std::vector<Fingerprint> recipient_fingerprints_;
+    Fingerprint own_fingerprint_;
     boost::asio::deadline_timer read_timeout_timer_;
-    std::deque<unsigned char> read_queue_;
+    boost::asio::deadline_timer reconnect_timer_;
 };
 #endif // CLIENT_HPP
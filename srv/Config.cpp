@@ -0,0 +1,107 @@
+// Config.cpp
+#include <cstdlib>
+#include "Config.hpp"
+
+namespace {
+
+// Числовые параметры, которые можно менять во время работы
+struct Knob {
+    const char* name;
+    std::atomic<std::size_t> Config::* field;
+};
+
+const Knob KNOBS[] = {
+    {"queue-frames", &Config::send_queue_max_frames},
+    {"queue-bytes", &Config::send_queue_max_bytes},
+    {"read-timeout", &Config::read_timeout},
+    {"idle-timeout", &Config::idle_timeout},
+    {"session-frames-per-sec", &Config::session_frames_per_sec},
+    {"session-bytes-per-sec", &Config::session_bytes_per_sec},
+    {"room-frames-per-sec", &Config::room_frames_per_sec},
+    {"room-bytes-per-sec", &Config::room_bytes_per_sec},
+    {"max-rooms", &Config::rooms_max},
+    {"session-rooms", &Config::session_rooms_max},
+    {"history-recent", &Config::history_recent},
+    {"trace-sample", &Config::trace_sample}
+};
+
+} // namespace
+
+Config::Config()
+    : send_queue_max_frames(SEND_QUEUE_MAX_FRAMES),
+      send_queue_max_bytes(SEND_QUEUE_MAX_BYTES),
+      slow_consumer_policy(DropOldest),
+      read_timeout(READ_TIMEOUT),
+      idle_timeout(IDLE_TIMEOUT),
+      session_frames_per_sec(SESSION_FRAMES_PER_SEC),
+      session_bytes_per_sec(SESSION_BYTES_PER_SEC),
+      room_frames_per_sec(ROOM_FRAMES_PER_SEC),
+      room_bytes_per_sec(ROOM_BYTES_PER_SEC),
+      rooms_max(ROOMS_MAX),
+      session_rooms_max(SESSION_ROOMS_MAX),
+      history_recent(HISTORY_RECENT),
+      trace_sample(TRACE_SAMPLE),
+      history_dir("history")
+{
+}
+
+Config& Config::Get() {
+    static Config config;
+    return config;
+}
+
+bool Config::ParsePolicy(const std::string& name, SlowConsumerPolicy& policy) {
+    if (name == "drop-oldest") {
+        policy = DropOldest;
+    } else if (name == "latest") {
+        policy = SkipToLatest;
+    } else if (name == "disconnect") {
+        policy = Disconnect;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* Config::PolicyName(SlowConsumerPolicy policy) {
+    switch (policy) {
+    case DropOldest:
+        return "drop-oldest";
+    case SkipToLatest:
+        return "latest";
+    case Disconnect:
+        return "disconnect";
+    }
+    return "unknown";
+}
+
+bool Config::Set(const std::string& name, const std::string& value) {
+    if (name == "slow-policy") {
+        SlowConsumerPolicy policy;
+        if (!ParsePolicy(value, policy)) {
+            return false;
+        }
+        slow_consumer_policy = policy;
+        return true;
+    }
+
+    char* end = nullptr;
+    unsigned long long number = std::strtoull(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || value[0] == '-') {
+        return false;
+    }
+    for (const auto& knob : KNOBS) {
+        if (name == knob.name) {
+            (this->*knob.field).store(number);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Config::Dump(std::ostream& out) const {
+    for (const auto& knob : KNOBS) {
+        out << knob.name << " " << (this->*knob.field).load() << "\n";
+    }
+    out << "slow-policy " << PolicyName(slow_consumer_policy.load()) << "\n";
+}
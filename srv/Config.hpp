@@ -0,0 +1,71 @@
+// Config.hpp
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include "RoomLog.hpp"
+#include "defs.hpp"
+
+// Что делать с участником, который не успевает читать
+enum SlowConsumerPolicy {
+    DropOldest,     // выкинуть самые старые неотправленные кадры
+    SkipToLatest,   // выкинуть все неотправленные, оставить только новый
+    Disconnect      // отключить участника
+};
+
+/**
+   Настройки сервера. Заполняются из командной строки при старте.
+   Атомарные поля можно читать из любого потока в любой момент,
+   остальные задаются только до запуска рабочих потоков.
+*/
+class Config {
+public:
+    static Config& Get();
+
+    static bool ParsePolicy(const std::string& name, SlowConsumerPolicy& policy);
+    static const char* PolicyName(SlowConsumerPolicy policy);
+
+    // Меняет атомарный параметр во время работы. name - ключ командной
+    // строки без "--" (например, idle-timeout); false - такого параметра
+    // нет или значение не разобрать
+    bool Set(const std::string& name, const std::string& value);
+    // Атомарные параметры строками "имя значение", имена - как для Set
+    void Dump(std::ostream& out) const;
+
+    std::atomic<std::size_t> send_queue_max_frames;
+    std::atomic<std::size_t> send_queue_max_bytes;
+    std::atomic<SlowConsumerPolicy> slow_consumer_policy;
+
+    // Сколько секунд ждать остаток начатого кадра
+    std::atomic<std::size_t> read_timeout;
+    // Через сколько секунд без входящих данных отключать сессию, 0 - никогда
+    std::atomic<std::size_t> idle_timeout;
+
+    // Ведра токенов на входе: кадров и байт в секунду от одной сессии
+    // и от всех сессий в одну комнату, 0 - без ограничения
+    std::atomic<std::size_t> session_frames_per_sec;
+    std::atomic<std::size_t> session_bytes_per_sec;
+    std::atomic<std::size_t> room_frames_per_sec;
+    std::atomic<std::size_t> room_bytes_per_sec;
+
+    // Сколько комнат может быть на узле и в скольких одновременно
+    // может состоять одна сессия
+    std::atomic<std::size_t> rooms_max;
+    std::atomic<std::size_t> session_rooms_max;
+    // Сколько последних кадров истории отдавать вошедшему участнику
+    std::atomic<std::size_t> history_recent;
+    // Трассируется каждый trace_sample-й кадр (если задан --trace-file),
+    // 0 - ни один
+    std::atomic<std::size_t> trace_sample;
+    // Каталог журналов комнат и параметры сегментов
+    std::string history_dir;
+    RoomLogOptions history;
+
+private:
+    Config();
+};
+
+#endif // CONFIG_HPP
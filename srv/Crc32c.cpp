@@ -0,0 +1,92 @@
+// Crc32c.cpp
+#include <cstring>
+#include "Crc32c.hpp"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// Отраженный полином Castagnoli
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+
+namespace {
+
+struct Crc32cTable {
+    uint32_t entries[256];
+
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+uint32_t Crc32cBytewise(const unsigned char* data, std::size_t size, uint32_t crc) {
+    static const Crc32cTable table;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t Crc32cSse42(const unsigned char* data, std::size_t size, uint32_t crc) {
+    uint64_t crc64 = crc;
+    while (size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (size > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        --size;
+    }
+    return crc;
+}
+#endif
+
+typedef uint32_t (*Crc32cImpl)(const unsigned char*, std::size_t, uint32_t);
+
+Crc32cImpl ChooseCrc32c() {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return Crc32cSse42;
+    }
+#endif
+    return Crc32cBytewise;
+}
+
+} // namespace
+
+uint32_t Crc32c(const void* data, std::size_t size, uint32_t crc) {
+    static const Crc32cImpl impl = ChooseCrc32c();
+    return ~impl(static_cast<const unsigned char*>(data), size, ~crc);
+}
+
+uint32_t Crc32cSoftware(const void* data, std::size_t size, uint32_t crc) {
+    return ~Crc32cBytewise(static_cast<const unsigned char*>(data), size, ~crc);
+}
+
+bool Crc32cHardwareSupported() {
+#if defined(__x86_64__)
+    return __builtin_cpu_supports("sse4.2");
+#else
+    return false;
+#endif
+}
+
+uint32_t Crc32cHardware(const void* data, std::size_t size, uint32_t crc) {
+#if defined(__x86_64__)
+    return ~Crc32cSse42(static_cast<const unsigned char*>(data), size, ~crc);
+#else
+    return Crc32cSoftware(data, size, crc);
+#endif
+}
@@ -0,0 +1,23 @@
+// Crc32c.hpp
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+   CRC32C (Castagnoli), как в iSCSI и ext4. На x86-64 с SSE4.2
+   считается инструкцией crc32 по 8 байт за раз, иначе - таблично
+   по байту. Выбор делается один раз, при первом вызове.
+   Crc32c(data, size) - CRC блока; для блока из нескольких частей
+   crc предыдущей части передается в следующий вызов.
+*/
+uint32_t Crc32c(const void* data, std::size_t size, uint32_t crc = 0);
+
+// Обе реализации по отдельности, для тестов. Crc32cHardware можно
+// вызывать, только если Crc32cHardwareSupported()
+uint32_t Crc32cSoftware(const void* data, std::size_t size, uint32_t crc = 0);
+bool Crc32cHardwareSupported();
+uint32_t Crc32cHardware(const void* data, std::size_t size, uint32_t crc = 0);
+
+#endif // CRC32C_HPP
@@ -31,33 +31,44 @@ EVP_PKEY* Crypt::LoadKeyFromFile(const std::string& key_file, bool is_private,
 }
 
 std::string Crypt::GetPubKeyFingerprint(EVP_PKEY* public_key) {
+    Fingerprint fingerprint;
+    if (!GetPubKeyFingerprint(public_key, fingerprint)) {
+        return "";
+    }
+
+    std::stringstream ss;
+    for (unsigned char byte : fingerprint) {
+        ss << std::hex << std::setw(2) << std::setfill('0')
+           << static_cast<int>(byte);
+    }
+
+    return ss.str();
+}
+
+bool Crypt::GetPubKeyFingerprint(EVP_PKEY* public_key, Fingerprint& fingerprint) {
     unsigned char* der = nullptr;
     int len = i2d_PUBKEY(public_key, &der);
     if (len < 0) {
         std::cerr << ":> Client::GetPubKeyFingerprint(): PubKeyFingerprint error: "
                   << "Failed to convert PubKey to DER format"
                   << std::endl;
-        return "";
+        return false;
     }
 
     unsigned char hash[EVP_MAX_MD_SIZE];
     unsigned int hash_len;
-    if (!EVP_Digest(der, len, hash, &hash_len, EVP_sha256(), nullptr)) {
+    if (!EVP_Digest(der, len, hash, &hash_len, EVP_sha256(), nullptr)
+        || hash_len != FINGERPRINT_SIZE) {
         OPENSSL_free(der);
         std::cerr << ":> Client::GetPubKeyFingerprint(): PubKeyFingerprint error: "
                   << "Failed to compute SHA-256 hash of public key"
                   << std::endl;
-        return "";
+        return false;
     }
     OPENSSL_free(der);
 
-    std::stringstream ss;
-    for (unsigned int i = 0; i < hash_len; ++i) {
-        ss << std::hex << std::setw(2) << std::setfill('0')
-           << static_cast<int>(hash[i]);
-    }
-
-    return ss.str();
+    std::copy(hash, hash + FINGERPRINT_SIZE, fingerprint.begin());
+    return true;
 }
 
 std::array<unsigned char, HASH_SIZE> Crypt::calcCRC(
@@ -16,6 +16,7 @@
 #include <iostream>
 #include <cstring>
 #include "Utils.hpp"
+#include "Protocol.hpp"
 
 class Crypt {
 public:
@@ -24,6 +25,8 @@ public:
         const std::string& key_file, bool is_private, const std::string& password = "");
 
     static std::string GetPubKeyFingerprint(EVP_PKEY* public_key);
+    // Тот же отпечаток байтами, как он идет в кадрах; false - ошибка
+    static bool GetPubKeyFingerprint(EVP_PKEY* public_key, Fingerprint& fingerprint);
 
     static std::array<unsigned char, HASH_SIZE> calcCRC(
         const std::string& message);
@@ -0,0 +1,415 @@
+// Federation.cpp
+#include <algorithm>
+#include <stdexcept>
+#include "Federation.hpp"
+#include "RoomRegistry.hpp"
+#include "Handoff.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+Federation::Federation(boost::asio::io_service& io_service, const std::string& self,
+                       const std::vector<std::string>& peers)
+    : io_service_(io_service),
+      strand_(io_service),
+      acceptor_(io_service),
+      self_(self),
+      peers_(peers),
+      registry_(nullptr),
+      hello_(Encode(PEER_HELLO, 0, nullptr, 0,
+                    reinterpret_cast<const unsigned char*>(self.data()), self.size()))
+{
+    ring_.Assign(std::vector<std::string>{self_});
+    Handoff::Get().Open(acceptor_, ParseEndpoint(self));
+}
+
+void Federation::Start(RoomRegistry& registry) {
+    registry_ = &registry;
+    strand_.dispatch([this]() {
+        Accept();
+        for (const auto& peer : peers_) {
+            // Из пары узлов подключается тот, чье имя меньше:
+            // между двумя узлами ровно одна связь
+            if (self_ < peer) {
+                Dial(peer);
+            }
+        }
+    });
+}
+
+bool Federation::Owns(uint32_t room_id) {
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    return ring_.Owner(room_id) == self_;
+}
+
+static uint8_t PeerFlags(bool sync_marker) {
+    return sync_marker ? PEER_SYNC_MARKER : 0;
+}
+
+void Federation::Forward(uint32_t room_id, const unsigned char* msg, std::size_t size,
+                         bool sync_marker)
+{
+    // Кадр собирается в потоке отправителя, strand федерации его только ставит в очередь
+    unsigned char flags[PEER_FLAGS_SIZE] = { PeerFlags(sync_marker) };
+    Message message = Encode(PEER_FORWARD, room_id, flags, PEER_FLAGS_SIZE, msg, size);
+    strand_.post([this, room_id, message]() { SendForward(room_id, message); });
+}
+
+void Federation::ForwardRouted(uint32_t room_id, const Fingerprint& recipient,
+                               const unsigned char* msg, std::size_t size, bool sync_marker)
+{
+    unsigned char prefix[FINGERPRINT_SIZE + PEER_FLAGS_SIZE];
+    std::copy(recipient.begin(), recipient.end(), prefix);
+    prefix[FINGERPRINT_SIZE] = PeerFlags(sync_marker);
+    Message message = Encode(PEER_FORWARD_ROUTED, room_id,
+                             prefix, sizeof(prefix), msg, size);
+    strand_.post([this, room_id, message]() { SendForward(room_id, message); });
+}
+
+void Federation::Relay(uint32_t room_id, const SharedFrame& frame) {
+    // Кадр для соседей собирается, только если они есть
+    strand_.post([this, room_id, frame]() {
+        if (subscribers_.count(room_id) == 0) {
+            return;
+        }
+        // Номер из журнала владельца: подписчики пишут кадр под ним же
+        unsigned char prefix[FRAME_SEQ_SIZE + PEER_FLAGS_SIZE];
+        for (std::size_t i = 0; i < FRAME_SEQ_SIZE; ++i) {
+            prefix[i] = static_cast<unsigned char>((frame->Seq() >> (i * 8)) & 0xFF);
+        }
+        prefix[FRAME_SEQ_SIZE] = PeerFlags(frame->SyncMarker());
+        SendRelay(room_id, Encode(PEER_RELAY, room_id, prefix, sizeof(prefix),
+                                  frame->Payload(), frame->PayloadSize()));
+    });
+}
+
+void Federation::RelayRouted(uint32_t room_id, const Fingerprint& recipient,
+                             const SharedFrame& frame)
+{
+    strand_.post([this, room_id, recipient, frame]() {
+        if (subscribers_.count(room_id) == 0) {
+            return;
+        }
+        unsigned char prefix[FINGERPRINT_SIZE + PEER_FLAGS_SIZE];
+        std::copy(recipient.begin(), recipient.end(), prefix);
+        prefix[FINGERPRINT_SIZE] = PeerFlags(frame->SyncMarker());
+        SendRelay(room_id, Encode(PEER_RELAY_ROUTED, room_id, prefix, sizeof(prefix),
+                                  frame->Payload(), frame->PayloadSize()));
+    });
+}
+
+void Federation::Join(uint32_t room_id) {
+    strand_.post([this, room_id]() { Subscribe(room_id); });
+}
+
+void Federation::Leave(uint32_t room_id) {
+    strand_.post([this, room_id]() { Unsubscribe(room_id); });
+}
+
+void Federation::OnFrame(const std::shared_ptr<PeerLink>& link,
+                         const FrameV2Header& header, const unsigned char* payload)
+{
+    if (link->Name().empty()) {
+        if (header.op != PEER_HELLO) {
+            LOG_MSG("Peer sent op " << int(header.op) << " before hello, closing link");
+            link->Close();
+            return;
+        }
+        OnHello(link, std::string(reinterpret_cast<const char*>(payload), header.length));
+        return;
+    }
+
+    switch (header.op) {
+    case PEER_SUBSCRIBE:
+        if (subscribers_[header.room].empty()) {
+            Hold(header.room);
+        }
+        subscribers_[header.room].insert(link);
+        LOG_MSG("Peer " << link->Name() << " subscribed to room " << header.room);
+        break;
+    case PEER_UNSUBSCRIBE: {
+        auto it = subscribers_.find(header.room);
+        if (it != subscribers_.end()) {
+            it->second.erase(link);
+            if (it->second.empty()) {
+                subscribers_.erase(it);
+                Unhold(header.room);
+            }
+        }
+        break;
+    }
+    case PEER_FORWARD: {
+        // Пересланное владельцу расходится дальше по подписчикам
+        if (header.length < PEER_FLAGS_SIZE) {
+            break;
+        }
+        std::shared_ptr<ChatRoom> room = registry_->Get(header.room);
+        if (room) {
+            room->Receive(payload + PEER_FLAGS_SIZE, header.length - PEER_FLAGS_SIZE,
+                          (payload[0] & PEER_SYNC_MARKER) != 0, true);
+            registry_->Release(room);
+        }
+        break;
+    }
+    case PEER_RELAY: {
+        // Разосланное владельцем - только по своим участникам
+        const std::size_t prefix_size = FRAME_SEQ_SIZE + PEER_FLAGS_SIZE;
+        if (header.length < prefix_size) {
+            break;
+        }
+        uint64_t seq = 0;
+        for (std::size_t i = 0; i < FRAME_SEQ_SIZE; ++i) {
+            seq |= static_cast<uint64_t>(payload[i]) << (i * 8);
+        }
+        std::shared_ptr<ChatRoom> room = registry_->Get(header.room);
+        if (room) {
+            room->Receive(payload + prefix_size, header.length - prefix_size,
+                          (payload[FRAME_SEQ_SIZE] & PEER_SYNC_MARKER) != 0, false, seq);
+            registry_->Release(room);
+        }
+        break;
+    }
+    case PEER_FORWARD_ROUTED:
+    case PEER_RELAY_ROUTED: {
+        const std::size_t prefix_size = FINGERPRINT_SIZE + PEER_FLAGS_SIZE;
+        if (header.length < prefix_size) {
+            LOG_MSG("Peer " << link->Name() << " sent a routed frame without recipient");
+            break;
+        }
+        Fingerprint recipient;
+        std::copy(payload, payload + FINGERPRINT_SIZE, recipient.begin());
+        std::shared_ptr<ChatRoom> room = registry_->Get(header.room);
+        if (room) {
+            room->ReceiveRouted(recipient, payload + prefix_size,
+                                header.length - prefix_size,
+                                (payload[FINGERPRINT_SIZE] & PEER_SYNC_MARKER) != 0,
+                                header.op == PEER_FORWARD_ROUTED);
+            registry_->Release(room);
+        }
+        break;
+    }
+    default:
+        LOG_MSG("Peer " << link->Name() << " sent unknown op " << int(header.op));
+        break;
+    }
+}
+
+void Federation::Hold(uint32_t room_id) {
+    std::shared_ptr<ChatRoom> room = registry_->Get(room_id);
+    if (room) {
+        held_[room_id] = room;
+    }
+}
+
+void Federation::Unhold(uint32_t room_id) {
+    auto it = held_.find(room_id);
+    if (it != held_.end()) {
+        registry_->Release(it->second);
+        held_.erase(it);
+    }
+}
+
+void Federation::OnClose(const std::shared_ptr<PeerLink>& link) {
+    const std::string& name = link->Name();
+    auto it = links_.find(name);
+    if (!name.empty() && it != links_.end() && it->second == link) {
+        LOG_MSG("Peer " << name << " disconnected");
+        links_.erase(it);
+        Metrics::Get().RecordPeerLink(-1);
+        for (auto room = subscribers_.begin(); room != subscribers_.end();) {
+            room->second.erase(link);
+            if (room->second.empty()) {
+                Unhold(room->first);
+                room = subscribers_.erase(room);
+            } else {
+                ++room;
+            }
+        }
+        UpdateRing();
+    }
+
+    if (!link->Address().empty()) {
+        Redial(link->Address());
+    }
+}
+
+Federation::Message Federation::Encode(
+    uint8_t op, uint32_t room_id, const unsigned char* prefix, std::size_t prefix_size,
+    const unsigned char* msg, std::size_t size)
+{
+    std::shared_ptr<std::vector<unsigned char>> message(
+        new std::vector<unsigned char>(FRAME_V2_HEADER_SIZE + prefix_size + size));
+    unsigned char* out = message->data();
+    EncodeFrameV2Header(out, op, room_id, prefix, prefix_size, msg, size);
+    std::copy(prefix, prefix + prefix_size, out + FRAME_V2_HEADER_SIZE);
+    std::copy(msg, msg + size, out + FRAME_V2_HEADER_SIZE + prefix_size);
+    return message;
+}
+
+tcp::endpoint Federation::ParseEndpoint(const std::string& address) {
+    std::size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::invalid_argument("peer address is not host:port: " + address);
+    }
+    return tcp::endpoint(boost::asio::ip::make_address(address.substr(0, colon)),
+                         std::stoi(address.substr(colon + 1)));
+}
+
+void Federation::Accept() {
+    std::shared_ptr<PeerLink> link(new PeerLink(io_service_, strand_, *this, ""));
+    acceptor_.async_accept(
+        link->Socket(),
+        strand_.wrap(boost::bind(&Federation::OnAccept, this, link,
+                                 boost::asio::placeholders::error)));
+}
+
+void Federation::OnAccept(std::shared_ptr<PeerLink> link,
+                          const boost::system::error_code& error)
+{
+    if (!error) {
+        link->Start(hello_);
+    } else {
+        LOG_MSG("Peer accept failed: " << error.message());
+    }
+    if (acceptor_.is_open()) {
+        Accept();
+    }
+}
+
+void Federation::Dial(const std::string& address) {
+    std::shared_ptr<PeerLink> link(new PeerLink(io_service_, strand_, *this, address));
+    link->Socket().async_connect(
+        ParseEndpoint(address),
+        strand_.wrap(boost::bind(&Federation::OnConnect, this, link,
+                                 boost::asio::placeholders::error)));
+}
+
+void Federation::Redial(const std::string& address) {
+    std::shared_ptr<boost::asio::steady_timer> timer(new boost::asio::steady_timer(
+        io_service_, std::chrono::milliseconds(PEER_RECONNECT_MS)));
+    timer->async_wait(strand_.wrap([this, timer, address](const boost::system::error_code&) {
+        Dial(address);
+    }));
+}
+
+void Federation::OnConnect(std::shared_ptr<PeerLink> link,
+                           const boost::system::error_code& error)
+{
+    if (error) {
+        Redial(link->Address());
+        return;
+    }
+    link->Start(hello_);
+}
+
+void Federation::OnHello(const std::shared_ptr<PeerLink>& link, const std::string& name) {
+    auto it = links_.find(name);
+    if (name.empty() || name == self_ || it != links_.end()) {
+        LOG_MSG("Peer hello from " << name << " rejected: self or already linked");
+        link->Close();
+        return;
+    }
+
+    link->SetName(name);
+    links_[name] = link;
+    Metrics::Get().RecordPeerLink(1);
+    LOG_MSG("Peer " << name << " linked");
+    UpdateRing();
+}
+
+void Federation::SendForward(uint32_t room_id, const Message& message) {
+    std::string owner = OwnerOf(room_id);
+    auto it = links_.find(owner);
+    if (it != links_.end()) {
+        it->second->Send(message);
+        return;
+    }
+
+    // Пока сообщение ждало strand, комната вернулась к этому узлу
+    const unsigned char* payload = message->data() + FRAME_V2_HEADER_SIZE;
+    std::size_t size = message->size() - FRAME_V2_HEADER_SIZE;
+    std::shared_ptr<ChatRoom> room = registry_->Get(room_id);
+    if (!room) {
+        return;
+    }
+    if ((*message)[3] == PEER_FORWARD) {
+        room->Receive(payload + PEER_FLAGS_SIZE, size - PEER_FLAGS_SIZE,
+                      (payload[0] & PEER_SYNC_MARKER) != 0, true);
+    } else {
+        const std::size_t prefix_size = FINGERPRINT_SIZE + PEER_FLAGS_SIZE;
+        Fingerprint recipient;
+        std::copy(payload, payload + FINGERPRINT_SIZE, recipient.begin());
+        room->ReceiveRouted(recipient, payload + prefix_size, size - prefix_size,
+                            (payload[FINGERPRINT_SIZE] & PEER_SYNC_MARKER) != 0, true);
+    }
+    registry_->Release(room);
+}
+
+void Federation::SendRelay(uint32_t room_id, const Message& message) {
+    auto it = subscribers_.find(room_id);
+    if (it == subscribers_.end()) {
+        return;
+    }
+    // Один и тот же кадр - по разу на связь
+    for (const auto& link : it->second) {
+        link->Send(message);
+    }
+}
+
+void Federation::Subscribe(uint32_t room_id) {
+    std::string owner = OwnerOf(room_id);
+    joined_[room_id] = owner;
+    if (owner != self_) {
+        SendTo(owner, PEER_SUBSCRIBE, room_id);
+    }
+}
+
+void Federation::Unsubscribe(uint32_t room_id) {
+    auto it = joined_.find(room_id);
+    if (it == joined_.end()) {
+        return;
+    }
+    if (it->second != self_) {
+        SendTo(it->second, PEER_UNSUBSCRIBE, room_id);
+    }
+    joined_.erase(it);
+}
+
+void Federation::UpdateRing() {
+    std::vector<std::string> nodes{self_};
+    for (const auto& link : links_) {
+        nodes.push_back(link.first);
+    }
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex_);
+        ring_.Assign(nodes);
+    }
+    LOG_MSG("Federation ring: " << nodes.size() << " nodes");
+
+    // Подписки переезжают к новым владельцам. Кадры, бывшие в пути
+    // во время переезда, могут потеряться или прийти дважды
+    for (auto& joined : joined_) {
+        std::string owner = OwnerOf(joined.first);
+        if (owner == joined.second) {
+            continue;
+        }
+        if (joined.second != self_) {
+            SendTo(joined.second, PEER_UNSUBSCRIBE, joined.first);
+        }
+        if (owner != self_) {
+            SendTo(owner, PEER_SUBSCRIBE, joined.first);
+        }
+        joined.second = owner;
+    }
+}
+
+std::string Federation::OwnerOf(uint32_t room_id) {
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    return ring_.Owner(room_id);
+}
+
+void Federation::SendTo(const std::string& name, uint8_t op, uint32_t room_id) {
+    auto it = links_.find(name);
+    if (it != links_.end()) {
+        it->second->Send(Encode(op, room_id, nullptr, 0, nullptr, 0));
+    }
+}
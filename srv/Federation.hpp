@@ -0,0 +1,124 @@
+// Federation.hpp
+#ifndef FEDERATION_HPP
+#define FEDERATION_HPP
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "Frame.hpp"
+#include "HashRing.hpp"
+#include "PeerLink.hpp"
+#include "Protocol.hpp"
+
+class RoomRegistry;
+class ChatRoom;
+
+/**
+   Федерация узлов chat_server. Узлы связаны попарно по TCP (PeerLink),
+   имя узла - адрес host:port, на котором он ждет соседей. Из каждой
+   пары подключается узел с меньшим именем, при обрыве - повторно
+   через PEER_RECONNECT_MS.
+   Комнаты распределены по узлам согласованным хешированием (HashRing)
+   среди этого узла и соседей, с которыми есть связь. Рассылкой и
+   историей комнаты занимается ее владелец: чужой узел пересылает
+   ему сообщения своих участников (PEER_FORWARD), а владелец
+   разосланный кадр отправляет один раз на каждую связь, по которой
+   пришла подписка на комнату (PEER_RELAY), а не по разу на участника.
+   Подписка - это PEER_SUBSCRIBE узла, на котором в комнате есть
+   участники; при смене владельца она переносится на нового.
+   Связи, подписки и кольцо меняются только в strand федерации
+   (на io_service 0 пула), остальные методы можно вызывать из любого
+   потока.
+*/
+class Federation {
+public:
+    typedef PeerLink::Message Message;
+
+    // self - имя этого узла и адрес для соседей, peers - адреса соседей
+    Federation(boost::asio::io_service& io_service, const std::string& self,
+               const std::vector<std::string>& peers);
+
+    // Начинает принимать соседей и подключаться к ним; кадры
+    // от соседей уходят в комнаты registry
+    void Start(RoomRegistry& registry);
+
+    // Этот узел - владелец комнаты
+    bool Owns(uint32_t room_id);
+
+    // Сообщение участника этого узла - владельцу комнаты; sync_marker
+    // уходит флагом PEER_SYNC_MARKER
+    void Forward(uint32_t room_id, const unsigned char* msg, std::size_t size,
+                 bool sync_marker);
+    void ForwardRouted(uint32_t room_id, const Fingerprint& recipient,
+                       const unsigned char* msg, std::size_t size, bool sync_marker);
+    // Кадр, разосланный владельцем, - узлам-подписчикам комнаты
+    void Relay(uint32_t room_id, const SharedFrame& frame);
+    void RelayRouted(uint32_t room_id, const Fingerprint& recipient,
+                     const SharedFrame& frame);
+
+    // В комнате на этом узле появился первый участник / ушел последний
+    void Join(uint32_t room_id);
+    void Leave(uint32_t room_id);
+
+    // Вызываются PeerLink в strand федерации
+    void OnFrame(const std::shared_ptr<PeerLink>& link, const FrameV2Header& header,
+                 const unsigned char* payload);
+    void OnClose(const std::shared_ptr<PeerLink>& link);
+
+private:
+    // Кадр v2 для соседа: payload из prefix и msg
+    static Message Encode(uint8_t op, uint32_t room_id,
+                          const unsigned char* prefix, std::size_t prefix_size,
+                          const unsigned char* msg, std::size_t size);
+    static tcp::endpoint ParseEndpoint(const std::string& address);
+
+    void Accept();
+    void OnAccept(std::shared_ptr<PeerLink> link, const boost::system::error_code& error);
+    void Dial(const std::string& address);
+    void Redial(const std::string& address);
+    void OnConnect(std::shared_ptr<PeerLink> link, const boost::system::error_code& error);
+    void OnHello(const std::shared_ptr<PeerLink>& link, const std::string& name);
+
+    // Дальше - только в strand_
+    void SendForward(uint32_t room_id, const Message& message);
+    void SendRelay(uint32_t room_id, const Message& message);
+    void Subscribe(uint32_t room_id);
+    void Unsubscribe(uint32_t room_id);
+    // Держит комнату в реестре, пока на нее подписан хоть один сосед
+    void Hold(uint32_t room_id);
+    void Unhold(uint32_t room_id);
+    // Перестраивает кольцо по живым связям и переносит подписки
+    void UpdateRing();
+    std::string OwnerOf(uint32_t room_id);
+    void SendTo(const std::string& name, uint8_t op, uint32_t room_id);
+
+    boost::asio::io_service& io_service_;
+    boost::asio::io_service::strand strand_;
+    tcp::acceptor acceptor_;
+    std::string self_;
+    std::vector<std::string> peers_;
+    RoomRegistry* registry_;
+    Message hello_;
+
+    // Соседи по имени, только прошедшие PEER_HELLO
+    std::unordered_map<std::string, std::shared_ptr<PeerLink>> links_;
+    // Комнаты этого узла: кто на них подписан
+    std::unordered_map<uint32_t, std::unordered_set<std::shared_ptr<PeerLink>>>
+        subscribers_;
+    // Комнаты с подписчиками не выселяются, пока на узле нет своих
+    // участников: реестр отдал их федерации через Get
+    std::unordered_map<uint32_t, std::shared_ptr<ChatRoom>> held_;
+    // Комнаты с участниками на этом узле и владелец, на которого
+    // оформлена подписка (self_ - подписка не нужна)
+    std::unordered_map<uint32_t, std::string> joined_;
+
+    std::mutex ring_mutex_;
+    HashRing ring_;
+};
+
+#endif // FEDERATION_HPP
@@ -0,0 +1,134 @@
+// Frame.cpp
+#include "Frame.hpp"
+#include "Metrics.hpp"
+
+Frame::Frame(Private, uint32_t room_id, const unsigned char* payload,
+             std::size_t size, bool sync_marker, uint64_t trace_id)
+    : room_id_(room_id),
+      v2_header_size_(FRAME_V2_HEADER_SIZE),
+      seq_(0),
+      bytes_(nullptr),
+      size_(size),
+      sync_marker_(sync_marker),
+      read_ns_(Metrics::NowNs()),
+      trace_id_(trace_id),
+      broadcast_ns_(0)
+{
+    bytes_ = static_cast<unsigned char*>(FramePool::Allocate(size_));
+    std::copy(payload, payload + size_, bytes_);
+
+    // Маркер, снятый с payload отправителя v1, форматы v1 возвращают,
+    // он входит в длину
+    uint16_t msg_len = static_cast<uint16_t>(size_ + TrailerSize(WireLegacy));
+    legacy_header_[0] = static_cast<unsigned char>(msg_len & 0xFF); // младший байт
+    legacy_header_[1] = static_cast<unsigned char>((msg_len >> 8) & 0xFF); // старший
+
+    uint16_t room_len = msg_len | ROOM_FRAME_FLAG;
+    room_header_[0] = static_cast<unsigned char>(room_len & 0xFF);
+    room_header_[1] = static_cast<unsigned char>((room_len >> 8) & 0xFF);
+    room_header_[2] = ROOM_MSG;
+    for (std::size_t i = 0; i < 4; ++i) {
+        room_header_[3 + i] = static_cast<unsigned char>((room_id >> (i * 8)) & 0xFF);
+    }
+
+    EncodeFrameV2Header(v2_header_.data(), ROOM_MSG, room_id, bytes_, size_);
+}
+
+Frame::~Frame() {
+    FramePool::Free(bytes_, size_);
+}
+
+SharedFrame Frame::Make(uint32_t room_id, const unsigned char* payload,
+                        std::size_t size, bool sync_marker, uint64_t trace_id)
+{
+    // Объект и счетчик ссылок - одним блоком пула, байты - вторым
+    return std::allocate_shared<const Frame>(
+        FramePoolAllocator<Frame>(), Private(), room_id, payload, size, sync_marker,
+        trace_id);
+}
+
+uint32_t Frame::RoomId() const {
+    return room_id_;
+}
+
+std::size_t Frame::Size() const {
+    return 2 + size_;
+}
+
+const unsigned char* Frame::Payload() const {
+    return bytes_;
+}
+
+std::size_t Frame::PayloadSize() const {
+    return size_;
+}
+
+const unsigned char* Frame::Header(WireFormat format) const {
+    switch (format) {
+    case WireRoom:
+        return room_header_.data();
+    case WireV2:
+        return v2_header_.data();
+    default:
+        return legacy_header_.data();
+    }
+}
+
+std::size_t Frame::HeaderSize(WireFormat format) const {
+    switch (format) {
+    case WireRoom:
+        return ROOM_HEADER_SIZE;
+    case WireV2:
+        return v2_header_size_;
+    default:
+        return 2;
+    }
+}
+
+const unsigned char* Frame::Trailer() {
+    static const unsigned char sync_marker[SYNC_MARKER_SIZE] = {};
+    return sync_marker;
+}
+
+std::size_t Frame::TrailerSize(WireFormat format) const {
+    return format == WireV2 || !sync_marker_ ? 0 : SYNC_MARKER_SIZE;
+}
+
+bool Frame::SyncMarker() const {
+    return sync_marker_;
+}
+
+std::size_t Frame::WireSize(WireFormat format) const {
+    return HeaderSize(format) + size_ + TrailerSize(format);
+}
+
+int64_t Frame::ReadNs() const {
+    return read_ns_;
+}
+
+int64_t Frame::BroadcastNs() const {
+    return broadcast_ns_.load(std::memory_order_relaxed);
+}
+
+void Frame::MarkBroadcast(int64_t ns) const {
+    broadcast_ns_.store(ns, std::memory_order_relaxed);
+}
+
+uint64_t Frame::Seq() const {
+    return seq_;
+}
+
+uint64_t Frame::TraceId() const {
+    return trace_id_;
+}
+
+void Frame::AssignSeq(uint64_t seq) const {
+    seq_ = seq;
+    unsigned char* number = v2_header_.data() + FRAME_V2_HEADER_SIZE;
+    for (std::size_t i = 0; i < FRAME_SEQ_SIZE; ++i) {
+        number[i] = static_cast<unsigned char>((seq >> (i * 8)) & 0xFF);
+    }
+    EncodeFrameV2Header(v2_header_.data(), ROOM_SEQ_MSG, room_id_,
+                        number, FRAME_SEQ_SIZE, bytes_, size_);
+    v2_header_size_ = FRAME_V2_HEADER_SIZE + FRAME_SEQ_SIZE;
+}
@@ -0,0 +1,108 @@
+// Frame.hpp
+#ifndef FRAME_HPP
+#define FRAME_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "FramePool.hpp"
+#include "FrameV2.hpp"
+#include "Protocol.hpp"
+
+class Frame;
+typedef std::shared_ptr<const Frame> SharedFrame;
+
+// Формат, в котором сессия получает кадры
+enum WireFormat {
+    WireLegacy,     // [длина][payload][синхромаркер]
+    WireRoom,       // [длина|ROOM_FRAME_FLAG][ROOM_MSG][room][payload][синхромаркер]
+    WireV2          // [заголовок v2][payload]
+};
+
+/**
+   Неизменяемый кадр рассылки: payload и готовые заголовки всех
+   форматов. Собирается один раз на Broadcast, после чего одним
+   и тем же SharedFrame владеют очереди всех участников и история
+   комнаты. В сокет заголовок, payload и синхромаркер уходят
+   отдельными буферами одной gather-записи.
+   Синхромаркер - часть формата v1, а не сообщения: сессия v1 снимает
+   его с принятого кадра и передает в Make только признак, что он был,
+   а сессиям v1 маркер дописывается при отправке. Payload от сессий
+   v2, shm и chat_bench уходит в v1 как есть, без маркера.
+   Кадру рассылки комната присваивает номер из своего журнала (AssignSeq):
+   в v2 он уходит в начале payload кадра ROOM_SEQ_MSG, поэтому номер
+   хранится в заголовке v2, сразу за его фиксированной частью.
+   Кадр, его байты и счетчик ссылок берутся из FramePool.
+*/
+class Frame {
+public:
+    // trace_id - номер трассы кадра (Tracer::Sample), 0 - не трассируется
+    // payload - без синхромаркера; sync_marker - отправитель v1 прислал
+    // его после payload, и сессиям v1 он уходит вместе с кадром
+    static SharedFrame Make(uint32_t room_id, const unsigned char* payload,
+                            std::size_t size, bool sync_marker, uint64_t trace_id = 0);
+
+    // Конструктор открыт только для allocate_shared внутри Make
+    struct Private {};
+    Frame(Private, uint32_t room_id, const unsigned char* payload, std::size_t size,
+          bool sync_marker, uint64_t trace_id);
+    ~Frame();
+    Frame(const Frame&) = delete;
+    Frame& operator=(const Frame&) = delete;
+
+    uint32_t RoomId() const;
+
+    // Размер кадра в учете очередей и метрик: payload и два байта длины
+    std::size_t Size() const;
+
+    // payload без заголовков и синхромаркера
+    const unsigned char* Payload() const;
+    std::size_t PayloadSize() const;
+
+    // Заголовок кадра в формате format
+    const unsigned char* Header(WireFormat format) const;
+    std::size_t HeaderSize(WireFormat format) const;
+    // Синхромаркер после payload: только в v1 и только если он был
+    // снят с payload при сборке кадра
+    static const unsigned char* Trailer();
+    std::size_t TrailerSize(WireFormat format) const;
+    // Отправитель v1 прислал кадр с синхромаркером
+    bool SyncMarker() const;
+    // Сколько байт кадр занимает в сокете в формате format
+    std::size_t WireSize(WireFormat format) const;
+
+    // Когда кадр прочитан у отправителя (Metrics::NowNs)
+    int64_t ReadNs() const;
+    // Когда комната разослала кадр; 0 у кадров из истории
+    int64_t BroadcastNs() const;
+    // Единственное изменяемое поле: пишется один раз в strand комнаты
+    // до рассылки, читается получателями после нее
+    void MarkBroadcast(int64_t ns) const;
+
+    // Номер кадра в журнале комнаты, 0 - без номера (адресные кадры).
+    // Как и MarkBroadcast, вызывается в strand комнаты до рассылки
+    uint64_t Seq() const;
+    void AssignSeq(uint64_t seq) const;
+
+    uint64_t TraceId() const;
+
+private:
+    uint32_t room_id_;
+    std::array<unsigned char, 2> legacy_header_;
+    std::array<unsigned char, ROOM_HEADER_SIZE> room_header_;
+    // Заголовок v2 и, у кадров с номером, сам номер
+    mutable std::array<unsigned char, FRAME_V2_HEADER_SIZE + FRAME_SEQ_SIZE> v2_header_;
+    mutable std::size_t v2_header_size_;
+    mutable uint64_t seq_;
+    unsigned char* bytes_;
+    std::size_t size_;
+    // payload пришел с синхромаркером
+    bool sync_marker_;
+    int64_t read_ns_;
+    uint64_t trace_id_;
+    mutable std::atomic<int64_t> broadcast_ns_;
+};
+
+#endif // FRAME_HPP
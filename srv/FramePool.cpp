@@ -0,0 +1,100 @@
+// FramePool.cpp
+#include <new>
+#include "FramePool.hpp"
+
+FramePool::ThreadCache::~ThreadCache() {
+    // Поток завершается: все его блоки уходят на склад одной пачкой на класс
+    Depot& depot = GetDepot();
+    std::lock_guard<std::mutex> lock(depot.mutex);
+    for (int cls = 0; cls < FRAME_POOL_CLASSES; ++cls) {
+        if (head[cls]) {
+            head[cls]->size = count[cls];
+            head[cls]->next_batch = depot.batches[cls];
+            depot.batches[cls] = head[cls];
+        }
+    }
+}
+
+int FramePool::ClassOf(std::size_t size) {
+    std::size_t block = FRAME_POOL_MIN_BLOCK;
+    for (int cls = 0; cls < FRAME_POOL_CLASSES; ++cls, block <<= 1) {
+        if (size <= block) {
+            return cls;
+        }
+    }
+    return -1;
+}
+
+FramePool::Depot& FramePool::GetDepot() {
+    // Склад никогда не разрушается: кэши потоков сдают в него блоки
+    // и при завершении процесса
+    static Depot* depot = new Depot;
+    return *depot;
+}
+
+FramePool::ThreadCache& FramePool::GetCache() {
+    static thread_local ThreadCache cache;
+    return cache;
+}
+
+void* FramePool::Allocate(std::size_t size) {
+    int cls = ClassOf(size);
+    if (cls < 0) {
+        return ::operator new(size);
+    }
+
+    ThreadCache& cache = GetCache();
+    if (!cache.head[cls]) {
+        // Кэш пуст: берем целую пачку со склада
+        Depot& depot = GetDepot();
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        Block* batch = depot.batches[cls];
+        if (batch) {
+            depot.batches[cls] = batch->next_batch;
+            cache.head[cls] = batch;
+            cache.count[cls] = batch->size;
+        }
+    }
+
+    Block* block = cache.head[cls];
+    if (!block) {
+        return ::operator new(FRAME_POOL_MIN_BLOCK << cls);
+    }
+    cache.head[cls] = block->next;
+    --cache.count[cls];
+    return block;
+}
+
+void FramePool::Free(void* pointer, std::size_t size) {
+    int cls = ClassOf(size);
+    if (cls < 0) {
+        ::operator delete(pointer);
+        return;
+    }
+
+    ThreadCache& cache = GetCache();
+    Block* block = static_cast<Block*>(pointer);
+    block->next = cache.head[cls];
+    cache.head[cls] = block;
+    if (++cache.count[cls] >= 2 * FRAME_POOL_BATCH) {
+        Release(cache, cls);
+    }
+}
+
+void FramePool::Release(ThreadCache& cache, int cls) {
+    // Отрезаем от начала кэша FRAME_POOL_BATCH блоков
+    Block* batch = cache.head[cls];
+    Block* last = batch;
+    for (std::size_t i = 1; i < FRAME_POOL_BATCH; ++i) {
+        last = last->next;
+    }
+    cache.head[cls] = last->next;
+    cache.count[cls] -= FRAME_POOL_BATCH;
+    last->next = nullptr;
+    batch->size = FRAME_POOL_BATCH;
+
+    Depot& depot = GetDepot();
+    std::lock_guard<std::mutex> lock(depot.mutex);
+    batch->next_batch = depot.batches[cls];
+    depot.batches[cls] = batch;
+}
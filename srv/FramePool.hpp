@@ -0,0 +1,79 @@
+// FramePool.hpp
+#ifndef FRAMEPOOL_HPP
+#define FRAMEPOOL_HPP
+
+#include <cstddef>
+#include <mutex>
+#include "defs.hpp"
+
+// Классы размеров блоков: 64, 128, ..., 64 << (FRAME_POOL_CLASSES - 1) байт.
+// Блоки больше берутся из кучи напрямую
+#define FRAME_POOL_CLASSES 10
+#define FRAME_POOL_MIN_BLOCK 64
+
+/**
+   Пул памяти для кадров рассылки (Frame, его байты и счетчик ссылок).
+   Кадр собирается в потоке отправителя, а освобождается в потоке
+   последнего получателя, поэтому у каждого потока свой кэш свободных
+   блоков, а излишки переходят пачками по FRAME_POOL_BATCH блоков
+   через общий склад под мьютексом. Память не возвращается в систему:
+   после прогрева кадры не обращаются к куче.
+*/
+class FramePool {
+public:
+    static void* Allocate(std::size_t size);
+    static void Free(void* block, std::size_t size);
+
+private:
+    // Свободный блок: next - следующий в пачке; у первого блока пачки
+    // еще next_batch - следующая пачка на складе и size - длина пачки
+    struct Block {
+        Block* next;
+        Block* next_batch;
+        std::size_t size;
+    };
+
+    struct Depot {
+        std::mutex mutex;
+        Block* batches[FRAME_POOL_CLASSES] = {};
+    };
+
+    struct ThreadCache {
+        Block* head[FRAME_POOL_CLASSES] = {};
+        std::size_t count[FRAME_POOL_CLASSES] = {};
+        ~ThreadCache();
+    };
+
+    static int ClassOf(std::size_t size);
+    static Depot& GetDepot();
+    static ThreadCache& GetCache();
+    // Отдает на склад пачку из FRAME_POOL_BATCH блоков кэша
+    static void Release(ThreadCache& cache, int cls);
+};
+
+/**
+   STL-аллокатор поверх FramePool, для std::allocate_shared
+*/
+template <typename T>
+class FramePoolAllocator {
+public:
+    typedef T value_type;
+
+    FramePoolAllocator() {}
+    template <typename U>
+    FramePoolAllocator(const FramePoolAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(FramePool::Allocate(sizeof(T) * n));
+    }
+    void deallocate(T* pointer, std::size_t n) {
+        FramePool::Free(pointer, sizeof(T) * n);
+    }
+
+    template <typename U>
+    bool operator==(const FramePoolAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const FramePoolAllocator<U>&) const { return false; }
+};
+
+#endif // FRAMEPOOL_HPP
@@ -0,0 +1,96 @@
+// FrameV2.cpp
+#include <cstring>
+#include "FrameV2.hpp"
+
+// Байты заголовка, покрытые crc: version, op, room и length
+static const std::size_t CRC_FIELDS_OFFSET = 2;
+static const std::size_t CRC_FIELDS_SIZE = 8;
+
+static uint32_t FrameCrc(const unsigned char* header, const unsigned char* payload,
+                         std::size_t size)
+{
+    uint32_t crc = Crc32c(header + CRC_FIELDS_OFFSET, CRC_FIELDS_SIZE);
+    return Crc32c(payload, size, crc);
+}
+
+void EncodeFrameV2Header(unsigned char* out, uint8_t op, uint32_t room,
+                         const unsigned char* payload, std::size_t size)
+{
+    EncodeFrameV2Header(out, op, room, nullptr, 0, payload, size);
+}
+
+void EncodeFrameV2Header(unsigned char* out, uint8_t op, uint32_t room,
+                         const unsigned char* prefix, std::size_t prefix_size,
+                         const unsigned char* payload, std::size_t size)
+{
+    std::size_t length = prefix_size + size;
+    out[0] = FRAME_V2_MAGIC_0;
+    out[1] = FRAME_V2_MAGIC_1;
+    out[2] = FRAME_V2_VERSION;
+    out[3] = op;
+    for (std::size_t i = 0; i < 4; ++i) {
+        out[4 + i] = static_cast<unsigned char>((room >> (i * 8)) & 0xFF);
+    }
+    out[8] = static_cast<unsigned char>(length & 0xFF);
+    out[9] = static_cast<unsigned char>((length >> 8) & 0xFF);
+
+    uint32_t crc = FrameCrc(out, prefix, prefix_size);
+    crc = Crc32c(payload, size, crc);
+    for (std::size_t i = 0; i < 4; ++i) {
+        out[10 + i] = static_cast<unsigned char>((crc >> (i * 8)) & 0xFF);
+    }
+}
+
+bool IsFrameV2(const unsigned char* data) {
+    return data[0] == FRAME_V2_MAGIC_0 && data[1] == FRAME_V2_MAGIC_1;
+}
+
+bool DecodeFrameV2Header(const unsigned char* data, FrameV2Header& header) {
+    if (!IsFrameV2(data)) {
+        return false;
+    }
+    header.version = data[2];
+    header.op = data[3];
+    header.room = 0;
+    for (std::size_t i = 0; i < 4; ++i) {
+        header.room |= static_cast<uint32_t>(data[4 + i]) << (i * 8);
+    }
+    header.length = static_cast<uint16_t>(data[8] | (data[9] << 8));
+    header.crc = 0;
+    for (std::size_t i = 0; i < 4; ++i) {
+        header.crc |= static_cast<uint32_t>(data[10 + i]) << (i * 8);
+    }
+    // Номер кадра перед сообщением бывает только у ROOM_SEQ_MSG и PEER_RELAY,
+    // флаги - у сообщений между узлами
+    std::size_t max_length = MAX_PACK_SIZE;
+    if (header.op == ROOM_SEQ_MSG) {
+        max_length += FRAME_SEQ_SIZE;
+    } else if (header.op == PEER_RELAY) {
+        max_length += FRAME_SEQ_SIZE + PEER_FLAGS_SIZE;
+    } else if (header.op == PEER_FORWARD || header.op == PEER_FORWARD_ROUTED
+               || header.op == PEER_RELAY_ROUTED) {
+        max_length += PEER_FLAGS_SIZE;
+    }
+    return header.version == FRAME_V2_VERSION && header.length <= max_length;
+}
+
+bool CheckFrameV2Crc(const unsigned char* data, const FrameV2Header& header,
+                     const unsigned char* payload)
+{
+    return FrameCrc(data, payload, header.length) == header.crc;
+}
+
+const unsigned char* FindFrameV2(const unsigned char* begin, const unsigned char* end) {
+    while (begin < end) {
+        const void* found = std::memchr(begin, FRAME_V2_MAGIC_0, end - begin);
+        if (!found) {
+            return end;
+        }
+        const unsigned char* candidate = static_cast<const unsigned char*>(found);
+        if (candidate + 1 == end || candidate[1] == FRAME_V2_MAGIC_1) {
+            return candidate;
+        }
+        begin = candidate + 1;
+    }
+    return end;
+}
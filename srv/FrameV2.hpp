@@ -0,0 +1,49 @@
+// FrameV2.hpp
+#ifndef FRAMEV2_HPP
+#define FRAMEV2_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "Protocol.hpp"
+#include "Crc32c.hpp"
+#include "defs.hpp"
+
+/**
+   Заголовок кадра v2 (формат - в Protocol.hpp)
+*/
+struct FrameV2Header {
+    uint8_t version;
+    uint8_t op;
+    uint32_t room;
+    uint16_t length;
+    uint32_t crc;
+};
+
+// Пишет FRAME_V2_HEADER_SIZE байт заголовка для payload в out
+void EncodeFrameV2Header(unsigned char* out, uint8_t op, uint32_t room,
+                         const unsigned char* payload, std::size_t size);
+// То же для payload из двух частей, prefix и payload (например,
+// номер кадра ROOM_SEQ_MSG и сообщение, хранящиеся раздельно)
+void EncodeFrameV2Header(unsigned char* out, uint8_t op, uint32_t room,
+                         const unsigned char* prefix, std::size_t prefix_size,
+                         const unsigned char* payload, std::size_t size);
+
+// С data начинается magic кадра v2 (нужно 2 байта)
+bool IsFrameV2(const unsigned char* data);
+
+// Разбирает FRAME_V2_HEADER_SIZE байт; false - не magic, чужая версия
+// или длина больше MAX_PACK_SIZE (у ROOM_SEQ_MSG и PEER_RELAY - плюс
+// номер кадра), то есть поток нужно синхронизировать
+bool DecodeFrameV2Header(const unsigned char* data, FrameV2Header& header);
+
+// Сходится ли crc кадра с заголовком data и payload
+bool CheckFrameV2Crc(const unsigned char* data, const FrameV2Header& header,
+                     const unsigned char* payload);
+
+// Ближайшее начало кадра v2 в [begin, end), end - если его нет.
+// Поиск идет memchr по первому байту magic (в glibc - векторно),
+// последний байт диапазона возвращается, если он может быть
+// началом magic, чье продолжение еще не пришло
+const unsigned char* FindFrameV2(const unsigned char* begin, const unsigned char* end);
+
+#endif // FRAMEV2_HPP
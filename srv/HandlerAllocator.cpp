@@ -0,0 +1,39 @@
+// HandlerAllocator.cpp
+#include "HandlerAllocator.hpp"
+
+HandlerMemory::HandlerMemory()
+    : block_(nullptr),
+      size_(0),
+      in_use_(false)
+{
+}
+
+HandlerMemory::~HandlerMemory() {
+    if (block_) {
+        FramePool::Free(block_, size_);
+    }
+}
+
+void* HandlerMemory::Allocate(std::size_t size) {
+    if (in_use_ || size > HANDLER_MEMORY_SIZE) {
+        return ::operator new(size);
+    }
+    if (size > size_) {
+        // Операция цепочки крупнее прежних: блок меняется на больший
+        if (block_) {
+            FramePool::Free(block_, size_);
+        }
+        block_ = FramePool::Allocate(size);
+        size_ = size;
+    }
+    in_use_ = true;
+    return block_;
+}
+
+void HandlerMemory::Deallocate(void* pointer) {
+    if (pointer == block_) {
+        in_use_ = false;
+    } else {
+        ::operator delete(pointer);
+    }
+}
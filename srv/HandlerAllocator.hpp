@@ -0,0 +1,112 @@
+// HandlerAllocator.hpp
+#ifndef HANDLERALLOCATOR_HPP
+#define HANDLERALLOCATOR_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <boost/asio.hpp>
+#include "FramePool.hpp"
+#include "defs.hpp"
+
+/**
+   Память под одну асинхронную операцию. У сессии на каждую цепочку
+   операций (чтение, запись, таймер, доставка) своя HandlerMemory:
+   в цепочке одновременно живет не больше одной операции, asio
+   освобождает память операции до вызова обработчика, поэтому один
+   и тот же блок переиспользуется без обращения к куче.
+   Блок берется из FramePool при первой операции цепочки: цепочки,
+   которыми сессия не пользуется (запись у молчащего соединения),
+   памяти не занимают. Если блок занят, память берется из кучи.
+   Не потокобезопасна: цепочка должна быть последовательной.
+*/
+class HandlerMemory {
+public:
+    HandlerMemory();
+    ~HandlerMemory();
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* Allocate(std::size_t size);
+    void Deallocate(void* pointer);
+
+private:
+    void* block_;
+    std::size_t size_;
+    bool in_use_;
+};
+
+/**
+   Аллокатор поверх HandlerMemory для associated_allocator
+*/
+template <typename T>
+class HandlerAllocator {
+public:
+    typedef T value_type;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(memory) {}
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) : memory_(other.memory_) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(memory_.Allocate(sizeof(T) * n));
+    }
+    void deallocate(T* pointer, std::size_t) {
+        memory_.Deallocate(pointer);
+    }
+
+    bool operator==(const HandlerAllocator& other) const {
+        return &memory_ == &other.memory_;
+    }
+    bool operator!=(const HandlerAllocator& other) const {
+        return &memory_ != &other.memory_;
+    }
+
+private:
+    template <typename> friend class HandlerAllocator;
+    HandlerMemory& memory_;
+};
+
+/**
+   Обработчик, операции которого размещаются в HandlerMemory.
+   Память отдается двумя путями: через associated_allocator, если
+   обработчик передан в asio напрямую, и через asio_handler_allocate,
+   который strand.wrap пробрасывает к вложенному обработчику.
+*/
+template <typename Handler>
+class AllocHandler {
+public:
+    typedef HandlerAllocator<Handler> allocator_type;
+
+    AllocHandler(HandlerMemory& memory, Handler handler)
+        : memory_(memory), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const {
+        return allocator_type(memory_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+    friend void* asio_handler_allocate(std::size_t size, AllocHandler* handler) {
+        return handler->memory_.Allocate(size);
+    }
+
+    friend void asio_handler_deallocate(void* pointer, std::size_t,
+                                        AllocHandler* handler) {
+        handler->memory_.Deallocate(pointer);
+    }
+
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline AllocHandler<Handler> MakeAllocHandler(HandlerMemory& memory, Handler handler) {
+    return AllocHandler<Handler>(memory, std::move(handler));
+}
+
+#endif // HANDLERALLOCATOR_HPP
@@ -0,0 +1,218 @@
+// Handoff.cpp
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Handoff.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+Handoff& Handoff::Get() {
+    static Handoff handoff;
+    return handoff;
+}
+
+Handoff::Handoff()
+    : pool_(nullptr),
+      registry_(nullptr),
+      drain_timeout_(0)
+{
+}
+
+void Handoff::Take(const std::string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0
+        || ::connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                     sizeof(address)) != 0) {
+        throw std::runtime_error("takeover connect " + path + ": " + std::strerror(errno));
+    }
+
+    // Одно сообщение: HandoffHello и сами сокеты
+    HandoffHello hello;
+    struct iovec iov = {&hello, sizeof(hello)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_SOCKETS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t received = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    ::close(fd);
+    if (received != static_cast<ssize_t>(sizeof(hello)) || hello.magic != HANDOFF_MAGIC) {
+        throw std::runtime_error("takeover handshake failed");
+    }
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    std::size_t count = 0;
+    if (cmsg && cmsg->cmsg_type == SCM_RIGHTS) {
+        count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    }
+    std::vector<int> fds(count);
+    if (count > 0) {
+        std::memcpy(fds.data(), CMSG_DATA(cmsg), count * sizeof(int));
+    }
+    if (count != hello.count) {
+        for (int socket : fds) {
+            ::close(socket);
+        }
+        throw std::runtime_error("takeover handshake: sockets lost");
+    }
+
+    // Сокеты сопоставляются акцепторам по адресу, на котором они слушают
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int socket : fds) {
+        tcp::endpoint endpoint;
+        socklen_t size = endpoint.capacity();
+        if (::getsockname(socket, endpoint.data(), &size) != 0) {
+            ::close(socket);
+            continue;
+        }
+        endpoint.resize(size);
+        LOG_MSG("Inherited listening socket " << endpoint);
+        inherited_.push_back(std::make_pair(endpoint, socket));
+    }
+}
+
+void Handoff::Open(tcp::acceptor& acceptor, const tcp::endpoint& endpoint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(inherited_.begin(), inherited_.end(),
+                           [&endpoint](const std::pair<tcp::endpoint, int>& socket) {
+                               return socket.first == endpoint;
+                           });
+    if (it != inherited_.end()) {
+        acceptor.assign(endpoint.protocol(), it->second);
+        inherited_.erase(it);
+    } else {
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(tcp::acceptor::reuse_address(true));
+        acceptor.bind(endpoint);
+        acceptor.listen();
+    }
+    acceptors_.push_back(&acceptor);
+}
+
+void Handoff::ReleaseUnused() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& socket : inherited_) {
+        LOG_MSG("Inherited socket " << socket.first << " is not used, closing");
+        ::close(socket.second);
+    }
+    inherited_.clear();
+}
+
+void Handoff::Listen(IoServicePool& pool, RoomRegistry& registry,
+                     const std::string& path, std::size_t drain_timeout)
+{
+    pool_ = &pool;
+    registry_ = &registry;
+    boost::asio::io_service& io_service = pool.GetIoService(0);
+    ::unlink(path.c_str());
+    listener_.reset(new boost::asio::local::stream_protocol::acceptor(
+        io_service, boost::asio::local::stream_protocol::endpoint(path)));
+    successor_.reset(new boost::asio::local::stream_protocol::socket(io_service));
+    drain_timer_.reset(new boost::asio::steady_timer(io_service));
+    drain_timeout_ = drain_timeout;
+
+    listener_->async_accept(*successor_, boost::bind(&Handoff::OnSuccessor, this, _1));
+}
+
+void Handoff::OnSuccessor(const boost::system::error_code& error) {
+    if (error) {
+        LOG_MSG("Takeover accept failed: " << error.message());
+        return;
+    }
+    // Преемник один: дальше по этому пути слушает уже он
+    boost::system::error_code ignored;
+    listener_->close(ignored);
+    LOG_MSG("Successor connected, draining rooms");
+
+    // Срок отсчитывается от подключения преемника
+    drain_deadline_ = std::chrono::steady_clock::now() + std::chrono::seconds(drain_timeout_);
+    registry_->Drain([this]() {
+        pool_->GetIoService(0).post(boost::bind(&Handoff::Transfer, this));
+    });
+}
+
+void Handoff::Transfer() {
+    std::vector<int> fds;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto acceptor : acceptors_) {
+            if (fds.size() < HANDOFF_MAX_SOCKETS) {
+                fds.push_back(acceptor->native_handle());
+            }
+        }
+    }
+
+    HandoffHello hello{HANDOFF_MAGIC, static_cast<uint32_t>(fds.size())};
+    struct iovec iov = {&hello, sizeof(hello)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_SOCKETS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (!fds.empty()) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    ssize_t sent = ::sendmsg(successor_->native_handle(), &msg, MSG_NOSIGNAL);
+    boost::system::error_code ignored;
+    successor_->close(ignored);
+    if (sent != static_cast<ssize_t>(sizeof(hello))) {
+        // Преемник сокетов не получил, но комнаты уже остановлены:
+        // журналы не пишутся, так что процесс все равно уходит
+        LOG_MSG("Takeover failed: " << std::strerror(errno));
+    } else {
+        LOG_MSG("Handed off " << fds.size() << " listening sockets");
+        // Копии сокетов остались у преемника, свои акцепторы закрываем
+        // в их потоках: владельцы перестанут принимать соединения
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto acceptor : acceptors_) {
+            boost::asio::post(acceptor->get_executor(), [acceptor]() {
+                boost::system::error_code ignored;
+                acceptor->close(ignored);
+            });
+        }
+    }
+
+    WaitSessions();
+}
+
+void Handoff::WaitSessions() {
+    drain_timer_->expires_from_now(std::chrono::milliseconds(DRAIN_POLL_MS));
+    drain_timer_->async_wait(boost::bind(&Handoff::OnDrainTimer, this, _1));
+}
+
+void Handoff::OnDrainTimer(const boost::system::error_code& error) {
+    if (error) {
+        return;
+    }
+    int64_t sessions = Metrics::Get().SessionsActive();
+    if (sessions > 0 && std::chrono::steady_clock::now() < drain_deadline_) {
+        WaitSessions();
+        return;
+    }
+    if (sessions > 0) {
+        LOG_MSG("Drain timeout, " << sessions << " sessions left");
+    }
+    LOG_MSG("Drained, stopping");
+    pool_->Stop();
+}
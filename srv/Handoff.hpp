@@ -0,0 +1,78 @@
+// Handoff.hpp
+#ifndef HANDOFF_HPP
+#define HANDOFF_HPP
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "IoServicePool.hpp"
+#include "RoomRegistry.hpp"
+#include "Protocol.hpp"
+
+using boost::asio::ip::tcp;
+
+/**
+   Перезапуск без простоя. Работающий сервер ждет преемника на unix-сокете
+   (--upgrade-socket PATH). Новый процесс с --takeover PATH подключается
+   к нему до того, как открыть свои порты, и старый процесс:
+   - останавливает комнаты (RoomRegistry::Drain): журналы больше
+     не пишутся, их дальше ведет новый процесс;
+   - отдает ему через SCM_RIGHTS все свои слушающие TCP-сокеты (клиентские
+     порты, порт счетчиков, порт федерации) и закрывает их у себя.
+     Очередь соединений ядра при этом не прерывается;
+   - отключает сессии, дописав каждой ее очередь отправки, и завершается,
+     когда сессий не осталось или прошло --drain-timeout секунд.
+   Клиенты переподключаются к новому процессу и по ROOM_RESUME получают
+   только пропущенные кадры, а не всю историю.
+   Unix-сокеты (--shm-socket, --stats-socket, --admin-socket) не
+   передаются: новый процесс создает их заново по тем же путям.
+*/
+class Handoff {
+public:
+    static Handoff& Get();
+
+    // Новый процесс: забрать слушающие сокеты у старого. Вызывать
+    // до создания акцепторов; блокирует, пока старый не остановит комнаты
+    void Take(const std::string& path);
+    // Открывает акцептор на endpoint: унаследованный сокет с тем же
+    // адресом, если он есть, иначе новый. Акцептор запоминается,
+    // чтобы отдать его следующему процессу
+    void Open(tcp::acceptor& acceptor, const tcp::endpoint& endpoint);
+    // Унаследованные сокеты, которые никому не понадобились, закрываются
+    void ReleaseUnused();
+
+    // Старый процесс: ждать преемника на path. drain_timeout - сколько
+    // секунд ждать ухода сессий, после чего пул останавливается
+    void Listen(IoServicePool& pool, RoomRegistry& registry,
+                const std::string& path, std::size_t drain_timeout);
+
+private:
+    Handoff();
+
+    void OnSuccessor(const boost::system::error_code& error);
+    // Комнаты остановлены: отдать сокеты и закрыть свои акцепторы
+    void Transfer();
+    void WaitSessions();
+    void OnDrainTimer(const boost::system::error_code& error);
+
+    // Акцепторы этого процесса, открытые через Open
+    std::mutex mutex_;
+    std::vector<tcp::acceptor*> acceptors_;
+    // Сокеты от старого процесса, еще не отданные акцепторам
+    std::vector<std::pair<tcp::endpoint, int>> inherited_;
+
+    IoServicePool* pool_;
+    RoomRegistry* registry_;
+    std::unique_ptr<boost::asio::local::stream_protocol::acceptor> listener_;
+    std::unique_ptr<boost::asio::local::stream_protocol::socket> successor_;
+    std::unique_ptr<boost::asio::steady_timer> drain_timer_;
+    std::size_t drain_timeout_;
+    std::chrono::steady_clock::time_point drain_deadline_;
+};
+
+#endif // HANDOFF_HPP
@@ -0,0 +1,59 @@
+// HashRing.cpp
+#include <algorithm>
+#include "HashRing.hpp"
+#include "defs.hpp"
+
+namespace {
+
+uint64_t Fnv1a(const std::string& text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Номера комнат идут подряд, перемешиваем их перед поиском на кольце
+uint64_t Mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+void HashRing::Assign(const std::vector<std::string>& nodes) {
+    nodes_ = nodes;
+    points_.clear();
+    for (std::size_t node = 0; node < nodes_.size(); ++node) {
+        for (int i = 0; i < FEDERATION_VNODES; ++i) {
+            points_.push_back(
+                Point{Fnv1a(nodes_[node] + "#" + std::to_string(i)), node});
+        }
+    }
+    // При равных хешах порядок задает имя, а не порядок в nodes
+    std::sort(points_.begin(), points_.end(),
+              [this](const Point& a, const Point& b) {
+                  return a.hash != b.hash ? a.hash < b.hash
+                                          : nodes_[a.node] < nodes_[b.node];
+              });
+}
+
+const std::string& HashRing::Owner(uint32_t room_id) const {
+    static const std::string none;
+    if (points_.empty()) {
+        return none;
+    }
+
+    uint64_t hash = Mix(room_id);
+    auto it = std::lower_bound(points_.begin(), points_.end(), hash,
+                               [](const Point& point, uint64_t value) {
+                                   return point.hash < value;
+                               });
+    if (it == points_.end()) {
+        it = points_.begin();
+    }
+    return nodes_[it->node];
+}
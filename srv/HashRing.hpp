@@ -0,0 +1,36 @@
+// HashRing.hpp
+#ifndef HASHRING_HPP
+#define HASHRING_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+   Согласованное хеширование комнат по узлам федерации. Каждый узел
+   ставится на кольцо FEDERATION_VNODES точками (FNV-1a от "имя#i"),
+   комната принадлежит узлу первой точки не меньше хеша ее номера.
+   Когда узел пропадает или появляется, переезжают только комнаты
+   его дуг, остальные остаются на своих местах. Кольцо зависит
+   только от набора имен, поэтому у узлов, видящих одних и тех же
+   соседей, оно одинаковое.
+*/
+class HashRing {
+public:
+    // Заменяет набор узлов кольца
+    void Assign(const std::vector<std::string>& nodes);
+    // Имя узла, которому принадлежит комната; пусто, если узлов нет
+    const std::string& Owner(uint32_t room_id) const;
+
+private:
+    struct Point {
+        uint64_t hash;
+        std::size_t node;
+    };
+
+    std::vector<std::string> nodes_;
+    // Точки по возрастанию хеша
+    std::vector<Point> points_;
+};
+
+#endif // HASHRING_HPP
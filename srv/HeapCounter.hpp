@@ -0,0 +1,15 @@
+// HeapCounter.hpp
+#ifndef HEAPCOUNTER_HPP
+#define HEAPCOUNTER_HPP
+
+#include <cstdint>
+
+/**
+   Счетчик выделений памяти через operator new в chat_server:
+   HeapCounter.cpp заменяет глобальные operator new/delete, и каждый
+   вызов new увеличивает счетчик (одно атомарное сложение, без блокировок).
+   Так видно, сколько выделений приходится на кадр под нагрузкой.
+*/
+uint64_t HeapAllocations();
+
+#endif // HEAPCOUNTER_HPP
@@ -0,0 +1,94 @@
+// Histogram.cpp
+#include <algorithm>
+#include "Histogram.hpp"
+
+Histogram::Histogram()
+    : count_(0),
+      sum_(0),
+      max_(0)
+{
+    for (auto& bucket : buckets_) {
+        bucket = 0;
+    }
+}
+
+std::size_t Histogram::BucketOf(uint64_t value) {
+    const uint64_t limit = (uint64_t(1) << HISTOGRAM_MAX_BITS) - 1;
+    if (value > limit) {
+        value = limit;
+    }
+    if (value < (uint64_t(1) << HISTOGRAM_SUB_BITS)) {
+        return value;
+    }
+    // После сдвига остаются HISTOGRAM_SUB_BITS старших бит значения,
+    // верхняя половина из них и есть корзина внутри степени двойки
+    unsigned msb = 63 - __builtin_clzll(value);
+    unsigned shift = msb - HISTOGRAM_SUB_BITS + 1;
+    return (shift << (HISTOGRAM_SUB_BITS - 1)) + (value >> shift);
+}
+
+uint64_t Histogram::BucketHigh(std::size_t bucket) {
+    const std::size_t half = 1 << (HISTOGRAM_SUB_BITS - 1);
+    if (bucket < 2 * half) {
+        return bucket;
+    }
+    unsigned shift = bucket / half - 1;
+    uint64_t sub = bucket % half + half;
+    return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::Record(uint64_t value) {
+    buckets_[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max
+           && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::Count() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Quantile(double q) const {
+    // Корзины читаются без общей блокировки, поэтому сумма по ним
+    // может немного расходиться с count_, считаем по самим корзинам
+    uint64_t total = 0;
+    for (const auto& bucket : buckets_) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(q * total);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(BucketHigh(i), max_.load(std::memory_order_relaxed));
+        }
+    }
+    return max_.load(std::memory_order_relaxed);
+}
+
+void Histogram::Dump(std::ostream& out, const std::string& name) const {
+    static const char* const quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+    static const double values[] = {0.5, 0.9, 0.99, 0.999};
+
+    uint64_t count = Count();
+    uint64_t sum = sum_.load(std::memory_order_relaxed);
+
+    out << name << "_count " << count << "\n"
+        << name << "_mean " << (count ? sum / count : 0) << "\n"
+        << name << "_max " << max_.load(std::memory_order_relaxed) << "\n";
+    for (std::size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        out << name << "{quantile=\"" << quantiles[i] << "\"} "
+            << Quantile(values[i]) << "\n";
+    }
+}
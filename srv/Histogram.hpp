@@ -0,0 +1,51 @@
+// Histogram.hpp
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "defs.hpp"
+
+// Точность корзин: 2^(HISTOGRAM_SUB_BITS-1) корзин на каждую степень двойки,
+// относительная ошибка не больше 1/32. Значения больше 2^HISTOGRAM_MAX_BITS
+// попадают в последнюю корзину.
+#define HISTOGRAM_SUB_BITS 6
+#define HISTOGRAM_MAX_BITS 44
+#define HISTOGRAM_BUCKETS                                                      \
+    ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * (1 << (HISTOGRAM_SUB_BITS - 1)) \
+     + (1 << HISTOGRAM_SUB_BITS))
+
+/**
+   Гистограмма в духе HDR: корзины логарифмические по степени двойки
+   и линейные внутри степени, поэтому при постоянной относительной
+   точности их немного и индекс считается парой сдвигов.
+   Record потокобезопасен и не блокирует (relaxed атомики),
+   Dump выводит число значений, среднее, максимум и квантили.
+*/
+class Histogram {
+public:
+    Histogram();
+
+    void Record(uint64_t value);
+
+    uint64_t Count() const;
+    // Верхняя граница корзины, в которой лежит квантиль q (0..1)
+    uint64_t Quantile(double q) const;
+
+    // Строки "name_count N", "name{quantile="0.99"} V" и т.д.
+    void Dump(std::ostream& out, const std::string& name) const;
+
+private:
+    static std::size_t BucketOf(uint64_t value);
+    static uint64_t BucketHigh(std::size_t bucket);
+
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+#endif // HISTOGRAM_HPP
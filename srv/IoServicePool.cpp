@@ -0,0 +1,79 @@
+// IoServicePool.cpp
+#include "IoServicePool.hpp"
+
+IoServicePool::IoServicePool(std::size_t pool_size)
+    : next_io_service_(0)
+{
+    if (pool_size == 0) {
+        throw std::runtime_error("IoServicePool size must be greater than 0");
+    }
+
+    for (std::size_t i = 0; i < pool_size; ++i) {
+        std::shared_ptr<boost::asio::io_service> io_service(
+            new boost::asio::io_service);
+        std::shared_ptr<boost::asio::io_service::work> work(
+            new boost::asio::io_service::work(*io_service));
+        io_services_.push_back(io_service);
+        work_.push_back(work);
+    }
+}
+
+void IoServicePool::Run() {
+    boost::thread_group workers;
+    unsigned int cpus = boost::thread::hardware_concurrency();
+
+    for (std::size_t i = 0; i < io_services_.size(); ++i) {
+        boost::thread* t = new boost::thread{
+            boost::bind(&WorkerThread::Run, io_services_[i])};
+#ifdef __linux__
+        // bind cpu affinity for worker thread in linux
+        if (cpus > 0) {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(i % cpus, &cpuset);
+            pthread_setaffinity_np(t->native_handle(), sizeof(cpu_set_t), &cpuset);
+        }
+#endif
+        workers.add_thread(t);
+    }
+
+    workers.join_all();
+}
+
+void IoServicePool::Stop() {
+    for (auto& io_service : io_services_) {
+        io_service->stop();
+    }
+}
+
+boost::asio::io_service& IoServicePool::GetIoService() {
+    std::size_t index = next_io_service_.fetch_add(1, std::memory_order_relaxed);
+    return *io_services_[index % io_services_.size()];
+}
+
+boost::asio::io_service& IoServicePool::GetIoService(std::size_t index) {
+    return *io_services_[index % io_services_.size()];
+}
+
+std::size_t IoServicePool::Size() const {
+    return io_services_.size();
+}
+
+std::size_t IoServicePool::IndexOf(const boost::asio::io_service& io_service) const {
+    for (std::size_t i = 0; i < io_services_.size(); ++i) {
+        if (io_services_[i].get() == &io_service) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+const char* IoServicePool::Backend() {
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+    return "io_uring";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+    return "epoll";
+#else
+    return "select";
+#endif
+}
@@ -0,0 +1,53 @@
+// IoServicePool.hpp
+#ifndef IOSERVICEPOOL_HPP
+#define IOSERVICEPOOL_HPP
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include "WorkerThread.hpp"
+#include "Log.hpp"
+#include "defs.hpp"
+
+// Сборка make IO_URING=1: без io_uring-бэкенда asio (Boost < 1.78)
+// BOOST_ASIO_DISABLE_EPOLL молча перевел бы сервер на select
+#if defined(BOOST_ASIO_HAS_IO_URING)
+#include <boost/version.hpp>
+#if BOOST_VERSION < 107800
+#error "IO_URING=1 requires Boost.Asio 1.78 or newer"
+#endif
+#endif
+
+/**
+   Пул io_service: по одному io_service и одному рабочему потоку на ядро.
+   Каждый поток привязывается к своему CPU (на linux), сессии
+   раздаются по пулу по кругу.
+*/
+class IoServicePool {
+public:
+    explicit IoServicePool(std::size_t pool_size);
+
+    // Запускает рабочие потоки и ждет их завершения
+    void Run();
+    void Stop();
+
+    // Следующий io_service по кругу
+    boost::asio::io_service& GetIoService();
+    boost::asio::io_service& GetIoService(std::size_t index);
+    std::size_t Size() const;
+    // Номер io_service в пуле
+    std::size_t IndexOf(const boost::asio::io_service& io_service) const;
+
+    // Механизм ожидания событий сокетов, с которым собран сервер
+    static const char* Backend();
+
+private:
+    std::vector<std::shared_ptr<boost::asio::io_service>> io_services_;
+    std::vector<std::shared_ptr<boost::asio::io_service::work>> work_;
+    std::atomic<std::size_t> next_io_service_;
+};
+
+#endif // IOSERVICEPOOL_HPP
@@ -3,63 +3,87 @@
 #ifndef LOG_HPP
 #define LOG_HPP
 
-#include <typeinfo>
-#include <cxxabi.h>
+#include <algorithm>
+#include <atomic>
+#include "Logger.hpp"
+#include "defs.hpp"
 
+// Уровень включен: при компиляции (ветка вырезается) и во время работы
+#define LOG_ENABLED(level)                                                     \
+    ((level) <= LOG_COMPILE_LEVEL && (level) <= Logger::Level())
+
+// Запись в кольцо текущего потока, выводит ее фоновый поток логгера
+#define LOG_RECORD(level, kind, msg)                                           \
+    do {                                                                       \
+        if (LOG_ENABLED(level)) {                                              \
+            LogRecord* log_rec_ =                                              \
+                Logger::Begin(level, kind, __FILE__, __FUNCTION__);            \
+            if (log_rec_) {                                                    \
+                LogRecordBuf log_buf_(log_rec_->text, LOG_RECORD_TEXT);        \
+                std::ostream log_out_(&log_buf_);                              \
+                log_out_ << msg;                                               \
+                Logger::Commit(log_rec_, log_buf_);                            \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+// Hex-дамп: только каждый LOG_HEX_SAMPLE-й вызов с этого места
+// и только первые LOG_HEX_BYTES байт, форматирует фоновый поток
+#define LOG_DUMP(msg, add_hex)                                                 \
+    do {                                                                       \
+        static std::atomic<unsigned> log_sample_(0);                           \
+        if (LOG_ENABLED(LOG_LEVEL_TRACE)                                       \
+            && log_sample_.fetch_add(1, std::memory_order_relaxed)             \
+               % LOG_HEX_SAMPLE == 0) {                                        \
+            LogRecord* log_rec_ = Logger::Begin(                               \
+                LOG_LEVEL_TRACE, LOG_KIND_HEX, __FILE__, __FUNCTION__);        \
+            if (log_rec_) {                                                    \
+                LogRecordBuf log_buf_(log_rec_->text, LOG_RECORD_TEXT - LOG_HEX_BYTES); \
+                std::ostream log_out_(&log_buf_);                              \
+                log_out_ << msg;                                               \
+                add_hex;                                                       \
+                Logger::Commit(log_rec_, log_buf_);                            \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
 
 // Макрос для функций вне классов, который выводит HEX value
 #define LOG_HEX(msg, value, cnt)                                               \
-    if (DBG_MSG > 0) {                                                         \
-        std::cerr << ":> " << __FILE__ "::" << __FUNCTION__ << "(): ";         \
-        std::cerr << msg << ": ";                                              \
-        for (size_t i = 0; i < cnt; ++i) {                                     \
-            unsigned char byte = (value >> (i * 8)) & 0xFF;                    \
-            std::cerr << std::setw(2) << std::setfill('0')                     \
-                      << std::hex << static_cast<int>(byte);                   \
-        }                                                                      \
-        std::cerr << std::dec << std::endl;                                    \
-    }
+    LOG_DUMP(msg, Logger::AddHexValue(log_rec_, log_buf_, (value), (cnt)))
 
 // Макрос для функций вне классов, который выводит HEX vector
 #define LOG_VEC(msg, vec)                                                      \
-    if (DBG_MSG > 0) {                                                         \
-        std::cerr << ":> " << __FILE__ "::" << __FUNCTION__ << "(): ";         \
-        std::cerr << msg << ": [";                                             \
-        for (const auto& byte : vec) {                                         \
-            std::cerr << std::setw(2) << std::setfill('0') << std::hex         \
-                      << static_cast<int>(byte);                               \
-        }                                                                      \
-        std::cerr << "]" << std::dec << std::endl;                             \
-    }
+    LOG_DUMP(msg, Logger::AddHexOf(log_rec_, log_buf_, (vec)))
+
+// HEX-дамп байт [data, data + size) без копии в контейнер:
+// для горячего пути, где байты уже лежат в буфере
+#define LOG_BYTES(msg, data, size)                                             \
+    LOG_DUMP(msg, Logger::AddHex(log_rec_, log_buf_, (data),                   \
+                                 std::min<std::size_t>((size), LOG_HEX_BYTES), \
+                                 (size)))
 
 // Макрос для функций вне классов
 #define LOG_TXT(msg)                                                           \
-    if (DBG_MSG > 0) {                                                         \
-        std::cerr << ":> " << __FILE__ "::" << __FUNCTION__                    \
-                  << "(): " << msg << std::endl;                               \
-    }
-
-// Макрос для деманглинга имени класса
-#define DEMANGLE(type) abi::__cxa_demangle(typeid(type).name(), 0, 0, &status)
-
-// Макрос для логирования с использованием деманглинга
-#define LOG_BASE(level, msg)                                                   \
-    {                                                                          \
-        int status;                                                            \
-        char* demangled = DEMANGLE(*this);                                     \
-        std::cerr << level << (status == 0 ? demangled : typeid(*this).name()) \
-                  << "::" << __FUNCTION__ << "(): "                            \
-                  << msg << std::endl;                                         \
-        if (demangled) free(demangled);                                        \
-    }
+    LOG_RECORD(LOG_LEVEL_DEBUG, LOG_KIND_FUNC, msg)
 
-// Макросы для сообщений об ошибках и информационных сообщений
+// Макросы для сообщений об ошибках и информационных сообщений.
+// Имя класса и метода фоновый поток берет из __PRETTY_FUNCTION__
 #define LOG_ERR(msg)                                                           \
-    if (DBG_MSG > 0) {                                                         \
-        LOG_BASE("!> ", msg)                                                   \
-    }
+    do {                                                                       \
+        if (LOG_ENABLED(LOG_LEVEL_DEBUG)) {                                    \
+            LogRecord* log_rec_ = Logger::Begin(                               \
+                LOG_LEVEL_DEBUG, LOG_KIND_METHOD, __FILE__, __PRETTY_FUNCTION__); \
+            if (log_rec_) {                                                    \
+                LogRecordBuf log_buf_(log_rec_->text, LOG_RECORD_TEXT);        \
+                std::ostream log_out_(&log_buf_);                              \
+                log_out_ << msg;                                               \
+                Logger::Commit(log_rec_, log_buf_);                            \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
 // Эти сообщения выводятся вне зависимости от DBG_MSG
 #define LOG_MSG(msg)                                                           \
-    std::cout << "-> " << msg << std::endl;                                    \
+    LOG_RECORD(LOG_LEVEL_INFO, LOG_KIND_MSG, msg)
 
 #endif // LOG_HPP
@@ -0,0 +1,263 @@
+// Logger.cpp
+#include "Logger.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "defs.hpp"
+
+std::atomic<int> Logger::level_(LOG_COMPILE_LEVEL);
+
+// Держит кольцо потока; при выходе потока отдает кольцо логгеру на дочитку
+struct LogRingHolder {
+    std::shared_ptr<LogRing> ring;
+    ~LogRingHolder() {
+        if (ring) {
+            ring->orphaned = true;
+        }
+    }
+};
+
+LogRecordBuf::LogRecordBuf(char* begin, std::size_t size) {
+    setp(begin, begin + size);
+}
+
+std::size_t LogRecordBuf::Size() const {
+    return pptr() - pbase();
+}
+
+LogRecordBuf::int_type LogRecordBuf::overflow(int_type) {
+    return traits_type::eof();
+}
+
+Logger::Logger()
+    : stop_(false)
+{
+    thread_ = std::thread(&Logger::Run, this);
+}
+
+Logger::~Logger() {
+    stop_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+Logger& Logger::Get() {
+    static Logger logger;
+    return logger;
+}
+
+int Logger::Level() {
+    return level_.load(std::memory_order_relaxed);
+}
+
+void Logger::SetLevel(int level) {
+    level_ = level;
+}
+
+bool Logger::ParseLevel(const std::string& name, int& level) {
+    if (name == "error") {
+        level = LOG_LEVEL_ERROR;
+    } else if (name == "info") {
+        level = LOG_LEVEL_INFO;
+    } else if (name == "debug") {
+        level = LOG_LEVEL_DEBUG;
+    } else if (name == "trace") {
+        level = LOG_LEVEL_TRACE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+LogRing* Logger::ThreadRing() {
+    static thread_local LogRingHolder holder;
+    if (!holder.ring) {
+        Logger& logger = Get();
+        holder.ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> lock(logger.rings_mutex_);
+        logger.rings_.push_back(holder.ring);
+    }
+    return holder.ring.get();
+}
+
+LogRecord* Logger::Begin(int level, LogKind kind, const char* where,
+                         const char* func)
+{
+    LogRing* ring = ThreadRing();
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail - ring->head.load(std::memory_order_acquire) >= LOG_RING_RECORDS) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    LogRecord* record = &ring->records[tail % LOG_RING_RECORDS];
+    record->level = level;
+    record->kind = kind;
+    record->text_size = 0;
+    record->hex_size = 0;
+    record->hex_total = 0;
+    record->where = where;
+    record->func = func;
+    record->time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return record;
+}
+
+void Logger::Commit(LogRecord* record, const LogRecordBuf& buf) {
+    if (record->hex_size == 0) {
+        record->text_size = buf.Size();
+    }
+    LogRing* ring = ThreadRing();
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+}
+
+void Logger::AddHex(LogRecord* record, const LogRecordBuf& buf,
+                    const unsigned char* data, std::size_t size, std::size_t total)
+{
+    // Сырые байты кладутся в текст записи сразу за сообщением
+    record->text_size = buf.Size();
+    std::size_t room = LOG_RECORD_TEXT - record->text_size;
+    std::size_t n = std::min(size, room);
+    std::memcpy(record->text + record->text_size, data, n);
+    record->hex_size = n;
+    record->hex_total = total;
+}
+
+void Logger::AddHexValue(LogRecord* record, const LogRecordBuf& buf,
+                         uint64_t value, std::size_t cnt)
+{
+    unsigned char bytes[8];
+    cnt = std::min<std::size_t>(cnt, sizeof(bytes));
+    for (std::size_t i = 0; i < cnt; ++i) {
+        bytes[i] = (value >> (i * 8)) & 0xFF;
+    }
+    AddHex(record, buf, bytes, cnt, cnt);
+}
+
+void Logger::Run() {
+    // Пока есть записи - читаем без пауз, иначе спим понемногу дольше
+    int idle_ms = 1;
+    while (!stop_) {
+        if (Drain()) {
+            idle_ms = 1;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(idle_ms));
+            idle_ms = std::min(idle_ms * 2, 10);
+        }
+    }
+    Drain();
+}
+
+void Logger::Flush() {
+    while (Drain()) {
+    }
+}
+
+bool Logger::Drain() {
+    std::lock_guard<std::mutex> drain_lock(drain_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        draining_ = rings_;
+    }
+
+    // Все накопленное форматируется в память и выводится одной записью
+    bool any = false;
+    for (auto& ring : draining_) {
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        uint64_t tail = ring->tail.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            Write(ring->records[head % LOG_RING_RECORDS], out_, err_);
+            any = true;
+        }
+        ring->head.store(head, std::memory_order_release);
+
+        uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            err_ << "!> Logger: " << dropped << " records dropped\n";
+            any = true;
+        }
+    }
+    draining_.clear();
+    if (any) {
+        // Пустой rdbuf выставил бы cout failbit, поэтому проверяем tellp
+        if (out_.tellp() > 0) {
+            std::cout << out_.rdbuf() << std::flush;
+        }
+        if (err_.tellp() > 0) {
+            std::cerr << err_.rdbuf();
+        }
+        // Присваивание пустой строки сохраняет емкость буфера
+        out_.str(std::string());
+        err_.str(std::string());
+    }
+
+    // Кольца завершившихся потоков, дочитанные до конца, больше не нужны
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    for (auto it = rings_.begin(); it != rings_.end();) {
+        if ((*it)->orphaned
+            && (*it)->head.load() == (*it)->tail.load(std::memory_order_acquire)) {
+            it = rings_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    return any;
+}
+
+// "void PersonInRoom::Start(int)" -> "PersonInRoom::Start"
+// Пишется прямо в поток, без копии в std::string: фоновый поток
+// печатает записи, ничего не выделяя
+static void WriteMethodName(std::ostream& err, const char* pretty) {
+    const char* end = std::strchr(pretty, '(');
+    if (!end) {
+        end = pretty + std::strlen(pretty);
+    }
+    const char* begin = end;
+    while (begin != pretty && begin[-1] != ' ') {
+        --begin;
+    }
+    err.write(begin, end - begin);
+}
+
+void Logger::Write(const LogRecord& record, std::ostream& out, std::ostream& err) {
+    const char* text = record.text;
+    std::streamsize size = record.text_size;
+
+    switch (record.kind) {
+    case LOG_KIND_MSG:
+        out << "-> ";
+        out.write(text, size) << "\n";
+        return;
+    case LOG_KIND_METHOD:
+        err << "!> ";
+        WriteMethodName(err, record.func);
+        err << "(): ";
+        err.write(text, size) << "\n";
+        return;
+    case LOG_KIND_FUNC:
+        err << ":> " << record.where << "::" << record.func << "(): ";
+        err.write(text, size) << "\n";
+        return;
+    case LOG_KIND_HEX:
+        err << ":> " << record.where << "::" << record.func << "(): ";
+        err.write(text, size) << ": [";
+        const unsigned char* hex =
+            reinterpret_cast<const unsigned char*>(record.text + record.text_size);
+        for (std::size_t i = 0; i < record.hex_size; ++i) {
+            err << std::setw(2) << std::setfill('0') << std::hex
+                      << static_cast<int>(hex[i]);
+        }
+        err << std::dec;
+        if (record.hex_total > record.hex_size) {
+            err << "... " << record.hex_total << " bytes";
+        }
+        err << "]\n";
+        return;
+    }
+}
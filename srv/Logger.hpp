@@ -0,0 +1,145 @@
+// Logger.hpp
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+// Уровни логирования: чем больше, тем подробнее
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_DEBUG 2
+#define LOG_LEVEL_TRACE 3
+
+// Размер текста одной записи и число записей в кольце потока
+#define LOG_RECORD_TEXT 448
+#define LOG_RING_RECORDS 1024
+// Из дампа сохраняется не больше LOG_HEX_BYTES байт
+#define LOG_HEX_BYTES 64
+
+enum LogKind {
+    LOG_KIND_MSG,       // "-> msg" в stdout
+    LOG_KIND_METHOD,    // "!> Class::Method(): msg" в stderr
+    LOG_KIND_FUNC,      // ":> file::func(): msg" в stderr
+    LOG_KIND_HEX        // как LOG_KIND_FUNC, плюс hex-дамп
+};
+
+/**
+   Запись в кольце. where и func - строковые литералы
+   (__FILE__, __PRETTY_FUNCTION__), их можно хранить указателем.
+*/
+struct LogRecord {
+    uint8_t level;
+    uint8_t kind;
+    uint16_t text_size;
+    uint16_t hex_size;
+    uint32_t hex_total;
+    const char* where;
+    const char* func;
+    uint64_t time_ns;
+    char text[LOG_RECORD_TEXT];
+};
+
+/**
+   Кольцо записей одного потока: пишет только поток-владелец,
+   читает только фоновый поток логгера, поэтому хватает двух
+   атомарных счетчиков, без блокировок.
+*/
+struct LogRing {
+    std::atomic<uint64_t> head{0};      // следующая запись для чтения
+    std::atomic<uint64_t> tail{0};      // следующая запись для заполнения
+    std::atomic<uint64_t> dropped{0};   // переполнения кольца
+    std::atomic<bool> orphaned{false};  // поток-владелец завершился
+    LogRecord records[LOG_RING_RECORDS];
+};
+
+/**
+   streambuf поверх текста записи: operator<< пишет прямо в кольцо,
+   без кучи. Что не влезло, молча отрезается.
+*/
+class LogRecordBuf : public std::streambuf {
+public:
+    LogRecordBuf(char* begin, std::size_t size);
+    std::size_t Size() const;
+
+protected:
+    int_type overflow(int_type ch) override;
+};
+
+/**
+   Асинхронный логгер. Вызывающий поток только заполняет запись
+   в своем кольце (Begin/Commit). Фоновый поток забирает записи,
+   разбирает имя метода, форматирует hex-дампы и пишет в stdout/stderr.
+   Если кольцо полно, запись теряется и учитывается в dropped.
+
+   Уровень проверяется дважды: при компиляции (LOG_COMPILE_LEVEL,
+   лишние вызовы вырезаются целиком) и во время работы (SetLevel).
+*/
+class Logger {
+public:
+    static Logger& Get();
+    ~Logger();
+
+    static int Level();
+    static void SetLevel(int level);
+    static bool ParseLevel(const std::string& name, int& level);
+
+    // Запись в кольце текущего потока или nullptr, если кольцо полно
+    static LogRecord* Begin(int level, LogKind kind, const char* where,
+                            const char* func);
+    static void Commit(LogRecord* record, const LogRecordBuf& buf);
+    static void AddHex(LogRecord* record, const LogRecordBuf& buf,
+                       const unsigned char* data, std::size_t size,
+                       std::size_t total);
+
+    // Hex-дамп любого контейнера байт: первые LOG_HEX_BYTES байт
+    template <typename Container>
+    static void AddHexOf(LogRecord* record, const LogRecordBuf& buf,
+                         const Container& bytes)
+    {
+        unsigned char head[LOG_HEX_BYTES];
+        std::size_t n = 0;
+        for (auto it = bytes.begin(); it != bytes.end() && n < LOG_HEX_BYTES; ++it) {
+            head[n++] = static_cast<unsigned char>(*it);
+        }
+        AddHex(record, buf, head, n, bytes.size());
+    }
+
+    // Hex-дамп cnt младших байт числа
+    static void AddHexValue(LogRecord* record, const LogRecordBuf& buf,
+                            uint64_t value, std::size_t cnt);
+
+    // Дописать все накопленное (при завершении процесса)
+    void Flush();
+
+private:
+    Logger();
+    static LogRing* ThreadRing();
+    void Run();
+    bool Drain();
+    void Write(const LogRecord& record, std::ostream& out, std::ostream& err);
+
+    static std::atomic<int> level_;
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    // Буферы Drain живут между вызовами и сохраняют емкость: фоновый
+    // поток не выделяет память на каждую пачку записей. Drain
+    // вызывается и из Flush, поэтому под своим мьютексом
+    std::mutex drain_mutex_;
+    std::vector<std::shared_ptr<LogRing>> draining_;
+    // Не ostringstream: из него rdbuf() ничего не прочитать, и вывод
+    // в cout выставил бы failbit, после чего cout молчал бы совсем
+    std::stringstream out_;
+    std::stringstream err_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
+
+#endif // LOGGER_HPP
@@ -0,0 +1,195 @@
+// MainBench.cpp
+#include <iostream>
+#include <random>
+#include <thread>
+#include <sys/resource.h>
+#include "Bench.hpp"
+#include "IoServicePool.hpp"
+
+static void Usage() {
+    std::cerr << "Usage: chat_bench [--sessions N] [--senders N] [--window N]"
+              << " [--rate FRAMES_PER_SEC] [--size BYTES] [--max-size BYTES]"
+              << " [--duration SEC] [--threads N] [--rooms N] [--ports N] [--v1] [--json]"
+              << " <host> <port> | --shm PATH\n";
+}
+
+// Тысячи сессий упираются в лимит открытых файлов, поднимаем его до жесткого
+static void RaiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::size_t sessions = 100;
+        std::size_t senders = 1;
+        std::size_t duration = 10;
+        std::size_t threads = 1;
+        std::size_t rooms = 0;
+        std::size_t ports = 1;
+        bool json = false;
+        std::string shm_path;
+        BenchLoad load;
+        load.window = 4;
+        load.rate = 0;
+        load.min_size = MIN_PACK_SIZE;
+        load.max_size = 0;
+        load.v2 = true;
+        std::vector<std::string> positional;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "--sessions" && i + 1 < argc) {
+                sessions = std::atoi(argv[++i]);
+            } else if (arg == "--senders" && i + 1 < argc) {
+                senders = std::atoi(argv[++i]);
+            } else if (arg == "--window" && i + 1 < argc) {
+                load.window = std::atoi(argv[++i]);
+            } else if (arg == "--rate" && i + 1 < argc) {
+                load.rate = std::atof(argv[++i]);
+            } else if (arg == "--size" && i + 1 < argc) {
+                load.min_size = std::atoi(argv[++i]);
+            } else if (arg == "--max-size" && i + 1 < argc) {
+                load.max_size = std::atoi(argv[++i]);
+            } else if (arg == "--duration" && i + 1 < argc) {
+                duration = std::atoi(argv[++i]);
+            } else if (arg == "--threads" && i + 1 < argc) {
+                threads = std::atoi(argv[++i]);
+            } else if (arg == "--rooms" && i + 1 < argc) {
+                rooms = std::atoi(argv[++i]);
+            } else if (arg == "--ports" && i + 1 < argc) {
+                ports = std::atoi(argv[++i]);
+            } else if (arg == "--v1") {
+                load.v2 = false;
+            } else if (arg == "--shm" && i + 1 < argc) {
+                shm_path = argv[++i];
+            } else if (arg == "--json") {
+                json = true;
+            } else {
+                positional.push_back(arg);
+            }
+        }
+
+        // Без --max-size все кадры одного размера
+        load.max_size = std::max(load.max_size, load.min_size);
+        // Через --shm (локальный транспорт сервера) - только кадры v2
+        bool shm = !shm_path.empty();
+        if (positional.size() != (shm ? 0 : 2) || (shm && !load.v2) || sessions == 0 || threads == 0 || ports == 0
+            || load.max_size > MAX_PACK_SIZE || load.rate < 0) {
+            Usage();
+            return 1;
+        }
+        senders = std::min(senders, sessions);
+        RaiseFileLimit();
+
+        tcp::endpoint endpoint;
+        if (!shm) {
+            boost::asio::io_service resolver_service;
+            tcp::resolver resolver(resolver_service);
+            endpoint = *resolver.resolve(tcp::resolver::query(positional[0], positional[1]));
+        }
+
+        IoServicePool pool(threads);
+        BenchStats stats;
+        uint32_t run_id = std::random_device()();
+        std::thread runner(boost::bind(&IoServicePool::Run, &pool));
+
+        // Сессии раскладываются по ports портам подряд: с одного адреса
+        // к одному порту не открыть больше, чем есть эфемерных портов.
+        // Одновременно подключается не больше BENCH_CONNECT_WINDOW сессий,
+        // чтобы не переполнять очередь accept сервера
+        auto progress = std::chrono::steady_clock::now();
+        uint64_t done = 0;
+        for (std::size_t i = 0; i < sessions; ++i) {
+            while (i >= stats.connected + stats.errors + BENCH_CONNECT_WINDOW) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            uint32_t room_id = rooms > 0 ? 1 + i % rooms : DEFAULT_ROOM;
+            if (shm) {
+                std::shared_ptr<BenchShmSession> session(new BenchShmSession(
+                    pool.GetIoService(), stats, run_id, i, room_id, i < senders, load));
+                session->Start(shm_path);
+                continue;
+            }
+            tcp::endpoint target(endpoint.address(), endpoint.port() + i % ports);
+            std::shared_ptr<BenchSession> session(new BenchSession(
+                pool.GetIoService(), stats, run_id, i, room_id, i < senders, load));
+            session->Start(target);
+        }
+
+        // Ждем подключения всех сессий, пока они подключаются,
+        // и даем системе прогреться
+        while (stats.connected + stats.errors < sessions
+               && std::chrono::steady_clock::now() - progress < std::chrono::seconds(10)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (stats.connected + stats.errors != done) {
+                done = stats.connected + stats.errors;
+                progress = std::chrono::steady_clock::now();
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        uint64_t sent_start = stats.frames_sent;
+        uint64_t frames_start = stats.frames_received;
+        uint64_t bytes_start = stats.bytes_received;
+        auto started = std::chrono::steady_clock::now();
+        stats.measuring = true;
+
+        std::this_thread::sleep_for(std::chrono::seconds(duration));
+
+        stats.measuring = false;
+        double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - started).count();
+        uint64_t sent = stats.frames_sent - sent_start;
+        uint64_t frames = stats.frames_received - frames_start;
+        uint64_t bytes = stats.bytes_received - bytes_start;
+
+        pool.Stop();
+        runner.join();
+
+        const Histogram& latency = stats.latency_ns;
+        if (json) {
+            // Одна строка JSON на запуск: удобно дописывать в файл и сравнивать
+            std::cout << "{\"sessions\":" << sessions
+                      << ",\"connected\":" << stats.connected
+                      << ",\"errors\":" << stats.errors
+                      << ",\"senders\":" << senders
+                      << ",\"rooms\":" << rooms
+                      << ",\"ports\":" << ports
+                      << ",\"v2\":" << (load.v2 ? "true" : "false")
+                      << ",\"shm\":" << (shm ? "true" : "false")
+                      << ",\"threads\":" << threads
+                      << ",\"window\":" << load.window
+                      << ",\"rate\":" << load.rate
+                      << ",\"min_size\":" << load.min_size
+                      << ",\"max_size\":" << load.max_size
+                      << ",\"duration_s\":" << elapsed
+                      << ",\"frames_sent_per_s\":" << sent / elapsed
+                      << ",\"fanout_frames_per_s\":" << frames / elapsed
+                      << ",\"fanout_bytes_per_s\":" << bytes / elapsed
+                      << ",\"latency_count\":" << latency.Count()
+                      << ",\"latency_p50_ns\":" << latency.Quantile(0.5)
+                      << ",\"latency_p99_ns\":" << latency.Quantile(0.99)
+                      << ",\"latency_p999_ns\":" << latency.Quantile(0.999)
+                      << ",\"latency_max_ns\":" << latency.Quantile(1.0)
+                      << "}" << std::endl;
+        } else {
+            std::cout << "sessions:        " << stats.connected << "/" << sessions << "\n"
+                      << "errors:          " << stats.errors << "\n"
+                      << "frames sent/s:   " << sent / elapsed << "\n"
+                      << "fan-out frames/s: " << frames / elapsed << "\n"
+                      << "fan-out MB/s:    " << bytes / elapsed / (1024 * 1024) << "\n"
+                      << "latency p50 us:  " << latency.Quantile(0.5) / 1000.0 << "\n"
+                      << "latency p99 us:  " << latency.Quantile(0.99) / 1000.0 << "\n"
+                      << "latency p999 us: " << latency.Quantile(0.999) / 1000.0 << "\n";
+        }
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
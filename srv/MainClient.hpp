@@ -9,5 +9,11 @@
 #include <boost/thread/thread.hpp>
 #include "WorkerThread.hpp"
 #include "Server.hpp"
+#include "StatsServer.hpp"
+#include "AdminServer.hpp"
+#include "Federation.hpp"
+#include "ShmServer.hpp"
+#include "Handoff.hpp"
+#include "Tracer.hpp"
 
 #endif // MAINCLIENT_HPP
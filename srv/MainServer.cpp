@@ -1,47 +1,271 @@
 // MainServer.cpp
+#include <filesystem>
+#include <sys/resource.h>
+#include <unistd.h>
 #include "MainClient.hpp"
 
+// По SIGUSR1 выводим счетчики сервера
+static void DumpMetrics(boost::asio::signal_set& signals,
+                        const boost::system::error_code& error)
+{
+    if (error) {
+        return;
+    }
+    Metrics::Get().Dump(std::cout);
+    std::cout.flush();
+    signals.async_wait(boost::bind(&DumpMetrics, boost::ref(signals), _1));
+}
+
+// Каждое соединение - открытый файл, поднимаем лимит до жесткого
+static void RaiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Каталог истории создается и проверяется до старта: комнаты открывают
+// журналы уже в рабочих потоках, где ошибка оставит комнату без истории
+static bool PrepareHistoryDir(const std::string& dir) {
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    if (error) {
+        std::cerr << "Cannot create history dir " << dir << ": " << error.message() << "\n";
+        return false;
+    }
+    if (::access(dir.c_str(), R_OK | W_OK | X_OK) != 0) {
+        std::cerr << "History dir " << dir << " is not writable: "
+                  << std::strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Список адресов через запятую
+static std::vector<std::string> SplitPeers(const std::string& list) {
+    std::vector<std::string> peers;
+    std::size_t begin = 0;
+    while (begin <= list.size()) {
+        std::size_t end = std::min(list.find(',', begin), list.size());
+        if (end > begin) {
+            peers.push_back(list.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    return peers;
+}
+
+static void Usage() {
+    std::cerr << "Usage: chat_server [--threads N] [--queue-frames N] [--queue-bytes N]"
+              << " [--slow-policy drop-oldest|latest|disconnect]"
+              << " [--read-timeout SEC] [--idle-timeout SEC]"
+              << " [--session-frames-per-sec N] [--session-bytes-per-sec N]"
+              << " [--room-frames-per-sec N] [--room-bytes-per-sec N]"
+              << " [--history-dir DIR] [--history-recent N]"
+              << " [--history-segment-bytes N] [--history-retention-bytes N]"
+              << " [--history-retention-hours N] [--max-rooms N] [--session-rooms N]"
+              << " [--log-level error|info|debug|trace]"
+              << " [--stats-port N] [--stats-socket PATH] [--admin-socket PATH]"
+              << " [--shm-socket PATH]"
+              << " [--peer-listen HOST:PORT [--peers HOST:PORT,...]]"
+              << " [--upgrade-socket PATH] [--takeover PATH] [--drain-timeout SEC]"
+              << " [--trace-file PATH [--trace-sample N] [--trace-file-bytes N]]"
+              << " <port> [<port> ...]\n";
+}
+
 int main(int argc, char* argv[]) {
     try {
-        if (argc < 2) {
-            std::cerr << "Usage: chat_server <port> [<port> ...]\n";
+        // По умолчанию - по одному рабочему потоку на ядро
+        std::size_t threads = std::max(1u, boost::thread::hardware_concurrency());
+        std::vector<unsigned short> ports;
+        unsigned short stats_port = 0;
+        std::string stats_socket;
+        std::string admin_socket;
+        std::string upgrade_socket;
+        std::string takeover;
+        std::size_t drain_timeout = DRAIN_TIMEOUT_SEC;
+        std::string trace_file;
+        std::size_t trace_file_bytes = TRACE_FILE_BYTES;
+        std::string shm_socket;
+        std::string peer_listen;
+        std::vector<std::string> peers;
+        Config& config = Config::Get();
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "--threads" && i + 1 < argc) {
+                threads = std::atoi(argv[++i]);
+            } else if (arg == "--queue-frames" && i + 1 < argc) {
+                config.send_queue_max_frames = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--queue-bytes" && i + 1 < argc) {
+                config.send_queue_max_bytes = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--slow-policy" && i + 1 < argc) {
+                SlowConsumerPolicy policy;
+                if (!Config::ParsePolicy(argv[++i], policy)) {
+                    Usage();
+                    return 1;
+                }
+                config.slow_consumer_policy = policy;
+            } else if (arg == "--read-timeout" && i + 1 < argc) {
+                config.read_timeout = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--idle-timeout" && i + 1 < argc) {
+                config.idle_timeout = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--session-frames-per-sec" && i + 1 < argc) {
+                config.session_frames_per_sec = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--session-bytes-per-sec" && i + 1 < argc) {
+                config.session_bytes_per_sec = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--room-frames-per-sec" && i + 1 < argc) {
+                config.room_frames_per_sec = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--room-bytes-per-sec" && i + 1 < argc) {
+                config.room_bytes_per_sec = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--history-dir" && i + 1 < argc) {
+                config.history_dir = argv[++i];
+            } else if (arg == "--history-recent" && i + 1 < argc) {
+                config.history_recent = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--history-segment-bytes" && i + 1 < argc) {
+                config.history.segment_bytes = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--history-retention-bytes" && i + 1 < argc) {
+                config.history.retention_bytes = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--history-retention-hours" && i + 1 < argc) {
+                config.history.retention_seconds =
+                    std::strtoull(argv[++i], nullptr, 10) * 3600;
+            } else if (arg == "--max-rooms" && i + 1 < argc) {
+                config.rooms_max = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--session-rooms" && i + 1 < argc) {
+                config.session_rooms_max = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--stats-port" && i + 1 < argc) {
+                stats_port = std::atoi(argv[++i]);
+            } else if (arg == "--stats-socket" && i + 1 < argc) {
+                stats_socket = argv[++i];
+            } else if (arg == "--admin-socket" && i + 1 < argc) {
+                admin_socket = argv[++i];
+            } else if (arg == "--shm-socket" && i + 1 < argc) {
+                shm_socket = argv[++i];
+            } else if (arg == "--upgrade-socket" && i + 1 < argc) {
+                upgrade_socket = argv[++i];
+            } else if (arg == "--takeover" && i + 1 < argc) {
+                takeover = argv[++i];
+            } else if (arg == "--drain-timeout" && i + 1 < argc) {
+                drain_timeout = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--trace-file" && i + 1 < argc) {
+                trace_file = argv[++i];
+            } else if (arg == "--trace-sample" && i + 1 < argc) {
+                config.trace_sample = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--trace-file-bytes" && i + 1 < argc) {
+                trace_file_bytes = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--peer-listen" && i + 1 < argc) {
+                peer_listen = argv[++i];
+            } else if (arg == "--peers" && i + 1 < argc) {
+                peers = SplitPeers(argv[++i]);
+            } else if (arg == "--log-level" && i + 1 < argc) {
+                int level;
+                if (!Logger::ParseLevel(argv[++i], level)) {
+                    Usage();
+                    return 1;
+                }
+                Logger::SetLevel(level);
+            } else {
+                ports.push_back(std::atoi(argv[i]));
+            }
+        }
+
+        if (ports.empty() || threads == 0 || (!peers.empty() && peer_listen.empty())) {
+            Usage();
             return 1;
         }
 
-        std::shared_ptr<boost::asio::io_service> io_service(
-            new boost::asio::io_service);
-        boost::shared_ptr<boost::asio::io_service::work> work(
-            new boost::asio::io_service::work(*io_service));
-        boost::shared_ptr<boost::asio::io_service::strand> strand(
-            new boost::asio::io_service::strand(*io_service));
+        if (!PrepareHistoryDir(config.history_dir)) {
+            return 1;
+        }
+        RaiseFileLimit();
+        // Перезапуск: слушающие сокеты забираются у работающего сервера
+        // до того, как их откроет кто-либо из акцепторов
+        if (!takeover.empty()) {
+            Handoff::Get().Take(takeover);
+        }
+        IoServicePool pool(threads);
+        // Трассировка включается до приема соединений и дальше только
+        // меняет частоту выборки (trace-sample через админ-сокет)
+        if (!trace_file.empty()) {
+            Tracer::Get().Start(trace_file, trace_file_bytes);
+        }
 
-        std::cout << "[" << std::this_thread::get_id() << "] server starts" << std::endl;
+        std::cout << "[" << std::this_thread::get_id() << "] server starts, "
+                  << threads << " worker threads, "
+                  << IoServicePool::Backend() << ", "
+                  << PersonInRoom::Engine() << std::endl;
+
+        // Узел федерации: имя - адрес, на котором он ждет соседей
+        std::unique_ptr<Federation> federation;
+        if (!peer_listen.empty()) {
+            // Один и тот же список --peers годится всем узлам
+            peers.erase(std::remove(peers.begin(), peers.end(), peer_listen), peers.end());
+            federation.reset(new Federation(pool.GetIoService(0), peer_listen, peers));
+            std::cout << "federation node " << peer_listen << ", "
+                      << peers.size() << " peers" << std::endl;
+        }
+
+        RoomRegistry registry(pool, federation.get());
+        if (federation) {
+            federation->Start(registry);
+        }
 
         std::list<std::shared_ptr<Server>> servers;
-        for (int i = 1; i < argc; ++i) {
-            tcp::endpoint endpoint(tcp::v4(), std::atoi(argv[i]));
-            std::shared_ptr<Server> a_server(new Server(*io_service, *strand, endpoint));
+        for (auto port : ports) {
+            tcp::endpoint endpoint(tcp::v4(), port);
+            std::shared_ptr<Server> a_server(new Server(pool, registry, endpoint));
             servers.push_back(a_server);
         }
 
-        boost::thread_group workers;
-        for (int i = 0; i < 1; ++i) {
-            boost::thread* t = new boost::thread{
-                boost::bind(&WorkerThread::Run, io_service)};
-#ifdef __linux__
-            // bind cpu affinity for worker thread in linux
-            cpu_set_t cpuset;
-            CPU_ZERO(&cpuset);
-            CPU_SET(i, &cpuset);
-            pthread_setaffinity_np(t->native_handle(), sizeof(cpu_set_t), &cpuset);
-#endif
-            workers.add_thread(t);
+        // Локальные клиенты: кольца в общей памяти вместо TCP
+        std::unique_ptr<ShmServer> shm_server;
+        if (!shm_socket.empty()) {
+            ::unlink(shm_socket.c_str());
+            shm_server.reset(new ShmServer(
+                pool, registry,
+                boost::asio::local::stream_protocol::endpoint(shm_socket)));
+        }
+
+        // Счетчики отдаются только локально: loopback или unix-сокет
+        std::unique_ptr<TcpStatsServer> tcp_stats;
+        if (stats_port != 0) {
+            tcp_stats.reset(new TcpStatsServer(
+                pool.GetIoService(0),
+                tcp::endpoint(boost::asio::ip::address_v4::loopback(), stats_port)));
         }
+        std::unique_ptr<LocalStatsServer> local_stats;
+        if (!stats_socket.empty()) {
+            ::unlink(stats_socket.c_str());
+            local_stats.reset(new LocalStatsServer(
+                pool.GetIoService(0),
+                boost::asio::local::stream_protocol::endpoint(stats_socket)));
+        }
+
+        // Управление на ходу: комнаты, участники, параметры Config
+        std::unique_ptr<AdminServer> admin;
+        if (!admin_socket.empty()) {
+            ::unlink(admin_socket.c_str());
+            admin.reset(new AdminServer(
+                pool.GetIoService(0), registry,
+                boost::asio::local::stream_protocol::endpoint(admin_socket)));
+        }
+
+        Handoff::Get().ReleaseUnused();
+        // Следующий перезапуск: ждем преемника
+        if (!upgrade_socket.empty()) {
+            Handoff::Get().Listen(pool, registry, upgrade_socket, drain_timeout);
+        }
+
+        boost::asio::signal_set signals(pool.GetIoService(0), SIGUSR1);
+        signals.async_wait(boost::bind(&DumpMetrics, boost::ref(signals), _1));
 
-        workers.join_all();
+        pool.Run();
     } catch (std::exception& e) {
         std::cerr << "Exception: " << e.what() << "\n";
     }
 
+    Tracer::Get().Stop();
+    Logger::Get().Flush();
     return 0;
 }
@@ -0,0 +1,259 @@
+// Metrics.cpp
+#include <chrono>
+#include <fstream>
+#include <unistd.h>
+#include "Metrics.hpp"
+#include "HeapCounter.hpp"
+
+// Резидентная память процесса, 0 - если /proc недоступен
+static uint64_t ProcessRssBytes() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t total_pages = 0;
+    uint64_t resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) {
+        return 0;
+    }
+    return resident_pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+Metrics::Metrics()
+    : sessions_accepted_(0),
+      sessions_active_(0),
+      read_bytes_(0),
+      frames_broadcast_(0),
+      frames_delivered_(0),
+      frames_routed_(0),
+      frames_unroutable_(0),
+      crc_errors_(0),
+      resyncs_(0),
+      resync_bytes_(0),
+      queued_frames_(0),
+      queued_bytes_(0),
+      throttled_by_session_(0),
+      throttled_by_room_(0),
+      throttled_sessions_(0),
+      throttled_ns_(0),
+      deadline_timeouts_(0),
+      idle_timeouts_(0),
+      rooms_active_(0),
+      rooms_rejected_(0),
+      write_flushes_(0),
+      write_frames_(0),
+      write_bytes_(0),
+      queue_overflows_(0),
+      queue_dropped_frames_(0),
+      queue_dropped_bytes_(0),
+      queue_skips_(0),
+      queue_disconnects_(0),
+      peer_links_(0),
+      peer_frames_sent_(0),
+      peer_bytes_sent_(0),
+      peer_frames_received_(0),
+      peer_bytes_received_(0)
+{
+    for (auto& bucket : frames_per_flush_) {
+        bucket = 0;
+    }
+}
+
+Metrics& Metrics::Get() {
+    static Metrics metrics;
+    return metrics;
+}
+
+int64_t Metrics::NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Metrics::RecordAccept() {
+    sessions_accepted_.fetch_add(1, std::memory_order_relaxed);
+    sessions_active_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordSessionEnd() {
+    sessions_active_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordRead(std::size_t bytes) {
+    read_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::RecordBroadcast(std::size_t recipients) {
+    frames_broadcast_.fetch_add(1, std::memory_order_relaxed);
+    frames_delivered_.fetch_add(recipients, std::memory_order_relaxed);
+}
+
+void Metrics::RecordRouted(std::size_t recipients) {
+    frames_routed_.fetch_add(1, std::memory_order_relaxed);
+    frames_delivered_.fetch_add(recipients, std::memory_order_relaxed);
+    if (recipients == 0) {
+        frames_unroutable_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::RecordCrcError() {
+    crc_errors_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordResync(std::size_t bytes) {
+    resyncs_.fetch_add(1, std::memory_order_relaxed);
+    resync_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::RecordQueued(int64_t frames, int64_t bytes) {
+    queued_frames_.fetch_add(frames, std::memory_order_relaxed);
+    queued_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::RecordThrottle(bool session, bool room) {
+    if (session) {
+        throttled_by_session_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (room) {
+        throttled_by_room_.fetch_add(1, std::memory_order_relaxed);
+    }
+    throttled_sessions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordThrottleEnd(int64_t ns) {
+    throttled_sessions_.fetch_sub(1, std::memory_order_relaxed);
+    throttled_ns_.fetch_add(ns > 0 ? ns : 0, std::memory_order_relaxed);
+}
+
+void Metrics::RecordDeadlineTimeout() {
+    deadline_timeouts_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordIdleTimeout() {
+    idle_timeouts_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordRoom(int64_t delta) {
+    rooms_active_.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Metrics::RecordRoomRejected() {
+    rooms_rejected_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordReadToBroadcast(int64_t ns) {
+    read_to_broadcast_ns_.Record(ns > 0 ? ns : 0);
+}
+
+void Metrics::RecordBroadcastToWrite(int64_t ns) {
+    broadcast_to_write_ns_.Record(ns > 0 ? ns : 0);
+}
+
+void Metrics::RecordFlush(std::size_t frames, std::size_t bytes) {
+    write_flushes_.fetch_add(1, std::memory_order_relaxed);
+    write_frames_.fetch_add(frames, std::memory_order_relaxed);
+    write_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+
+    // Номер корзины - номер старшего бита
+    std::size_t bucket = 0;
+    while ((frames >>= 1) != 0 && bucket < FLUSH_BUCKETS - 1) {
+        ++bucket;
+    }
+    frames_per_flush_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordOverflow() {
+    queue_overflows_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordDrop(std::size_t bytes) {
+    queue_dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+    queue_dropped_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::RecordSkip() {
+    queue_skips_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordDisconnect() {
+    queue_disconnects_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordPeerLink(int64_t delta) {
+    peer_links_.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Metrics::RecordPeerSend(std::size_t frames, std::size_t bytes) {
+    peer_frames_sent_.fetch_add(frames, std::memory_order_relaxed);
+    peer_bytes_sent_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::RecordPeerReceive(std::size_t frames, std::size_t bytes) {
+    peer_frames_received_.fetch_add(frames, std::memory_order_relaxed);
+    peer_bytes_received_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+int64_t Metrics::SessionsActive() const {
+    return sessions_active_.load(std::memory_order_relaxed);
+}
+
+void Metrics::Dump(std::ostream& out) const {
+    uint64_t flushes = write_flushes_.load(std::memory_order_relaxed);
+    uint64_t frames = write_frames_.load(std::memory_order_relaxed);
+
+    out << "sessions_accepted " << sessions_accepted_.load(std::memory_order_relaxed) << "\n"
+        << "sessions_active " << sessions_active_.load(std::memory_order_relaxed) << "\n"
+        << "process_rss_bytes " << ProcessRssBytes() << "\n"
+        << "heap_allocations " << HeapAllocations() << "\n"
+        << "read_bytes " << read_bytes_.load(std::memory_order_relaxed) << "\n"
+        << "frames_broadcast " << frames_broadcast_.load(std::memory_order_relaxed) << "\n"
+        << "frames_delivered " << frames_delivered_.load(std::memory_order_relaxed) << "\n"
+        << "frames_routed " << frames_routed_.load(std::memory_order_relaxed) << "\n"
+        << "frames_unroutable " << frames_unroutable_.load(std::memory_order_relaxed) << "\n"
+        << "crc_errors " << crc_errors_.load(std::memory_order_relaxed) << "\n"
+        << "resyncs " << resyncs_.load(std::memory_order_relaxed) << "\n"
+        << "resync_bytes " << resync_bytes_.load(std::memory_order_relaxed) << "\n"
+        << "throttle_pauses{bucket=\"session\"} "
+        << throttled_by_session_.load(std::memory_order_relaxed) << "\n"
+        << "throttle_pauses{bucket=\"room\"} "
+        << throttled_by_room_.load(std::memory_order_relaxed) << "\n"
+        << "throttled_sessions " << throttled_sessions_.load(std::memory_order_relaxed) << "\n"
+        << "throttled_ns " << throttled_ns_.load(std::memory_order_relaxed) << "\n"
+        << "deadline_timeouts " << deadline_timeouts_.load(std::memory_order_relaxed) << "\n"
+        << "idle_timeouts " << idle_timeouts_.load(std::memory_order_relaxed) << "\n"
+        << "rooms_active " << rooms_active_.load(std::memory_order_relaxed) << "\n"
+        << "rooms_rejected " << rooms_rejected_.load(std::memory_order_relaxed) << "\n"
+        << "queued_frames " << queued_frames_.load(std::memory_order_relaxed) << "\n"
+        << "queued_bytes " << queued_bytes_.load(std::memory_order_relaxed) << "\n";
+
+    out << "write_flushes " << flushes << "\n"
+        << "write_frames " << frames << "\n"
+        << "write_bytes " << write_bytes_.load(std::memory_order_relaxed) << "\n"
+        << "write_frames_per_flush "
+        << (flushes ? static_cast<double>(frames) / flushes : 0.0) << "\n";
+
+    for (std::size_t i = 0; i < FLUSH_BUCKETS; ++i) {
+        out << "write_flushes_by_frames{range=\"" << (1u << i);
+        if (i == FLUSH_BUCKETS - 1) {
+            out << "+";
+        } else if (i > 0) {
+            out << "-" << ((2u << i) - 1);
+        }
+        out << "\"} " << frames_per_flush_[i].load(std::memory_order_relaxed) << "\n";
+    }
+
+    out << "queue_overflows " << queue_overflows_.load(std::memory_order_relaxed) << "\n"
+        << "queue_dropped_frames "
+        << queue_dropped_frames_.load(std::memory_order_relaxed) << "\n"
+        << "queue_dropped_bytes "
+        << queue_dropped_bytes_.load(std::memory_order_relaxed) << "\n"
+        << "queue_skips " << queue_skips_.load(std::memory_order_relaxed) << "\n"
+        << "queue_disconnects "
+        << queue_disconnects_.load(std::memory_order_relaxed) << "\n"
+        << "peer_links " << peer_links_.load(std::memory_order_relaxed) << "\n"
+        << "peer_frames_sent " << peer_frames_sent_.load(std::memory_order_relaxed) << "\n"
+        << "peer_bytes_sent " << peer_bytes_sent_.load(std::memory_order_relaxed) << "\n"
+        << "peer_frames_received "
+        << peer_frames_received_.load(std::memory_order_relaxed) << "\n"
+        << "peer_bytes_received "
+        << peer_bytes_received_.load(std::memory_order_relaxed) << "\n";
+
+    read_to_broadcast_ns_.Dump(out, "read_to_broadcast_ns");
+    broadcast_to_write_ns_.Dump(out, "broadcast_to_write_ns");
+}
@@ -0,0 +1,118 @@
+// Metrics.hpp
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include "Histogram.hpp"
+#include "defs.hpp"
+
+// Корзины гистограммы кадров на одну запись: 1, 2-3, 4-7, ..., 64+
+#define FLUSH_BUCKETS 7
+
+/**
+   Счетчики сервера. Все поля атомарные, обновлять можно из любого потока.
+   Dump выводит их в текстовом виде "имя значение", по строке на счетчик.
+   Задержки меряются по steady_clock в наносекундах (NowNs).
+*/
+class Metrics {
+public:
+    static Metrics& Get();
+    static int64_t NowNs();
+
+    // Сессии: принятые всего и живые сейчас
+    void RecordAccept();
+    void RecordSessionEnd();
+    // Прочитано из сокета клиента
+    void RecordRead(std::size_t bytes);
+    // Кадр разослан recipients участникам комнаты
+    void RecordBroadcast(std::size_t recipients);
+    // Кадр v2 с неверным crc; пропущено bytes байт при поиске magic
+    void RecordCrcError();
+    void RecordResync(std::size_t bytes);
+    // Адресный кадр доставлен recipients сессиям (0 - получателя нет)
+    void RecordRouted(std::size_t recipients);
+    // Изменение суммарной глубины очередей отправки всех сессий
+    void RecordQueued(int64_t frames, int64_t bytes);
+    // Сессия перестала читать: пусто ее ведро и/или ведро комнаты
+    void RecordThrottle(bool session, bool room);
+    // Сессия снова читает после паузы длиной ns
+    void RecordThrottleEnd(int64_t ns);
+    void RecordDeadlineTimeout();
+    void RecordIdleTimeout();
+    // Комнаты: созданные минус выселенные, и отказы создать новую
+    // или войти в еще одну сверх предела
+    void RecordRoom(int64_t delta);
+    void RecordRoomRejected();
+
+    // От чтения кадра до рассылки в strand комнаты
+    void RecordReadToBroadcast(int64_t ns);
+    // От рассылки до завершения записи кадра в сокет получателя
+    void RecordBroadcastToWrite(int64_t ns);
+
+    // Одна gather-запись в сокет из frames кадров общим размером bytes
+    void RecordFlush(std::size_t frames, std::size_t bytes);
+
+    // Решения по переполненным очередям отправки
+    void RecordOverflow();
+    void RecordDrop(std::size_t bytes);
+    void RecordSkip();
+    void RecordDisconnect();
+
+    // Федерация: связь с соседом установлена (+1) или потеряна (-1);
+    // кадры и байты, ушедшие соседям и полученные от них
+    void RecordPeerLink(int64_t delta);
+    void RecordPeerSend(std::size_t frames, std::size_t bytes);
+    void RecordPeerReceive(std::size_t frames, std::size_t bytes);
+
+    // Живые сессии: по ним старый процесс при перезапуске ждет,
+    // пока все клиенты уйдут
+    int64_t SessionsActive() const;
+
+    void Dump(std::ostream& out) const;
+
+private:
+    Metrics();
+
+    std::atomic<uint64_t> sessions_accepted_;
+    std::atomic<int64_t> sessions_active_;
+    std::atomic<uint64_t> read_bytes_;
+    std::atomic<uint64_t> frames_broadcast_;
+    std::atomic<uint64_t> frames_delivered_;
+    std::atomic<uint64_t> frames_routed_;
+    std::atomic<uint64_t> frames_unroutable_;
+    std::atomic<uint64_t> crc_errors_;
+    std::atomic<uint64_t> resyncs_;
+    std::atomic<uint64_t> resync_bytes_;
+    std::atomic<int64_t> queued_frames_;
+    std::atomic<int64_t> queued_bytes_;
+    std::atomic<uint64_t> throttled_by_session_;
+    std::atomic<uint64_t> throttled_by_room_;
+    std::atomic<int64_t> throttled_sessions_;
+    std::atomic<uint64_t> throttled_ns_;
+    std::atomic<uint64_t> deadline_timeouts_;
+    std::atomic<uint64_t> idle_timeouts_;
+    std::atomic<int64_t> rooms_active_;
+    std::atomic<uint64_t> rooms_rejected_;
+    Histogram read_to_broadcast_ns_;
+    Histogram broadcast_to_write_ns_;
+
+    std::atomic<uint64_t> write_flushes_;
+    std::atomic<uint64_t> write_frames_;
+    std::atomic<uint64_t> write_bytes_;
+    std::array<std::atomic<uint64_t>, FLUSH_BUCKETS> frames_per_flush_;
+    std::atomic<uint64_t> queue_overflows_;
+    std::atomic<uint64_t> queue_dropped_frames_;
+    std::atomic<uint64_t> queue_dropped_bytes_;
+    std::atomic<uint64_t> queue_skips_;
+    std::atomic<uint64_t> queue_disconnects_;
+    std::atomic<int64_t> peer_links_;
+    std::atomic<uint64_t> peer_frames_sent_;
+    std::atomic<uint64_t> peer_bytes_sent_;
+    std::atomic<uint64_t> peer_frames_received_;
+    std::atomic<uint64_t> peer_bytes_received_;
+};
+
+#endif // METRICS_HPP
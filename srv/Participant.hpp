@@ -3,12 +3,41 @@
 #define PARTICIPANT_HPP
 
 #include <array>
+#include <vector>
 #include "Protocol.hpp"
+#include "Frame.hpp"
+
+// Снимок участника для админ-сокета
+struct ParticipantStats {
+    const char* transport;      // "tcp", "shm"
+    std::size_t worker;
+    // Глубина очереди отправки участника
+    std::size_t queued_frames;
+    std::size_t queued_bytes;
+};
 
 class Participant {
 public:
     virtual ~Participant() {}
-    virtual void OnMessage(const std::vector<unsigned char>& msg) = 0;
+    // Номер рабочего потока (io_service пула), в котором живет участник:
+    // по нему комната раскладывает участников по шардам рассылки
+    virtual std::size_t Worker() const { return 0; }
+    // Кадр общий для всех получателей, копировать его не нужно
+    virtual void OnMessage(const SharedFrame& frame) = 0;
+    // Вызывается из чужого потока (strand комнаты): значения могут
+    // немного отставать от сессии
+    virtual ParticipantStats Stats() const {
+        return ParticipantStats{"local", Worker(), 0, 0};
+    }
+    // Перезапуск сервера (Handoff.hpp): перестать читать, дописать
+    // очередь отправки и отключиться. Можно звать из любого потока
+    virtual void Drain() {}
+    // Пачка кадров (история при входе), по умолчанию - по одному
+    virtual void OnMessages(const std::vector<SharedFrame>& frames) {
+        for (const auto& frame : frames) {
+            OnMessage(frame);
+        }
+    }
 };
 
 #endif // PARTICIPANT_HPP
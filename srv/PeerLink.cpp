@@ -0,0 +1,166 @@
+// PeerLink.cpp
+#include <cstring>
+#include "PeerLink.hpp"
+#include "Federation.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+PeerLink::PeerLink(boost::asio::io_service& io_service,
+                   boost::asio::io_service::strand& strand,
+                   Federation& federation, const std::string& address)
+    : socket_(io_service),
+      strand_(strand),
+      federation_(federation),
+      address_(address),
+      closed_(false),
+      buffer_(READ_BUFFER_SIZE),
+      buffered_(0),
+      queued_bytes_(0)
+{
+}
+
+tcp::socket& PeerLink::Socket() {
+    return socket_;
+}
+
+const std::string& PeerLink::Address() const {
+    return address_;
+}
+
+const std::string& PeerLink::Name() const {
+    return name_;
+}
+
+void PeerLink::SetName(const std::string& name) {
+    name_ = name;
+}
+
+void PeerLink::Start(const Message& hello) {
+    boost::system::error_code ignored;
+    socket_.set_option(tcp::no_delay(true), ignored);
+    Send(hello);
+    Read();
+}
+
+void PeerLink::Send(const Message& message) {
+    if (closed_) {
+        return;
+    }
+    if (queued_bytes_ + message->size() > PEER_QUEUE_MAX_BYTES) {
+        // Не сразу: Send зовут, перебирая подписчиков, которых меняет Close
+        LOG_MSG("Peer " << name_ << " does not keep up, closing link");
+        strand_.post(boost::bind(&PeerLink::Close, shared_from_this()));
+        return;
+    }
+    queue_.push_back(message);
+    queued_bytes_ += message->size();
+    Write();
+}
+
+void PeerLink::Close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    boost::system::error_code ignored;
+    socket_.shutdown(tcp::socket::shutdown_both, ignored);
+    socket_.close(ignored);
+    queue_.clear();
+    queued_bytes_ = 0;
+    federation_.OnClose(shared_from_this());
+}
+
+void PeerLink::Read() {
+    socket_.async_read_some(
+        boost::asio::buffer(buffer_.data() + buffered_, buffer_.size() - buffered_),
+        strand_.wrap(boost::bind(&PeerLink::OnRead, shared_from_this(),
+                                 boost::asio::placeholders::error,
+                                 boost::asio::placeholders::bytes_transferred)));
+}
+
+void PeerLink::OnRead(const boost::system::error_code& error, std::size_t bytes) {
+    if (closed_) {
+        return;
+    }
+    if (error) {
+        LOG_MSG("Peer " << name_ << " link lost: " << error.message());
+        Close();
+        return;
+    }
+    buffered_ += bytes;
+
+    // Соседи шлют только целые кадры v2 по надежному TCP: испорченный
+    // кадр - ошибка, которую не лечат поиском magic, а разрывом связи
+    const unsigned char* data = buffer_.data();
+    std::size_t offset = 0;
+    std::size_t frames = 0;
+    while (buffered_ - offset >= FRAME_V2_HEADER_SIZE) {
+        FrameV2Header header;
+        if (!DecodeFrameV2Header(data + offset, header)) {
+            LOG_MSG("Peer " << name_ << " sent a malformed frame, closing link");
+            Close();
+            return;
+        }
+        if (buffered_ - offset < FRAME_V2_HEADER_SIZE + header.length) {
+            break;
+        }
+        const unsigned char* payload = data + offset + FRAME_V2_HEADER_SIZE;
+        if (!CheckFrameV2Crc(data + offset, header, payload)) {
+            Metrics::Get().RecordCrcError();
+            LOG_MSG("Peer " << name_ << " frame crc mismatch, closing link");
+            Close();
+            return;
+        }
+        offset += FRAME_V2_HEADER_SIZE + header.length;
+        ++frames;
+        federation_.OnFrame(shared_from_this(), header, payload);
+        if (closed_) {
+            return;
+        }
+    }
+    Metrics::Get().RecordPeerReceive(frames, bytes);
+
+    // Начало недочитанного кадра - в начало буфера
+    if (offset > 0) {
+        std::memmove(buffer_.data(), data + offset, buffered_ - offset);
+        buffered_ -= offset;
+    }
+    Read();
+}
+
+void PeerLink::Write() {
+    if (!writing_.empty() || queue_.empty()) {
+        return;
+    }
+
+    std::size_t bytes = 0;
+    while (!queue_.empty() && writing_.size() < MAX_WRITE_BATCH_BUFFERS) {
+        writing_.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+        buffers_.push_back(boost::asio::buffer(*writing_.back()));
+        bytes += writing_.back()->size();
+    }
+    queued_bytes_ -= bytes;
+    Metrics::Get().RecordPeerSend(writing_.size(), bytes);
+
+    boost::asio::async_write(
+        socket_, buffers_,
+        strand_.wrap(boost::bind(&PeerLink::OnWrite, shared_from_this(),
+                                 boost::asio::placeholders::error,
+                                 boost::asio::placeholders::bytes_transferred)));
+}
+
+void PeerLink::OnWrite(const boost::system::error_code& error, std::size_t) {
+    // Емкость векторов сохраняется до следующей записи
+    writing_.clear();
+    buffers_.clear();
+    if (closed_) {
+        return;
+    }
+    if (error) {
+        LOG_MSG("Peer " << name_ << " write failed: " << error.message());
+        Close();
+        return;
+    }
+    Write();
+}
@@ -0,0 +1,72 @@
+// PeerLink.hpp
+#ifndef PEERLINK_HPP
+#define PEERLINK_HPP
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "FrameV2.hpp"
+#include "defs.hpp"
+
+using boost::asio::ip::tcp;
+
+class Federation;
+
+/**
+   TCP-связь с соседним узлом федерации. По ней в обе стороны идут
+   кадры v2 с op из PeerOp; первым каждая сторона шлет PEER_HELLO
+   со своим именем. Все обработчики выполняются в strand федерации,
+   поэтому и вызывать методы можно только из него.
+   Сообщение для соседа собирается один раз (Message) и стоит
+   в очереди, пока не уйдет; все накопившееся уходит одной
+   gather-записью. Очередь больше PEER_QUEUE_MAX_BYTES - признак
+   зависшего соседа: связь закрывается и переустанавливается.
+*/
+class PeerLink : public std::enable_shared_from_this<PeerLink> {
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char>> Message;
+
+    // address - куда подключается этот узел, пусто у входящих связей
+    PeerLink(boost::asio::io_service& io_service,
+             boost::asio::io_service::strand& strand,
+             Federation& federation, const std::string& address);
+
+    tcp::socket& Socket();
+    const std::string& Address() const;
+    // Имя соседа из его PEER_HELLO, до него пусто
+    const std::string& Name() const;
+    void SetName(const std::string& name);
+
+    // Соединение установлено: отправить hello и начать чтение
+    void Start(const Message& hello);
+    void Send(const Message& message);
+    void Close();
+
+private:
+    void Read();
+    void OnRead(const boost::system::error_code& error, std::size_t bytes);
+    void Write();
+    void OnWrite(const boost::system::error_code& error, std::size_t bytes);
+
+    tcp::socket socket_;
+    boost::asio::io_service::strand& strand_;
+    Federation& federation_;
+    std::string address_;
+    std::string name_;
+    bool closed_;
+
+    // Прочитанные байты, в начале буфера - начало очередного кадра
+    std::vector<unsigned char> buffer_;
+    std::size_t buffered_;
+
+    std::deque<Message> queue_;
+    std::size_t queued_bytes_;
+    // Сообщения текущей записи и их буферы
+    std::vector<Message> writing_;
+    std::vector<boost::asio::const_buffer> buffers_;
+};
+
+#endif // PEERLINK_HPP
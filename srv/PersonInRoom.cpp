@@ -1,26 +1,99 @@
+#include <cstring>
 #include "PersonInRoom.hpp"
 
-PersonInRoom::PersonInRoom(boost::asio::io_service& io_service,
-                           boost::asio::io_service::strand& strand, ChatRoom& room)
+PersonInRoom::PersonInRoom(boost::asio::io_service& io_service, RoomRegistry& registry)
     : socket_(io_service),
-      strand_(strand),
-      room_(room),
-      read_msg_(2),
-      deadline_(io_service)
+      strand_(io_service),
+      registry_(registry),
+      worker_(registry.Pool().IndexOf(io_service)),
+      wire_format_(WireLegacy),
+      has_fingerprint_(false),
+      started_(false),
+      pending_(nullptr),
+      pending_size_(0),
+      wheel_(boost::asio::use_service<TimingWheel>(io_service)),
+      read_deadline_(false),
+      room_wait_(0),
+      paused_at_(0),
+      join_pending_(false),
+      draining_(false)
 {
-    // начинаем с буфера размером 2 байта для заголовка
-    // и неустановленного таймера
-    deadline_.expires_at(boost::asio::steady_timer::time_point::max());
+    // начинаем с пустого буфера приема и без тайм-аутов
+    deferred_.session = this;
 }
 
-void PersonInRoom::CheckDeadline() {
-    if (deadline_.expiry() <= boost::asio::steady_timer::clock_type::now()) {
-        // Тайм-аут произошел, закрываем соединение
-        socket_.close();
-        deadline_.expires_at(boost::asio::steady_timer::time_point::max());
+std::shared_ptr<PersonInRoom> PersonInRoom::Create(
+    boost::asio::io_service& io_service, RoomRegistry& registry)
+{
+    // Слэб живет до конца процесса: сессии могут пережить main
+    static SessionSlab* slab = new SessionSlab(SESSION_SLAB_CHUNK);
+    return std::allocate_shared<PersonInRoom>(
+        SlabAllocator<PersonInRoom>(*slab), io_service, registry);
+}
+
+PersonInRoom::~PersonInRoom() {
+    if (pending_) {
+        FramePool::Free(pending_, READ_PENDING_CAPACITY);
+    }
+    if (started_) {
+        Metrics::Get().RecordSessionEnd();
+    }
+}
+
+void PersonInRoom::UpdateTimeout(bool consumed) {
+    Config& config = Config::Get();
+
+    if (pending_size_ > 0) {
+        // Срок на остаток кадра отсчитывается от начала этого кадра
+        if (consumed || !read_deadline_ || !Armed()) {
+            read_deadline_ = true;
+            wheel_.Schedule(*this, shared_from_this(), std::chrono::seconds(
+                config.read_timeout.load(std::memory_order_relaxed)));
+        }
+        return;
+    }
+
+    read_deadline_ = false;
+    std::size_t idle = config.idle_timeout.load(std::memory_order_relaxed);
+    if (idle > 0) {
+        wheel_.Schedule(*this, shared_from_this(), std::chrono::seconds(idle));
+    } else {
+        wheel_.Cancel(*this);
     }
+}
+
+void PersonInRoom::OnTimer() {
+    // Колесо и strand сессии работают в одном потоке io_service,
+    // поэтому состояние сессии здесь можно трогать напрямую
+    if (!socket_.is_open()) {
+        return;
+    }
+
+    // Тайм-аут произошел, закрываем соединение
+    if (read_deadline_) {
+        Metrics::Get().RecordDeadlineTimeout();
+    } else {
+        LOG_MSG("Idle participant disconnected");
+        Metrics::Get().RecordIdleTimeout();
+    }
+    Close();
+}
+
+const char* PersonInRoom::Engine() {
+#ifdef SESSION_COROUTINES
+    return "coroutines";
+#else
+    return "callbacks";
+#endif
+}
+
+std::size_t PersonInRoom::Worker() const {
+    return worker_;
+}
 
-    deadline_.async_wait(boost::bind(&PersonInRoom::CheckDeadline, shared_from_this()));
+ParticipantStats PersonInRoom::Stats() const {
+    return ParticipantStats{"tcp", worker_, send_queue_.SnapshotFrames(),
+                            send_queue_.SnapshotBytes()};
 }
 
 tcp::socket& PersonInRoom::Socket() {
@@ -28,125 +101,676 @@ tcp::socket& PersonInRoom::Socket() {
 }
 
 void PersonInRoom::Start() {
+    // Start вызывается из потока акцептора, дальше работаем в strand сессии
+    started_ = true;
+    Metrics::Get().RecordAccept();
+    strand_.dispatch(boost::bind(&PersonInRoom::StartImpl, shared_from_this()));
+}
+
+void PersonInRoom::StartImpl() {
     LOG_ERR("Participant starting");
 
     // Запускаем проверку тайм-аутов после создания объекта
-    CheckDeadline();
+    UpdateTimeout(false);
+
+    // Данные читаются сами, без ожидающего async_read с буфером:
+    // сессия ждет только готовности сокета к чтению
+    boost::system::error_code ignored;
+    socket_.non_blocking(true, ignored);
+#ifdef SESSION_COROUTINES
+    boost::asio::co_spawn(strand_, WriteLoop(shared_from_this()),
+                          boost::asio::detached);
+#endif
+    WaitRead();
+    LOG_ERR("async_wait initiated");
+
+    // Каждое соединение попадает в комнату по умолчанию, но не сразу:
+    // вошедшему отдается история, а переподключившемуся клиенту нужна
+    // только пропущенная ее часть - он сообщит ее первым кадром
+    join_pending_ = true;
+    wheel_.Schedule(deferred_, shared_from_this(),
+                    std::chrono::milliseconds(DEFAULT_ROOM_JOIN_DELAY_MS));
+}
+
+void PersonInRoom::JoinDefaultRoom() {
+    join_pending_ = false;
+    if (paused_at_ == 0) {
+        wheel_.Cancel(deferred_);
+    }
+    JoinRoom(DEFAULT_ROOM);
+}
+
+void PersonInRoom::OnDeferred() {
+    // Как и OnTimer, вызывается в потоке io_service сессии
+    if (join_pending_ && socket_.is_open()) {
+        JoinDefaultRoom();
+    }
+    if (paused_at_ != 0) {
+        ResumeReads();
+    }
+}
+
+void PersonInRoom::WaitRead() {
+#ifdef SESSION_COROUTINES
+    boost::asio::co_spawn(strand_, ReadLoop(shared_from_this()),
+                          boost::asio::detached);
+#else
+    // Молчащее соединение держит только операцию ожидания, без буфера
+    socket_.async_wait(
+        tcp::socket::wait_read,
+        strand_.wrap(MakeAllocHandler(
+            read_memory_,
+            boost::bind(&PersonInRoom::ReadHandler, shared_from_this(), _1))));
+#endif
+}
+
+// Общий буфер приема потока: сессии одного io_service читают в него
+// по очереди, кадры разбираются и рассылаются до следующего чтения
+static unsigned char* ScratchBuffer() {
+    static thread_local std::vector<unsigned char> scratch(READ_BUFFER_SIZE);
+    return scratch.data();
+}
+
+void PersonInRoom::Drain() {
+    strand_.post(boost::bind(&PersonInRoom::DrainImpl, shared_from_this()));
+}
+
+void PersonInRoom::DrainImpl() {
+    if (draining_ || !socket_.is_open()) {
+        return;
+    }
+    draining_ = true;
+    join_pending_ = false;
+    LOG_ERR("Participant draining");
+
+    // Кадры, уже разосланные сессии, тоже уходят клиенту
+    DeliverImpl();
+    for (auto& room : rooms_) {
+        room.second->Leave(shared_from_this());
+        registry_.Release(room.second);
+    }
+    rooms_.clear();
+    // Иначе идет запись, ее завершение и закроет сессию
+    if (send_queue_.Empty() && socket_.is_open()) {
+        CloseDrained();
+    }
+}
+
+void PersonInRoom::CloseDrained() {
+    // Непрочитанные данные при close превращаются в RST, и клиент может
+    // потерять хвост очереди: выбираем их и закрываем соединение с FIN
+    boost::system::error_code error;
+    do {
+        socket_.read_some(boost::asio::buffer(ScratchBuffer(), READ_BUFFER_SIZE), error);
+    } while (!error);
+    socket_.shutdown(tcp::socket::shutdown_send, error);
+    Close();
+}
+
+void PersonInRoom::OnMessage(const SharedFrame& frame) {
+    // Вызывается из strand комнаты, очередь записи трогаем только в своем strand
+    Deliver(&frame, &frame + 1);
+}
+
+void PersonInRoom::OnMessages(const std::vector<SharedFrame>& frames) {
+    Deliver(frames.begin(), frames.end());
+}
+
+template <typename Iterator>
+void PersonInRoom::Deliver(Iterator begin, Iterator end) {
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        schedule = inbox_.empty();
+        inbox_.insert(inbox_.end(), begin, end);
+    }
+
+    // DeliverImpl уже запланирован и заберет эти кадры вместе с прочими
+    if (schedule) {
+        strand_.post(MakeAllocHandler(
+            deliver_memory_,
+            boost::bind(&PersonInRoom::DeliverImpl, shared_from_this())));
+    }
+}
+
+void PersonInRoom::DeliverImpl() {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        inbox_.swap(delivering_);
+    }
+
+    // Сначала вся пачка в очередь, потом одна запись
+    bool need_flush = false;
+    for (const auto& frame : delivering_) {
+        need_flush = Enqueue(frame) || need_flush;
+    }
+    // Емкость векторов сохраняется, память больше не выделяется
+    delivering_.clear();
+
+    if (need_flush) {
+        LOG_ERR("Starting async_write");
+        Flush();
+    }
+}
+
+bool PersonInRoom::Enqueue(const SharedFrame& frame) {
+    if (!socket_.is_open()) {
+        // Сессия уже отключена, комната еще не обработала Leave
+        return false;
+    }
 
-    // читаем сначала 2 байта заголовка
-    boost::asio::async_read(
+    LOG_ERR("Adding message to queue");
+    switch (send_queue_.Push(frame)) {
+    case SendQueue::StartWrite:
+        return true;
+    case SendQueue::Queued:
+        return false;
+    case SendQueue::Overflow:
+        // Участник не успевает читать, отключаем его
+        LOG_MSG("Slow consumer disconnected, queued: "
+                << send_queue_.Frames() << " frames, "
+                << send_queue_.Bytes() << " bytes");
+        Close();
+        return false;
+    }
+    return false;
+}
+
+void PersonInRoom::Close() {
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+#ifdef SESSION_COROUTINES
+    // Пишущая сопрограмма увидит закрытый сокет и завершится. Будим ее
+    // через очередь strand: Close зовут и из самой сопрограммы чтения
+    if (write_waiter_) {
+        boost::asio::post(strand_, std::move(*write_waiter_));
+        write_waiter_.reset();
+    }
+#endif
+    wheel_.Cancel(*this);
+    wheel_.Cancel(deferred_);
+    if (paused_at_ != 0) {
+        Metrics::Get().RecordThrottleEnd(Metrics::NowNs() - paused_at_);
+        paused_at_ = 0;
+    }
+
+    for (auto& room : rooms_) {
+        room.second->Leave(shared_from_this());
+        registry_.Release(room.second);
+    }
+    rooms_.clear();
+}
+
+#ifdef SESSION_COROUTINES
+// Цепочки чтения и записи - две сопрограммы в strand сессии на все
+// время ее жизни: кадр каждой выделяется один раз, а не на каждую
+// запись. Пишущая сопрограмма на пустой очереди засыпает, отдавая
+// свой обработчик продолжения в write_waiter_
+
+void PersonInRoom::Flush() {
+    if (write_waiter_) {
+        WriteWaiter waiter(std::move(*write_waiter_));
+        write_waiter_.reset();
+        // Мы уже в strand сессии: сопрограмма продолжается прямо здесь,
+        // без лишнего прохода через очередь io_service
+        waiter();
+    }
+}
+
+boost::asio::awaitable<void, PersonInRoom::Strand>
+PersonInRoom::ReadLoop(std::shared_ptr<PersonInRoom> self) {
+    boost::system::error_code error;
+    do {
+        // Молчащее соединение держит только кадр сопрограммы, без буфера
+        co_await socket_.async_wait(
+            tcp::socket::wait_read,
+            boost::asio::redirect_error(boost::asio::use_awaitable_t<Strand>(), error));
+        if (error) {
+            LOG_MSG("ERR, PersonInRoom::ReadLoop leaving: " << error);
+            Close();
+            co_return;
+        }
+    } while (ReadAvailable());
+}
+
+boost::asio::awaitable<void, PersonInRoom::Strand>
+PersonInRoom::WriteLoop(std::shared_ptr<PersonInRoom> self) {
+    boost::system::error_code error;
+    while (socket_.is_open()) {
+        if (send_queue_.Empty()) {
+            // Спим до Flush или Close
+            boost::asio::use_awaitable_t<Strand> token;
+            co_await boost::asio::async_initiate<decltype(token), void()>(
+                [this](WriteWaiter&& waiter) { write_waiter_.emplace(std::move(waiter)); },
+                token);
+            continue;
+        }
+
+        // Все, что накопилось в очереди, уходит одной gather-записью.
+        // Операция записи, как и в сборке на обработчиках, лежит
+        // в write_memory_: общий кеш потока asio хранит один блок,
+        // и при рассылке пачке сессий его не хватает
+        auto token = boost::asio::redirect_error(
+            boost::asio::use_awaitable_t<Strand>(), error);
+        co_await boost::asio::async_initiate<decltype(token),
+                                             void(boost::system::error_code, std::size_t)>(
+            [this](auto&& handler, ConstBufferSpan buffers) {
+                boost::asio::async_write(
+                    socket_, buffers,
+                    boost::asio::bind_executor(
+                        strand_, MakeAllocHandler(write_memory_, std::move(handler))));
+            },
+            token, send_queue_.PrepareBatch());
+        if (error) {
+            LOG_ERR("Error writing message: " << error.message());
+            Close();
+            co_return;
+        }
+        LOG_ERR("Message written successfully");
+        send_queue_.ConsumeBatch();
+        if (draining_ && send_queue_.Empty()) {
+            CloseDrained();
+            co_return;
+        }
+    }
+}
+#else
+void PersonInRoom::Flush() {
+    // Все, что накопилось в очереди, уходит одной gather-записью
+    boost::asio::async_write(
         socket_,
-        boost::asio::buffer(read_msg_.data(), 2),
-        strand_.wrap(boost::bind(&PersonInRoom::HeaderHandler,
-                                 shared_from_this(), _1)));
-    LOG_ERR("async_read initiated");
-    room_.Enter(shared_from_this(), "ParticipantNickname"); // TODO: nickname
+        send_queue_.PrepareBatch(),
+        strand_.wrap(MakeAllocHandler(
+            write_memory_,
+            boost::bind(&PersonInRoom::WriteHandler, shared_from_this(), _1))));
 }
+#endif
 
-void PersonInRoom::HeaderHandler(const boost::system::error_code& error) {
-    if (!error) {
-        uint16_t msg_length =
-            (static_cast<uint16_t>(read_msg_[1]) << 8) |
-            static_cast<uint16_t>(read_msg_[0]);
+#ifndef SESSION_COROUTINES
+void PersonInRoom::ReadHandler(const boost::system::error_code& error) {
+    if (error) {
+        LOG_MSG("ERR, PersonInRoom::ReadHandler leaving: " << error);
+        Close();
+        return;
+    }
+
+    if (ReadAvailable()) {
+        // снова ждем данных
+        WaitRead();
+    }
+}
+#endif
+
+bool PersonInRoom::ReadAvailable() {
+    // Сессия, не состоящая ни в одной комнате, узнает о перезапуске здесь
+    if (draining_ || registry_.Draining()) {
+        DrainImpl();
+        return false;
+    }
+
+    // Пока не дочитан начатый кадр, читаем в буфер сессии вслед за ним,
+    // иначе - в общий буфер потока
+    unsigned char* data;
+    std::size_t capacity;
+    std::size_t size;
+    if (pending_) {
+        data = pending_;
+        capacity = READ_PENDING_CAPACITY;
+        size = pending_size_;
+    } else {
+        data = ScratchBuffer();
+        capacity = READ_BUFFER_SIZE;
+        size = 0;
+    }
 
-        LOG_ERR("msg_length: " << msg_length);
+    // Читаем сколько есть, одним вызовом: у конвейерного клиента
+    // за раз приходит сразу много кадров
+    boost::system::error_code read_error;
+    std::size_t bytes_readed = socket_.read_some(
+        boost::asio::buffer(data + size, capacity - size), read_error);
+    if (read_error == boost::asio::error::would_block) {
+        return true;
+    }
+    if (read_error) {
+        LOG_MSG("ERR, PersonInRoom::ReadHandler leaving: " << read_error);
+        Close();
+        return false;
+    }
+
+    Metrics::Get().RecordRead(bytes_readed);
+    size += bytes_readed;
+
+    std::size_t frames = 0;
+    std::size_t parsed = 0;
+    room_wait_ = 0;
+    if (!ParseFrames(data, size, parsed, frames)) {
+        return false;
+    }
+    KeepPending(data + parsed, size - parsed);
+    if (join_pending_ && frames > 0) {
+        JoinDefaultRoom();
+    }
+
+    // Прочитанное уже разослано, ведра уходят в долг; пока он
+    // не погашен, сессия не читает
+    int64_t session_wait = ChargeSession(frames, bytes_readed);
+    if (session_wait > 0 || room_wait_ > 0) {
+        PauseReads(session_wait, room_wait_);
+        return false;
+    }
+    UpdateTimeout(frames > 0);
+    return true;
+}
+
+int64_t PersonInRoom::ChargeSession(std::size_t frames, std::size_t bytes) {
+    Config& config = Config::Get();
+    std::size_t frame_rate = config.session_frames_per_sec.load(std::memory_order_relaxed);
+    std::size_t byte_rate = config.session_bytes_per_sec.load(std::memory_order_relaxed);
+    if (frame_rate == 0 && byte_rate == 0) {
+        return 0;
+    }
+
+    int64_t now = Metrics::NowNs();
+    return std::max(ingress_frames_.Take(frames, frame_rate, now),
+                    ingress_bytes_.Take(bytes, byte_rate, now));
+}
+
+void PersonInRoom::ChargeRoom(ChatRoom& room, std::size_t size) {
+    room_wait_ = std::max(room_wait_, room.ChargeIngress(size));
+}
+
+void PersonInRoom::PauseReads(int64_t session_wait, int64_t room_wait) {
+    Metrics::Get().RecordThrottle(session_wait > 0, room_wait > 0);
+    paused_at_ = Metrics::NowNs();
+
+    // Пауза назначена сервером, тайм-ауты клиента на нее не идут
+    wheel_.Cancel(*this);
+    int64_t wait = std::max(session_wait, room_wait);
+    wheel_.Schedule(deferred_, shared_from_this(),
+                    std::chrono::milliseconds((wait + 999999) / 1000000));
+}
+
+void PersonInRoom::ResumeReads() {
+    Metrics::Get().RecordThrottleEnd(Metrics::NowNs() - paused_at_);
+    paused_at_ = 0;
+    if (!socket_.is_open()) {
+        return;
+    }
+    UpdateTimeout(true);
+    WaitRead();
+}
+
+bool PersonInRoom::ParseFrames(const unsigned char* data, std::size_t size,
+                               std::size_t& parsed, std::size_t& frames)
+{
+    while (size - parsed >= 2) {
+        const unsigned char* frame = data + parsed;
+
+        if (IsFrameV2(frame)) {
+            if (size - parsed < FRAME_V2_HEADER_SIZE) {
+                break;
+            }
+            FrameV2Header header;
+            if (!DecodeFrameV2Header(frame, header)) {
+                parsed += Resync(frame, data + size);
+                continue;
+            }
+            if (size - parsed < FRAME_V2_HEADER_SIZE + header.length) {
+                break;
+            }
+            const unsigned char* payload = frame + FRAME_V2_HEADER_SIZE;
+            if (!CheckFrameV2Crc(frame, header, payload)) {
+                LOG_ERR("Frame v2 crc mismatch, room " << header.room);
+                Metrics::Get().RecordCrcError();
+                parsed += Resync(frame, data + size);
+                continue;
+            }
+            SetWireFormat(WireV2);
+            HandleRoomOp(header.op, header.room, payload, header.length, false);
+            parsed += FRAME_V2_HEADER_SIZE + header.length;
+            ++frames;
+            continue;
+        }
+
+        // Между кадрами v2 ничего быть не может: это мусор или
+        // поврежденный заголовок, ищем следующий кадр
+        if (wire_format_ == WireV2) {
+            parsed += Resync(frame, data + size);
+            continue;
+        }
+
+        uint16_t header =
+            (static_cast<uint16_t>(frame[1]) << 8) |
+            static_cast<uint16_t>(frame[0]);
+        uint16_t msg_length = header & FRAME_LENGTH_MASK;
+        bool room_frame = (header & ROOM_FRAME_FLAG) != 0;
 
         if (msg_length > MAX_PACK_SIZE) {
             LOG_ERR("Error: Message length exceeds maximum allowed size: "
                     << msg_length);
-            room_.Leave(shared_from_this());
-            return;
+            Close();
+            return false;
         }
 
-        read_msg_.resize(msg_length);
+        // У кадра с комнатой перед payload идут op и номер комнаты
+        std::size_t body_length =
+            msg_length + (room_frame ? ROOM_FIELDS_SIZE : 0);
+        if (size - parsed < 2 + body_length) {
+            break;
+        }
 
-        // Установим тайм-аут для чтения тела сообщения
-        deadline_.expires_after(std::chrono::seconds(READ_TIMEOUT));
+        // Кадр разбирается прямо в буфере приема: Broadcast собирает
+        // из него общий кадр синхронно, буфер можно переиспользовать
+        HandleFrame(room_frame, frame + 2, body_length);
+        parsed += 2 + body_length;
+        ++frames;
+    }
 
-        // Асинхронно читаем само сообщение
-        // _1 будет заменён на объект boost::system::error_code,
-        //     который предоставляет информацию об ошибке (или её отсутствии).
-        // _2 будет заменён на размер данных (тип std::size_t),
-        //     указывающий, сколько байт было успешно прочитано.
-        boost::asio::async_read(
-            socket_,
-            boost::asio::buffer(read_msg_.data(), msg_length),
-            strand_.wrap(boost::bind(&PersonInRoom::ReadHandler,
-                                     shared_from_this(), _1, _2)));
-    } else {
-		LOG_MSG("PersonInRoom::HEaderHandler LEaving");
-        room_.Leave(shared_from_this());
+    return socket_.is_open();
+}
+
+std::size_t PersonInRoom::Resync(const unsigned char* frame, const unsigned char* end) {
+    std::size_t skipped = FindFrameV2(frame + 1, end) - frame;
+    Metrics::Get().RecordResync(skipped);
+    return skipped;
+}
+
+void PersonInRoom::SetWireFormat(WireFormat format) {
+    if (wire_format_ != format) {
+        wire_format_ = format;
+        send_queue_.SetWireFormat(format);
     }
 }
 
-void PersonInRoom::OnMessage(const std::vector<unsigned char>& msg) {
-    LOG_ERR("Adding message to queue");
-    bool write_in_progress = !write_msgs_.empty();
-    write_msgs_.push_back(msg);
-    LOG_ERR("Added message to write queue, size: " << msg.size());
-    if (!write_in_progress) {
-        LOG_ERR("Starting async_write");
-        boost::asio::async_write(
-            socket_,
-            boost::asio::buffer(write_msgs_.front().data(),
-                                write_msgs_.front().size()),
-            strand_.wrap(boost::bind(&PersonInRoom::WriteHandler,
-                                     shared_from_this(), _1)));
+void PersonInRoom::KeepPending(const unsigned char* rest, std::size_t size) {
+    if (size == 0) {
+        // Все кадры целые, буфер сессии больше не нужен
+        if (pending_) {
+            FramePool::Free(pending_, READ_PENDING_CAPACITY);
+            pending_ = nullptr;
+        }
+        pending_size_ = 0;
+        return;
+    }
+
+    // Начало кадра переносится в буфер сессии (или в его начало)
+    if (!pending_) {
+        pending_ = static_cast<unsigned char*>(
+            FramePool::Allocate(READ_PENDING_CAPACITY));
+    }
+    std::memmove(pending_, rest, size);
+    pending_size_ = size;
+}
+
+// Кадр v1 закрыт синхромаркером: длина в заголовке учитывает его
+static bool EndsWithSyncMarker(const unsigned char* payload, std::size_t size) {
+    if (size < SYNC_MARKER_SIZE) {
+        return false;
+    }
+    const unsigned char* marker = payload + size - SYNC_MARKER_SIZE;
+    for (std::size_t i = 0; i < SYNC_MARKER_SIZE; ++i) {
+        if (marker[i] != 0) {
+            return false;
+        }
     }
+    return true;
 }
 
-void PersonInRoom::ReadHandler(
-    const boost::system::error_code& error
-    , size_t bytes_readed
-    )
+void PersonInRoom::HandleFrame(bool room_frame, const unsigned char* body,
+                               std::size_t body_length)
 {
-    if (!error) {
-        std::vector<unsigned char> received_msg(read_msg_.begin(), read_msg_.end());
-
-        // Debug print
-        uint16_t received_msg_size = received_msg.size();
-        LOG_HEX("Received message size in hex", received_msg_size, 2);
-        LOG_VEC("Received message", received_msg);
-
-        // Отмена таймера после успешного чтения
-        deadline_.expires_at(boost::asio::steady_timer::time_point::max());
-
-        room_.Broadcast(received_msg, shared_from_this());
-
-        // готовим буфер для чтения следующего заголовка
-        read_msg_.resize(2);
-        // снова читаем заголовок
-        boost::asio::async_read(
-            socket_,
-            boost::asio::buffer(read_msg_.data(), 2),
-            strand_.wrap(boost::bind(&PersonInRoom::HeaderHandler,
-                                     shared_from_this(), _1)));
-    } else {
-		LOG_MSG("ERR, PersonInRoom::ReadHandler LEaving: " <<
-			error);
-        room_.Leave(shared_from_this());
+    LOG_ERR("msg_length: " << body_length);
+    LOG_BYTES("Received message", body, body_length);
+
+    uint8_t op = ROOM_MSG;
+    uint32_t room_id = DEFAULT_ROOM;
+    const unsigned char* payload = body;
+    std::size_t size = body_length;
+    if (room_frame) {
+        if (wire_format_ == WireLegacy) {
+            SetWireFormat(WireRoom);
+        }
+        op = body[0];
+        room_id = 0;
+        for (std::size_t i = 0; i < 4; ++i) {
+            room_id |= static_cast<uint32_t>(body[1 + i]) << (i * 8);
+        }
+        payload += ROOM_FIELDS_SIZE;
+        size -= ROOM_FIELDS_SIZE;
+    }
+
+    // Синхромаркер - часть формата v1, а не сообщения: он снимается,
+    // а кадр запоминает, что маркер был. Старые клиенты шлют и без него
+    bool sync_marker = EndsWithSyncMarker(payload, size);
+    if (sync_marker) {
+        size -= SYNC_MARKER_SIZE;
+    }
+    HandleRoomOp(op, room_id, payload, size, sync_marker);
+}
+
+void PersonInRoom::HandleRoomOp(uint8_t op, uint32_t room_id,
+                                const unsigned char* payload, std::size_t size,
+                                bool sync_marker)
+{
+    switch (op) {
+    case ROOM_MSG: {
+        // Сообщение в комнату, в которой нас еще нет, - сначала входим
+        std::shared_ptr<ChatRoom> room = JoinRoom(room_id);
+        if (!room) {
+            break;
+        }
+        ChargeRoom(*room, size);
+        room->Broadcast(payload, size, sync_marker);
+        break;
+    }
+    case ROOM_JOIN:
+        JoinRoom(room_id);
+        break;
+    case ROOM_LEAVE:
+        LeaveRoom(room_id);
+        break;
+    case ROOM_HELLO:
+        // Отпечаток регистрируется один раз, во всех комнатах сессии
+        if (size != FINGERPRINT_SIZE || has_fingerprint_) {
+            LOG_ERR("Bad hello, payload size: " << size);
+            break;
+        }
+        std::copy(payload, payload + FINGERPRINT_SIZE, fingerprint_.begin());
+        has_fingerprint_ = true;
+        for (auto& room : rooms_) {
+            room.second->Register(shared_from_this(), fingerprint_);
+        }
+        break;
+    case ROOM_ROUTED: {
+        if (size < FINGERPRINT_SIZE) {
+            LOG_ERR("Routed frame without recipient, size: " << size);
+            break;
+        }
+        Fingerprint recipient;
+        std::copy(payload, payload + FINGERPRINT_SIZE, recipient.begin());
+        std::shared_ptr<ChatRoom> room = JoinRoom(room_id);
+        if (!room) {
+            break;
+        }
+        ChargeRoom(*room, size);
+        room->Route(recipient, payload + FINGERPRINT_SIZE, size - FINGERPRINT_SIZE,
+                    sync_marker);
+        break;
+    }
+    case ROOM_RESUME: {
+        if (size != FRAME_SEQ_SIZE) {
+            LOG_ERR("Bad resume, payload size: " << size);
+            break;
+        }
+        uint64_t last_seq = 0;
+        for (std::size_t i = 0; i < FRAME_SEQ_SIZE; ++i) {
+            last_seq |= static_cast<uint64_t>(payload[i]) << (i * 8);
+        }
+        JoinRoom(room_id, last_seq);
+        break;
+    }
+    default:
+        LOG_ERR("Unknown room op: " << static_cast<int>(op));
+        break;
+    }
+}
+
+std::shared_ptr<ChatRoom> PersonInRoom::JoinRoom(uint32_t room_id, uint64_t last_seq) {
+    auto it = rooms_.find(room_id);
+    if (it != rooms_.end()) {
+        // Уже в комнате: повторный вход лишь дополучает пропущенное
+        if (last_seq != 0) {
+            it->second->Enter(shared_from_this(), "ParticipantNickname", last_seq);
+        }
+        return it->second;
+    }
+
+    // Комнаты создаются по запросу клиента, поэтому их число ограничено
+    if (rooms_.size() >= Config::Get().session_rooms_max.load(std::memory_order_relaxed)) {
+        LOG_ERR("Session is in too many rooms, join to " << room_id << " refused");
+        Metrics::Get().RecordRoomRejected();
+        return nullptr;
+    }
+    std::shared_ptr<ChatRoom> room = registry_.Get(room_id);
+    if (!room) {
+        return nullptr;
+    }
+    rooms_[room_id] = room;
+    room->Enter(shared_from_this(), "ParticipantNickname", last_seq); // TODO: nickname
+    if (has_fingerprint_) {
+        room->Register(shared_from_this(), fingerprint_);
+    }
+    return room;
+}
+
+void PersonInRoom::LeaveRoom(uint32_t room_id) {
+    auto it = rooms_.find(room_id);
+    if (it != rooms_.end()) {
+        it->second->Leave(shared_from_this());
+        registry_.Release(it->second);
+        rooms_.erase(it);
     }
 }
 
+#ifndef SESSION_COROUTINES
 void PersonInRoom::WriteHandler(const boost::system::error_code& error) {
     if (!error) {
         LOG_ERR("Message written successfully");
 
-        write_msgs_.pop_front();
+        send_queue_.ConsumeBatch();
 
-        if (!write_msgs_.empty()) {
-            boost::asio::async_write(
-                socket_,
-                boost::asio::buffer(write_msgs_.front().data(),
-                                    write_msgs_.front().size()),
-                strand_.wrap(boost::bind(&PersonInRoom::WriteHandler,
-                                         shared_from_this(), _1)));
+        // Пока шла запись, могли прийти новые кадры
+        if (!send_queue_.Empty()) {
+            Flush();
+        } else if (draining_) {
+            CloseDrained();
         }
     } else {
-        LOG_ERR("Message written successfully: " << error.message());
-        room_.Leave(shared_from_this());
+        LOG_ERR("Error writing message: " << error.message());
+        Close();
     }
 }
+#endif
 
 // void PersonInRoom::NicknameHandler(const boost::system::error_code& error) {
 //     if (!error) {
@@ -2,37 +2,193 @@
 #ifndef PERSONINROOM_HPP
 #define PERSONINROOM_HPP
 
-#include <deque>
 #include <array>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#ifdef SESSION_COROUTINES
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#endif
 #include <algorithm>
 #include "ChatRoom.hpp"
+#include "RoomRegistry.hpp"
+#include "SendQueue.hpp"
+#include "HandlerAllocator.hpp"
+#include "SessionSlab.hpp"
+#include "TimingWheel.hpp"
+#include "TokenBucket.hpp"
 
 using boost::asio::ip::tcp;
 
-class PersonInRoom : public Participant, public std::enable_shared_from_this<PersonInRoom>
+class PersonInRoom : public Participant, public TimerEntry,
+                     public std::enable_shared_from_this<PersonInRoom>
 {
 public:
-    PersonInRoom(boost::asio::io_service& io_service,
-                 boost::asio::io_service::strand& strand, ChatRoom& room);
+    PersonInRoom(boost::asio::io_service& io_service, RoomRegistry& registry);
+    ~PersonInRoom();
+    // Сессия из общего слэба сессий
+    static std::shared_ptr<PersonInRoom> Create(boost::asio::io_service& io_service,
+                                                RoomRegistry& registry);
     tcp::socket& Socket();
     void Start();
-    void OnMessage(const std::vector<unsigned char>& msg);
+    void OnMessage(const SharedFrame& frame);
+    void OnMessages(const std::vector<SharedFrame>& frames);
+    std::size_t Worker() const override;
+    ParticipantStats Stats() const override;
+    void Drain() override;
+
+    // Как выполняются цепочки чтения и записи: "callbacks" или "coroutines"
+    static const char* Engine();
 
 private:
-    void HeaderHandler(const boost::system::error_code& error);
-    void ReadHandler(const boost::system::error_code& error, size_t bytes_readed);
+    void StartImpl();
+    // Ждет готовности сокета к чтению и читает, пока ReadAvailable
+    // не скажет остановиться
+    void WaitRead();
+    // Читает все, что есть в сокете, и разбирает кадры. false - сессия
+    // закрыта или чтение приостановлено, ждать данных не нужно
+    bool ReadAvailable();
+#ifdef SESSION_COROUTINES
+    // Сборка make COROUTINES=1: те же цепочки чтения и записи,
+    // но сопрограммами C++20 в strand сессии, а не обработчиками
+    typedef boost::asio::io_service::strand Strand;
+    boost::asio::awaitable<void, Strand> ReadLoop(std::shared_ptr<PersonInRoom> self);
+    boost::asio::awaitable<void, Strand> WriteLoop(std::shared_ptr<PersonInRoom> self);
+    // Продолжение уснувшей пишущей сопрограммы
+    typedef boost::asio::async_result<boost::asio::use_awaitable_t<Strand>,
+                                      void()>::handler_type WriteWaiter;
+#else
+    void ReadHandler(const boost::system::error_code& error);
     void WriteHandler(const boost::system::error_code& error);
-    void CheckDeadline();
+#endif
+    // Разбирает все целые кадры из data, parsed - сколько байт разобрано,
+    // frames - сколько кадров; false - сессия закрыта
+    bool ParseFrames(const unsigned char* data, std::size_t size,
+                     std::size_t& parsed, std::size_t& frames);
+    // Списывает прочитанное из ведер сессии, возвращает, сколько
+    // наносекунд не читать дальше
+    int64_t ChargeSession(std::size_t frames, std::size_t bytes);
+    // Списывает кадр из ведер комнаты, запоминает самую долгую паузу
+    void ChargeRoom(ChatRoom& room, std::size_t size);
+    // Пауза чтения, пока не погашен долг ведер: данные остаются
+    // в сокете, и TCP сам притормаживает клиента
+    void PauseReads(int64_t session_wait, int64_t room_wait);
+    void ResumeReads();
+    // Вход в комнату по умолчанию, отложенный до первого кадра клиента
+    void JoinDefaultRoom();
+    // Срабатывание второго элемента колеса
+    void OnDeferred();
+    // Пропускает поврежденный кадр v2 или мусор с frame до следующего
+    // magic, возвращает число пропущенных байт
+    std::size_t Resync(const unsigned char* frame, const unsigned char* end);
+    // Сессия отвечает кадрами того формата, в котором пишет клиент
+    void SetWireFormat(WireFormat format);
+    // Сохраняет начало неполного кадра до следующего чтения
+    void KeepPending(const unsigned char* rest, std::size_t size);
+    // Взводит тайм-аут чтения, пока висит неполный кадр, иначе тайм-аут
+    // бездействия; consumed - из буфера только что разобраны кадры
+    void UpdateTimeout(bool consumed);
+    void OnTimer() override;
+    void HandleFrame(bool room_frame, const unsigned char* body,
+                     std::size_t body_length);
+    // sync_marker - кадр v1 пришел с синхромаркером, уже снятым с payload
+    void HandleRoomOp(uint8_t op, uint32_t room_id,
+                      const unsigned char* payload, std::size_t size,
+                      bool sync_marker);
+    // last_seq - последний полученный кадр комнаты (ROOM_RESUME): сессия
+    // получит из истории только кадры после него, даже если уже в комнате,
+    // но не больше history_recent последних - более ранний пропуск
+    // не досылается.
+    // nullptr - сессия уже в session_rooms_max комнатах или на узле
+    // больше нет места для новой
+    std::shared_ptr<ChatRoom> JoinRoom(uint32_t room_id, uint64_t last_seq = 0);
+    void LeaveRoom(uint32_t room_id);
+    // Кладет кадры во входящие, при необходимости планирует DeliverImpl
+    template <typename Iterator>
+    void Deliver(Iterator begin, Iterator end);
+    void DeliverImpl();
+    // Кладет кадр в очередь, true - нужно запустить запись
+    bool Enqueue(const SharedFrame& frame);
+    void Flush();
+    void Close();
+    // Перезапуск: сессия выходит из комнат, больше не читает и закрывается,
+    // как только уйдет ее очередь отправки
+    void DrainImpl();
+    void CloseDrained();
 
     tcp::socket socket_;
-    boost::asio::io_service::strand& strand_;
-    ChatRoom& room_;
+    // Собственный strand сессии: обработчики одной сессии не пересекаются,
+    // а разные сессии обслуживаются параллельно
+    boost::asio::io_service::strand strand_;
+    RoomRegistry& registry_;
+    // Номер io_service сессии в пуле
+    std::size_t worker_;
+    // Комнаты, в которых состоит сессия
+    std::unordered_map<uint32_t, std::shared_ptr<ChatRoom>> rooms_;
+    // Формат кадров клиента: кадры с комнатой или v2 сессия
+    // начинает получать, как только клиент прислал хотя бы один такой
+    WireFormat wire_format_;
+    // Отпечаток ключа из ROOM_HELLO: по нему комнаты доставляют
+    // адресные кадры
+    bool has_fingerprint_;
+    Fingerprint fingerprint_;
+    // Сессия принята акцептором и учтена в sessions_active
+    bool started_;
     std::array<char, MAX_NICKNAME> nickname_;
-    std::vector<unsigned char> read_msg_;
-    std::deque<std::vector<unsigned char>> write_msgs_;
-    boost::asio::steady_timer deadline_;
+    // Начало кадра, не поместившегося в прошлое чтение. Буфер берется
+    // из FramePool, только пока такой кадр есть, а целые кадры
+    // разбираются прямо в общем буфере потока
+    unsigned char* pending_;
+    std::size_t pending_size_;
+    SendQueue send_queue_;
+    // Тайм-ауты сессии - элемент колеса таймеров ее io_service
+    TimingWheel& wheel_;
+    // Взведен тайм-аут чтения кадра, а не бездействия
+    bool read_deadline_;
+
+    // Входящие кадры сессии, по числу и по байтам
+    TokenBucket ingress_frames_;
+    TokenBucket ingress_bytes_;
+    // Пауза, которой требуют комнаты кадров текущего чтения
+    int64_t room_wait_;
+    // Второй элемент колеса: отложенный вход в комнату по умолчанию
+    // и возобновление чтения после паузы
+    struct DeferredEntry : TimerEntry {
+        PersonInRoom* session;
+        void OnTimer() override { session->OnDeferred(); }
+    };
+    DeferredEntry deferred_;
+    // Начало паузы чтения, 0 - сессия читает
+    int64_t paused_at_;
+    // Сессия еще не вошла в комнату по умолчанию: ждем первый кадр,
+    // вдруг это ROOM_RESUME
+    bool join_pending_;
+    // Сессия дописывает очередь перед закрытием (Drain)
+    bool draining_;
+
+    // Входящие кадры от комнат. Комнаты кладут кадры под мьютексом,
+    // а DeliverImpl в strand сессии забирает их все разом, так что
+    // на пачку кадров приходится один post, а не по одному на кадр
+    std::mutex inbox_mutex_;
+    std::vector<SharedFrame> inbox_;
+    std::vector<SharedFrame> delivering_;
+
+#ifdef SESSION_COROUTINES
+    // Пишущая сопрограмма, уснувшая на пустой очереди
+    std::optional<WriteWaiter> write_waiter_;
+#endif
+
+    // Память под операции: в каждой цепочке одна операция за раз
+#ifndef SESSION_COROUTINES
+    HandlerMemory read_memory_;
+#endif
+    HandlerMemory write_memory_;
+    HandlerMemory deliver_memory_;
 };
 
 #endif // PERSONINROOM_HPP
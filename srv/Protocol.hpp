@@ -2,9 +2,111 @@
 #ifndef PROTOCOL_HPP
 #define PROTOCOL_HPP
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 const std::size_t MAX_NICKNAME = 20;
 const std::size_t PADDING = 4;
 
+// Кадр с комнатой: старший бит в двух байтах длины, за ними
+// [op 1 байт][room 4 байта, little-endian], дальше payload.
+// Длина (младшие 15 бит) - размер payload без op и room.
+// Кадры без флага относятся к комнате DEFAULT_ROOM, в которую
+// сервер сам вводит каждое новое соединение.
+const uint16_t ROOM_FRAME_FLAG = 0x8000;
+const uint16_t FRAME_LENGTH_MASK = 0x7FFF;
+const std::size_t ROOM_HEADER_SIZE = 7;
+const std::size_t ROOM_FIELDS_SIZE = 5;
+const uint32_t DEFAULT_ROOM = 0;
+
+enum RoomOp {
+    ROOM_MSG = 0,       // сообщение в комнату (вход в нее, если нужно)
+    ROOM_JOIN = 1,      // войти в комнату, payload пустой
+    ROOM_LEAVE = 2,     // выйти из комнаты, payload пустой
+    ROOM_HELLO = 3,     // payload - отпечаток своего ключа, room не важен
+    ROOM_ROUTED = 4,    // payload - [отпечаток получателя][сообщение]
+    ROOM_SEQ_MSG = 5,   // от сервера: payload - [номер кадра 8 LE][сообщение]
+    ROOM_RESUME = 6     // payload - [последний полученный номер 8 LE]
+};
+
+// Номер кадра - его номер в журнале комнаты (RoomLog), растет на 1
+// с каждым кадром рассылки; 0 - "нет кадра". Номера видны только
+// в v2: сервер шлет кадры рассылки как ROOM_SEQ_MSG. Переподключившийся
+// клиент присылает ROOM_RESUME с последним увиденным номером и получает
+// из истории только пропущенные кадры, а не последние HISTORY_RECENT;
+// пропуск длиннее history_recent досылается не целиком, а его хвостом.
+const std::size_t FRAME_SEQ_SIZE = 8;
+
+// Кадр v2 (FrameV2.hpp):
+// [magic 2][version 1][op 1][room 4 LE][length 2 LE][crc32c 4 LE][payload]
+// magic C3 F2 не бывает началом кадра v1: как длина это 0xF2C3 -
+// кадр с комнатой длиннее MAX_PACK_SIZE. crc32c считается от байт
+// version..length и payload. Синхромаркер из 32 нулей в v2 не нужен:
+// после ошибки поток ищет следующий magic.
+// Сервер отвечает кадрами v2 сессии, приславшей хотя бы один такой кадр.
+const unsigned char FRAME_V2_MAGIC_0 = 0xC3;
+const unsigned char FRAME_V2_MAGIC_1 = 0xF2;
+const uint8_t FRAME_V2_VERSION = 2;
+const std::size_t FRAME_V2_HEADER_SIZE = 14;
+
+// Кадры между узлами федерации (Federation.hpp) - тоже кадры v2,
+// со своими op, которых клиент не шлет и не получает
+enum PeerOp {
+    PEER_HELLO = 16,            // payload - имя узла (его host:port для соседей)
+    PEER_SUBSCRIBE = 17,        // присылать рассылку комнаты room, payload пустой
+    PEER_UNSUBSCRIBE = 18,      // больше не присылать, payload пустой
+    PEER_FORWARD = 19,          // владельцу комнаты: [флаги 1][сообщение]
+    PEER_RELAY = 20,            // от владельца: [номер кадра 8 LE][флаги 1][сообщение]
+    PEER_FORWARD_ROUTED = 21,   // владельцу: [отпечаток получателя][флаги 1][сообщение]
+    PEER_RELAY_ROUTED = 22      // от владельца: [отпечаток получателя][флаги 1][сообщение]
+};
+
+// Флаги сообщения между узлами: синхромаркер v1 снят с сообщения,
+// но узел-получатель должен вернуть его своим сессиям v1
+const std::size_t PEER_FLAGS_SIZE = 1;
+const uint8_t PEER_SYNC_MARKER = 0x01;
+
+// Локальный транспорт (ShmSession.hpp): клиент подключается к unix-
+// сокету --shm-socket и получает одно сообщение ShmHello с тремя
+// дескрипторами (SCM_RIGHTS): memfd с двумя кольцами ShmRing, eventfd
+// сервера и eventfd клиента. В memfd подряд лежат кольцо клиент->сервер
+// и кольцо сервер->клиент, каждое по ShmRing::RegionSize(ring_bytes)
+// байт. По кольцам идут кадры v2, как по TCP. Соединение по сокету
+// остается открытым: его закрытие любой из сторон завершает сессию.
+const uint32_t SHM_HELLO_MAGIC = 0x314D4853;    // "SHM1"
+
+struct ShmHello {
+    uint32_t magic;
+    uint32_t ring_bytes;
+};
+
+// Перезапуск сервера (Handoff.hpp): старый процесс отвечает новому
+// одним сообщением по unix-сокету - HandoffHello и count слушающих
+// TCP-сокетов в SCM_RIGHTS, в порядке их открытия.
+const uint32_t HANDOFF_MAGIC = 0x31464F48;      // "HOF1"
+
+struct HandoffHello {
+    uint32_t magic;
+    uint32_t count;
+};
+
+// Отпечаток публичного ключа: SHA-256 от DER (Crypt::GetPubKeyFingerprint),
+// в кадрах - 32 байта как есть, без hex.
+// Клиент, приславший ROOM_HELLO, получает кадры ROOM_ROUTED со своим
+// отпечатком; получателю кадр приходит как обычный ROOM_MSG,
+// уже без отпечатка.
+const std::size_t FINGERPRINT_SIZE = 32;
+typedef std::array<unsigned char, FINGERPRINT_SIZE> Fingerprint;
+
+// Отпечаток - уже хеш, в качестве ключа таблицы хватает его начала
+struct FingerprintHash {
+    std::size_t operator()(const Fingerprint& fingerprint) const {
+        std::size_t hash;
+        std::memcpy(&hash, fingerprint.data(), sizeof(hash));
+        return hash;
+    }
+};
+
 #endif // PROTOCOL_HPP
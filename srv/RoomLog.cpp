@@ -0,0 +1,423 @@
+// RoomLog.cpp
+#include "RoomLog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Log.hpp"
+
+// Заголовок записи в .log
+struct RecordHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint64_t seq;
+    int64_t timestamp;
+};
+
+// Флаги записи
+const uint32_t RECORD_SYNC_MARKER = 1;
+
+// Запись в .idx
+struct IndexEntry {
+    uint64_t seq;
+    uint64_t pos;
+};
+
+static std::size_t RecordSize(std::size_t payload_size) {
+    return (sizeof(RecordHeader) + payload_size + 7) & ~static_cast<std::size_t>(7);
+}
+
+static int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static std::runtime_error SysError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+RoomLog::RoomLog(const std::string& dir, const RoomLogOptions& options)
+    : dir_(dir),
+      options_(options),
+      total_bytes_(0)
+{
+    Open();
+}
+
+RoomLog::~RoomLog() {
+    for (auto& segment : segments_) {
+        Close(segment);
+    }
+}
+
+std::string RoomLog::SegmentPath(uint64_t base_seq, const char* ext) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu%s",
+             static_cast<unsigned long long>(base_seq), ext);
+    return dir_ + "/" + name;
+}
+
+void RoomLog::Open() {
+    // Каталог и первый сегмент появятся с первым кадром (Append)
+    if (!std::filesystem::exists(dir_)) {
+        return;
+    }
+    std::vector<uint64_t> bases;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+        if (entry.path().extension() == ".log") {
+            bases.push_back(std::strtoull(entry.path().stem().c_str(), nullptr, 10));
+        }
+    }
+    std::sort(bases.begin(), bases.end());
+
+    for (std::size_t i = 0; i < bases.size(); ++i) {
+        Segment segment;
+        segment.base_seq = bases[i];
+        segment.path = SegmentPath(bases[i], ".log");
+        segment.index_path = SegmentPath(bases[i], ".idx");
+        LoadSegment(segment, i + 1 == bases.size());
+        segments_.push_back(segment);
+    }
+
+    if (segments_.empty()) {
+        return;
+    }
+    ApplyRetention();
+
+    LOG_MSG("Room log " << dir_ << ": " << segments_.size() << " segments, frames "
+            << FirstSeq() << ".." << NextSeq());
+}
+
+void RoomLog::LoadSegment(Segment& segment, bool active) {
+    segment.fd = open(segment.path.c_str(), O_RDWR);
+    if (segment.fd < 0) {
+        throw SysError("Cannot open", segment.path);
+    }
+
+    struct stat st;
+    if (fstat(segment.fd, &st) != 0) {
+        throw SysError("Cannot stat", segment.path);
+    }
+    segment.capacity = st.st_size;
+    segment.last_write = st.st_mtime;
+
+    if (active) {
+        // Последний сегмент продолжаем дописывать
+        MapActive(segment);
+    } else if (segment.capacity > 0) {
+        void* data = mmap(nullptr, segment.capacity, PROT_READ, MAP_SHARED,
+                          segment.fd, 0);
+        if (data == MAP_FAILED) {
+            throw SysError("Cannot mmap", segment.path);
+        }
+        segment.data = static_cast<unsigned char*>(data);
+    }
+
+    // Индекс с диска, затем досканировать хвост после последней его записи
+    LoadIndex(segment);
+    if (segment.index.empty()) {
+        Scan(segment, 0, segment.base_seq);
+    } else {
+        Scan(segment, segment.index.back().second, segment.index.back().first);
+    }
+
+    total_bytes_ += segment.size;
+}
+
+void RoomLog::LoadIndex(Segment& segment) {
+    int fd = open(segment.index_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    IndexEntry entry;
+    while (read(fd, &entry, sizeof(entry)) == sizeof(entry)) {
+        // Запись индекса должна указывать на запись журнала с тем же номером
+        RecordHeader header;
+        if (entry.pos + sizeof(header) > segment.capacity) {
+            break;
+        }
+        std::memcpy(&header, segment.data + entry.pos, sizeof(header));
+        if (header.size == 0 || header.seq != entry.seq) {
+            break;
+        }
+        segment.index.push_back(std::make_pair(entry.seq, entry.pos));
+    }
+    close(fd);
+}
+
+void RoomLog::Scan(Segment& segment, std::size_t pos, uint64_t seq) {
+    while (pos + sizeof(RecordHeader) <= segment.capacity) {
+        RecordHeader header;
+        std::memcpy(&header, segment.data + pos, sizeof(header));
+        if (header.size == 0 || header.seq != seq
+            || pos + RecordSize(header.size) > segment.capacity) {
+            break;
+        }
+        if (segment.index.empty()
+            || pos - segment.index.back().second >= options_.index_interval) {
+            AddIndexEntry(segment, seq, pos);
+        }
+        pos += RecordSize(header.size);
+        ++seq;
+    }
+
+    segment.size = pos;
+    segment.next_seq = seq;
+}
+
+void RoomLog::MapActive(Segment& segment) {
+    std::size_t initial = std::min<std::size_t>(HISTORY_SEGMENT_INITIAL_BYTES,
+                                                options_.segment_bytes);
+    Map(segment, std::max(segment.capacity, initial));
+
+    segment.index_fd = open(segment.index_path.c_str(),
+                            O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (segment.index_fd < 0) {
+        throw SysError("Cannot open", segment.index_path);
+    }
+}
+
+void RoomLog::Map(Segment& segment, std::size_t capacity) {
+    // Выделяем место сразу: запись в дыру mmap при нехватке диска - это SIGBUS
+    int err = posix_fallocate(segment.fd, 0, capacity);
+    if (err != 0) {
+        errno = err;
+        throw SysError("Cannot allocate", segment.path);
+    }
+
+    void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      segment.fd, 0);
+    if (data == MAP_FAILED) {
+        throw SysError("Cannot mmap", segment.path);
+    }
+    if (segment.data) {
+        munmap(segment.data, segment.capacity);
+    }
+    segment.data = static_cast<unsigned char*>(data);
+    segment.capacity = capacity;
+}
+
+void RoomLog::CreateSegment(uint64_t base_seq) {
+    Segment segment;
+    segment.base_seq = base_seq;
+    segment.next_seq = base_seq;
+    segment.path = SegmentPath(base_seq, ".log");
+    segment.index_path = SegmentPath(base_seq, ".idx");
+    segment.last_write = std::time(nullptr);
+
+    segment.fd = open(segment.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (segment.fd < 0) {
+        throw SysError("Cannot create", segment.path);
+    }
+    // Индекс мог остаться от удаленного сегмента с тем же номером
+    unlink(segment.index_path.c_str());
+    try {
+        MapActive(segment);
+    } catch (...) {
+        Close(segment);
+        throw;
+    }
+
+    segments_.push_back(segment);
+}
+
+void RoomLog::Seal(Segment& segment) {
+    // Отдаем неиспользованный хвост и переоткрываем сегмент только на чтение
+    munmap(segment.data, segment.capacity);
+    segment.data = nullptr;
+    if (ftruncate(segment.fd, segment.size) != 0) {
+        LOG_MSG("Cannot truncate " << segment.path << ": " << std::strerror(errno));
+    }
+    segment.capacity = segment.size;
+    if (segment.size > 0) {
+        void* data = mmap(nullptr, segment.size, PROT_READ, MAP_SHARED, segment.fd, 0);
+        if (data == MAP_FAILED) {
+            throw SysError("Cannot mmap", segment.path);
+        }
+        segment.data = static_cast<unsigned char*>(data);
+    }
+    close(segment.index_fd);
+    segment.index_fd = -1;
+}
+
+void RoomLog::Close(Segment& segment) {
+    if (segment.data) {
+        munmap(segment.data, segment.capacity);
+        segment.data = nullptr;
+    }
+    if (segment.fd >= 0) {
+        close(segment.fd);
+        segment.fd = -1;
+    }
+    if (segment.index_fd >= 0) {
+        close(segment.index_fd);
+        segment.index_fd = -1;
+    }
+}
+
+void RoomLog::ApplyRetention() {
+    std::time_t now = std::time(nullptr);
+
+    // Активный сегмент не удаляется никогда
+    while (segments_.size() > 1
+           && (total_bytes_ > options_.retention_bytes
+               || segments_.front().last_write + options_.retention_seconds < now)) {
+        Segment& oldest = segments_.front();
+        LOG_MSG("Room log " << dir_ << ": removing segment " << oldest.path);
+        Close(oldest);
+        unlink(oldest.path.c_str());
+        unlink(oldest.index_path.c_str());
+        total_bytes_ -= oldest.size;
+        segments_.pop_front();
+    }
+}
+
+void RoomLog::AddIndexEntry(Segment& segment, uint64_t seq, std::size_t pos) {
+    segment.index.push_back(std::make_pair(seq, pos));
+    if (segment.index_fd >= 0) {
+        IndexEntry entry = { seq, pos };
+        if (write(segment.index_fd, &entry, sizeof(entry)) != sizeof(entry)) {
+            LOG_MSG("Cannot write " << segment.index_path << ": " << std::strerror(errno));
+        }
+    }
+}
+
+uint64_t RoomLog::Append(const unsigned char* payload, std::size_t size, bool sync_marker) {
+    // Номер 0 зарезервирован под "нет кадра", NextSeq пустого журнала - 1
+    return Write(payload, size, sync_marker, NextSeq());
+}
+
+uint64_t RoomLog::Append(const unsigned char* payload, std::size_t size, bool sync_marker,
+                         uint64_t seq)
+{
+    if (seq < NextSeq()) {
+        return 0;
+    }
+    return Write(payload, size, sync_marker, seq);
+}
+
+uint64_t RoomLog::Write(const unsigned char* payload, std::size_t size, bool sync_marker,
+                        uint64_t seq)
+{
+    std::size_t record_size = RecordSize(size);
+
+    try {
+        if (segments_.empty()) {
+            std::filesystem::create_directories(dir_);
+            CreateSegment(seq);
+        } else if (seq != segments_.back().next_seq) {
+            // В сегменте номера идут подряд, после пропуска - новый сегмент.
+            // Пустой сегмент назван прежним номером, он просто удаляется
+            Segment& active = segments_.back();
+            if (active.size > 0) {
+                Seal(active);
+            } else {
+                Close(active);
+                unlink(active.path.c_str());
+                unlink(active.index_path.c_str());
+                segments_.pop_back();
+            }
+            CreateSegment(seq);
+            ApplyRetention();
+        }
+        Segment& active = segments_.back();
+        if (active.size + record_size > active.capacity) {
+            if (active.size > 0 && active.size + record_size > options_.segment_bytes) {
+                uint64_t next_seq = active.next_seq;
+                Seal(active);
+                CreateSegment(next_seq);
+                ApplyRetention();
+            }
+            // Сегмент растет вдвое, но не больше segment_bytes
+            Segment& segment = segments_.back();
+            std::size_t needed = segment.size + record_size;
+            if (needed > segment.capacity && needed <= options_.segment_bytes) {
+                Map(segment, std::min(options_.segment_bytes,
+                                      std::max(segment.capacity * 2, needed)));
+            }
+        } else if (segments_.size() > 1
+                   && segments_.front().last_write + options_.retention_seconds
+                      < std::time(nullptr)) {
+            ApplyRetention();
+        }
+    } catch (std::exception& e) {
+        LOG_MSG("Room log " << dir_ << ": " << e.what());
+        return 0;
+    }
+
+    Segment& segment = segments_.back();
+    if (segment.size + record_size > segment.capacity) {
+        LOG_MSG("Room log " << dir_ << ": frame does not fit into a segment");
+        return 0;
+    }
+
+    std::size_t pos = segment.size;
+    unsigned char* record = segment.data + pos;
+
+    RecordHeader header = { 0, sync_marker ? RECORD_SYNC_MARKER : 0, seq, NowMs() };
+    std::memcpy(record, &header, sizeof(header));
+    std::memcpy(record + sizeof(header), payload, size);
+    // Длина пишется последней: до этого момента запись не видна при восстановлении
+    __atomic_store_n(reinterpret_cast<uint32_t*>(record),
+                     static_cast<uint32_t>(size), __ATOMIC_RELEASE);
+
+    if (segment.index.empty()
+        || pos - segment.index.back().second >= options_.index_interval) {
+        AddIndexEntry(segment, seq, pos);
+    }
+
+    segment.size += record_size;
+    segment.next_seq = seq + 1;
+    segment.last_write = std::time(nullptr);
+    total_bytes_ += record_size;
+
+    return seq;
+}
+
+void RoomLog::Replay(uint64_t from, uint64_t to, const Visitor& visitor) const {
+    for (const auto& segment : segments_) {
+        if (segment.next_seq <= from || segment.base_seq >= to) {
+            continue;
+        }
+
+        // Ближайшая запись индекса не дальше from
+        std::size_t pos = 0;
+        auto it = std::upper_bound(
+            segment.index.begin(), segment.index.end(), from,
+            [](uint64_t seq, const std::pair<uint64_t, std::size_t>& entry) {
+                return seq < entry.first;
+            });
+        if (it != segment.index.begin()) {
+            pos = (it - 1)->second;
+        }
+
+        while (pos < segment.size) {
+            RecordHeader header;
+            std::memcpy(&header, segment.data + pos, sizeof(header));
+            if (header.seq >= to) {
+                break;
+            }
+            if (header.seq >= from) {
+                visitor(header.seq, segment.data + pos + sizeof(header), header.size,
+                        (header.flags & RECORD_SYNC_MARKER) != 0);
+            }
+            pos += RecordSize(header.size);
+        }
+    }
+}
+
+uint64_t RoomLog::FirstSeq() const {
+    return segments_.empty() ? 1 : segments_.front().base_seq;
+}
+
+uint64_t RoomLog::NextSeq() const {
+    return segments_.empty() ? 1 : segments_.back().next_seq;
+}
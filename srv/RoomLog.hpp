@@ -0,0 +1,111 @@
+// RoomLog.hpp
+#ifndef ROOMLOG_HPP
+#define ROOMLOG_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "defs.hpp"
+
+struct RoomLogOptions {
+    std::size_t segment_bytes = HISTORY_SEGMENT_BYTES;
+    std::size_t retention_bytes = HISTORY_RETENTION_BYTES;
+    std::time_t retention_seconds = HISTORY_RETENTION_SECONDS;
+    std::size_t index_interval = HISTORY_INDEX_INTERVAL;
+};
+
+/**
+   Журнал кадров комнаты: только дозапись, сегменты в mmap.
+
+   Каталог журнала содержит пары файлов <base_seq>.log и <base_seq>.idx,
+   где base_seq - номер первого кадра сегмента. Запись в .log:
+   [size 4][flags 4][seq 8][timestamp 8][payload size байт],
+   выровненная на 8 байт. Во flags отмечается синхромаркер v1,
+   с которым пришел кадр (сам маркер не хранится). Активный сегмент пишется через mmap, место
+   под него выделяется заранее (posix_fallocate): сначала
+   HISTORY_SEGMENT_INITIAL_BYTES, затем вдвое больше при заполнении,
+   до segment_bytes. Поле size пишется последним,
+   поэтому недописанная запись после падения читается как конец сегмента.
+   .idx - разреженный индекс: пары (seq, смещение) примерно на каждые
+   index_interval байт сегмента. Каталог и первый сегмент создаются
+   с первым кадром: комната, в которую не писали, ничего не занимает
+   на диске.
+
+   Сегмент закрывается, когда он дорос до segment_bytes; после этого
+   удаляются самые старые сегменты сверх retention_bytes
+   или старше retention_seconds.
+
+   Ошибки ввода-вывода при открытии журнала - исключения, при записи -
+   номер 0 из Append.
+   Не потокобезопасен: используется только из strand комнаты.
+*/
+class RoomLog {
+public:
+    typedef std::function<void(uint64_t seq, const unsigned char* payload,
+                               std::size_t size, bool sync_marker)> Visitor;
+
+    RoomLog(const std::string& dir, const RoomLogOptions& options);
+    ~RoomLog();
+
+    RoomLog(const RoomLog&) = delete;
+    RoomLog& operator=(const RoomLog&) = delete;
+
+    // Дописывает кадр, возвращает его номер (0 - ошибка записи).
+    // sync_marker возвращается в Visitor при чтении
+    uint64_t Append(const unsigned char* payload, std::size_t size, bool sync_marker);
+    // Дописывает кадр под номером seq, присвоенным в другом журнале
+    // (у владельца комнаты в федерации). Номера могут идти с пропусками,
+    // но только по возрастанию: кадр с номером меньше NextSeq не пишется, 0
+    uint64_t Append(const unsigned char* payload, std::size_t size, bool sync_marker,
+                    uint64_t seq);
+
+    // Обходит сохраненные кадры с номерами из [from, to)
+    void Replay(uint64_t from, uint64_t to, const Visitor& visitor) const;
+
+    // Номер самого старого сохраненного кадра и номер следующего кадра
+    uint64_t FirstSeq() const;
+    uint64_t NextSeq() const;
+
+private:
+    struct Segment {
+        uint64_t base_seq = 0;
+        uint64_t next_seq = 0;
+        std::string path;
+        std::string index_path;
+        unsigned char* data = nullptr;
+        std::size_t capacity = 0;
+        std::size_t size = 0;
+        int fd = -1;
+        int index_fd = -1;
+        std::vector<std::pair<uint64_t, std::size_t>> index;
+        std::time_t last_write = 0;
+    };
+
+    void Open();
+    uint64_t Write(const unsigned char* payload, std::size_t size, bool sync_marker,
+                   uint64_t seq);
+    void LoadSegment(Segment& segment, bool active);
+    void LoadIndex(Segment& segment);
+    void Scan(Segment& segment, std::size_t pos, uint64_t seq);
+    void MapActive(Segment& segment);
+    // Выделяет на диске и отображает capacity байт сегмента;
+    // при ошибке прежнее отображение остается в силе
+    void Map(Segment& segment, std::size_t capacity);
+    void CreateSegment(uint64_t base_seq);
+    void Seal(Segment& segment);
+    void Close(Segment& segment);
+    void ApplyRetention();
+    void AddIndexEntry(Segment& segment, uint64_t seq, std::size_t pos);
+    std::string SegmentPath(uint64_t base_seq, const char* ext) const;
+
+    std::string dir_;
+    RoomLogOptions options_;
+    std::deque<Segment> segments_;
+    std::size_t total_bytes_;
+};
+
+#endif // ROOMLOG_HPP
@@ -0,0 +1,113 @@
+// RoomRegistry.cpp
+#include "RoomRegistry.hpp"
+
+RoomRegistry::RoomRegistry(IoServicePool& pool, Federation* federation)
+    : pool_(pool),
+      federation_(federation),
+      draining_(false),
+      count_(0)
+{
+    for (std::size_t i = 0; i < pool_.Size(); ++i) {
+        shards_.emplace_back(new Shard);
+    }
+}
+
+std::shared_ptr<ChatRoom> RoomRegistry::Get(uint32_t room_id) {
+    std::size_t index = room_id % shards_.size();
+    Shard& shard = *shards_[index];
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.rooms.find(room_id);
+    if (it != shard.rooms.end()) {
+        ++it->second.holders;
+        return it->second.room;
+    }
+
+    // Предел общий для шардов, поэтому его можно чуть превысить
+    // одновременными Get из разных шардов
+    if (count_.load() >= Config::Get().rooms_max.load(std::memory_order_relaxed)) {
+        LOG_MSG("Too many rooms, room " << room_id << " is not created");
+        Metrics::Get().RecordRoomRejected();
+        return nullptr;
+    }
+    std::shared_ptr<ChatRoom> room(new ChatRoom(
+        pool_, index, room_id,
+        Config::Get().history_dir + "/" + std::to_string(room_id), federation_));
+    shard.rooms[room_id] = Entry{room, 1};
+    ++count_;
+    Metrics::Get().RecordRoom(1);
+    if (draining_.load()) {
+        room->Drain([]() {});
+    }
+    LOG_MSG("Room " << room_id << " created on shard " << index);
+    return room;
+}
+
+void RoomRegistry::Release(const std::shared_ptr<ChatRoom>& room) {
+    Shard& shard = *shards_[room->Id() % shards_.size()];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.rooms.find(room->Id());
+    if (it == shard.rooms.end() || it->second.room != room) {
+        return;
+    }
+    if (--it->second.holders == 0) {
+        // Выход последнего участника уже в очереди комнаты перед этим
+        room->Evict([this, room]() { return Remove(room); });
+    }
+}
+
+bool RoomRegistry::Remove(const std::shared_ptr<ChatRoom>& room) {
+    Shard& shard = *shards_[room->Id() % shards_.size()];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.rooms.find(room->Id());
+    if (it == shard.rooms.end() || it->second.room != room || it->second.holders > 0) {
+        return false;
+    }
+    shard.rooms.erase(it);
+    --count_;
+    Metrics::Get().RecordRoom(-1);
+    LOG_MSG("Room " << room->Id() << " evicted");
+    return true;
+}
+
+std::vector<std::shared_ptr<ChatRoom>> RoomRegistry::Rooms() {
+    std::vector<std::shared_ptr<ChatRoom>> rooms;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (const auto& room : shard->rooms) {
+            rooms.push_back(room.second.room);
+        }
+    }
+    std::sort(rooms.begin(), rooms.end(),
+              [](const std::shared_ptr<ChatRoom>& a, const std::shared_ptr<ChatRoom>& b) {
+                  return a->Id() < b->Id();
+              });
+    return rooms;
+}
+
+void RoomRegistry::Drain(std::function<void()> done) {
+    // Комнаты, созданные после этой строки, Get останавливает сам
+    draining_.store(true);
+    std::vector<std::shared_ptr<ChatRoom>> rooms = Rooms();
+    if (rooms.empty()) {
+        done();
+        return;
+    }
+    std::shared_ptr<std::atomic<std::size_t>> left(
+        new std::atomic<std::size_t>(rooms.size()));
+    for (const auto& room : rooms) {
+        room->Drain([left, done]() {
+            if (left->fetch_sub(1) == 1) {
+                done();
+            }
+        });
+    }
+}
+
+bool RoomRegistry::Draining() const {
+    return draining_.load(std::memory_order_relaxed);
+}
+
+IoServicePool& RoomRegistry::Pool() {
+    return pool_;
+}
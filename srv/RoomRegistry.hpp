@@ -0,0 +1,68 @@
+// RoomRegistry.hpp
+#ifndef ROOMREGISTRY_HPP
+#define ROOMREGISTRY_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "ChatRoom.hpp"
+#include "IoServicePool.hpp"
+
+/**
+   Реестр комнат. Комната создается при первом обращении и навсегда
+   закрепляется за одним рабочим потоком (шардом): ее strand живет
+   в io_service номер room_id % pool.Size(). Так горячая комната
+   занимает только свой шард и не задерживает комнаты в других.
+   Таблицы комнат тоже разбиты по шардам, у каждой свой мьютекс.
+   Комнату держат те, кто взял ее через Get: сессии, пока они в ней,
+   и федерация на время передачи кадра. Когда последний вернул ее через
+   Release, комната выселяется (ChatRoom::Evict): уходит из реестра
+   и закрывает журнал, а следующий Get создаст ее заново. Комнат на узле
+   не больше Config::rooms_max.
+*/
+class RoomRegistry {
+public:
+    // federation - nullptr, если узел один
+    RoomRegistry(IoServicePool& pool, Federation* federation = nullptr);
+
+    // Комната с данным номером, при необходимости создается. Каждый
+    // Get парный с Release; nullptr - на узле уже rooms_max комнат
+    std::shared_ptr<ChatRoom> Get(uint32_t room_id);
+    void Release(const std::shared_ptr<ChatRoom>& room);
+    // Все созданные комнаты, по возрастанию номера
+    std::vector<std::shared_ptr<ChatRoom>> Rooms();
+    IoServicePool& Pool();
+    // Перезапуск: все комнаты, и существующие, и созданные позже,
+    // перестают писать журналы и отключают участников (ChatRoom::Drain).
+    // done вызывается из strand последней комнаты
+    void Drain(std::function<void()> done);
+    bool Draining() const;
+
+private:
+    struct Entry {
+        std::shared_ptr<ChatRoom> room;
+        // Сколько Get еще не вернули через Release
+        std::size_t holders;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint32_t, Entry> rooms;
+    };
+
+    // Снимает пустую комнату с реестра, если ее никто не взял снова.
+    // Вызывается из strand комнаты
+    bool Remove(const std::shared_ptr<ChatRoom>& room);
+
+    IoServicePool& pool_;
+    Federation* federation_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool> draining_;
+    // Комнат во всех шардах
+    std::atomic<std::size_t> count_;
+};
+
+#endif // ROOMREGISTRY_HPP
@@ -0,0 +1,109 @@
+// RoomShard.cpp
+#include "RoomShard.hpp"
+
+RoomShard::RoomShard(boost::asio::io_service& io_service, bool local)
+    : local_(local),
+      size_(0),
+      strand_(io_service)
+{
+}
+
+void RoomShard::Add(std::shared_ptr<Participant> participant) {
+    ++size_;
+    Schedule(Task{TaskAdd, std::move(participant), SharedFrame()});
+}
+
+void RoomShard::Remove(std::shared_ptr<Participant> participant) {
+    --size_;
+    Schedule(Task{TaskRemove, std::move(participant), SharedFrame()});
+}
+
+void RoomShard::Deliver(const SharedFrame& frame) {
+    Schedule(Task{TaskDeliver, std::shared_ptr<Participant>(), frame});
+}
+
+void RoomShard::Retire(std::shared_ptr<void> owner) {
+    if (local_) {
+        // Задачи локального шарда уже выполнены в strand комнаты
+        return;
+    }
+    // Обычный post, без tasks_memory_: обработчик может оказаться
+    // последним владельцем комнаты, а с ней и этого шарда
+    strand_.post([owner]() {});
+}
+
+void RoomShard::DeliverTo(std::shared_ptr<Participant> participant,
+                          const SharedFrame& frame)
+{
+    Schedule(Task{TaskDeliverTo, std::move(participant), frame});
+}
+
+std::size_t RoomShard::Size() const {
+    return size_;
+}
+
+void RoomShard::Schedule(Task task) {
+    if (local_) {
+        // Мы в strand комнаты, который сам защищает и этот шард
+        Run(task);
+        return;
+    }
+
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        schedule = inbox_.empty();
+        inbox_.push_back(std::move(task));
+    }
+
+    // Иначе RunTasks уже запланирован и заберет задачу вместе с прочими
+    if (schedule) {
+        strand_.post(MakeAllocHandler(
+            tasks_memory_, boost::bind(&RoomShard::RunTasks, this)));
+    }
+}
+
+void RoomShard::RunTasks() {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        inbox_.swap(running_);
+    }
+
+    for (const auto& task : running_) {
+        Run(task);
+    }
+    // Емкость векторов сохраняется, память больше не выделяется
+    running_.clear();
+}
+
+void RoomShard::Run(const Task& task) {
+    switch (task.kind) {
+    case TaskAdd:
+        positions_[task.participant.get()] = members_.size();
+        members_.push_back(task.participant);
+        break;
+    case TaskRemove: {
+        auto it = positions_.find(task.participant.get());
+        if (it == positions_.end()) {
+            break;
+        }
+        std::size_t position = it->second;
+        positions_.erase(it);
+        if (position + 1 != members_.size()) {
+            members_[position] = std::move(members_.back());
+            positions_[members_[position].get()] = position;
+        }
+        members_.pop_back();
+        break;
+    }
+    case TaskDeliver:
+        // Каждому участнику достается только указатель на общий кадр
+        for (const auto& member : members_) {
+            member->OnMessage(task.frame);
+        }
+        break;
+    case TaskDeliverTo:
+        task.participant->OnMessage(task.frame);
+        break;
+    }
+}
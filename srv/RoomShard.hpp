@@ -0,0 +1,73 @@
+// RoomShard.hpp
+#ifndef ROOMSHARD_HPP
+#define ROOMSHARD_HPP
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "Participant.hpp"
+#include "HandlerAllocator.hpp"
+
+/**
+   Участники одной комнаты, живущие в одном рабочем потоке. Рассылка
+   кадра большой комнате идет всеми шардами сразу: каждый кладет кадр
+   своим сессиям в своем потоке, по плотному массиву, без обхода
+   хеш-таблицы.
+   Add, Remove, Deliver и DeliverTo вызываются только из strand комнаты, а
+   выполняются в strand шарда в порядке вызова, пачками, как задачи
+   ChatRoom. Шард в потоке самой комнаты (local) выполняет их сразу:
+   лишний переход между потоками ему не нужен.
+*/
+class RoomShard {
+public:
+    RoomShard(boost::asio::io_service& io_service, bool local);
+
+    void Add(std::shared_ptr<Participant> participant);
+    void Remove(std::shared_ptr<Participant> participant);
+    void Deliver(const SharedFrame& frame);
+    // Адресный кадр одному участнику шарда - в общей очереди шарда,
+    // чтобы он не обогнал разосланные раньше кадры
+    void DeliverTo(std::shared_ptr<Participant> participant, const SharedFrame& frame);
+    // owner (комната) отпускается в strand шарда после всех уже
+    // поставленных задач: шард не переживет комнату с задачами в очереди
+    void Retire(std::shared_ptr<void> owner);
+    // Число участников с точки зрения комнаты (учтены еще
+    // не выполненные Add и Remove)
+    std::size_t Size() const;
+
+private:
+    enum TaskKind {
+        TaskAdd,
+        TaskRemove,
+        TaskDeliver,
+        TaskDeliverTo
+    };
+
+    struct Task {
+        TaskKind kind;
+        std::shared_ptr<Participant> participant;
+        SharedFrame frame;
+    };
+
+    void Schedule(Task task);
+    void RunTasks();
+    void Run(const Task& task);
+
+    bool local_;
+    std::size_t size_;
+    boost::asio::io_service::strand strand_;
+    // Участники подряд, рассылка идет по массиву. Удаленного заменяет
+    // последний, его место ищется по positions_
+    std::vector<std::shared_ptr<Participant>> members_;
+    std::unordered_map<Participant*, std::size_t> positions_;
+
+    std::mutex inbox_mutex_;
+    std::vector<Task> inbox_;
+    std::vector<Task> running_;
+    HandlerMemory tasks_memory_;
+};
+
+#endif // ROOMSHARD_HPP
@@ -0,0 +1,184 @@
+// SendQueue.cpp
+#include "SendQueue.hpp"
+#include "Tracer.hpp"
+#include <algorithm>
+
+SendQueue::SendQueue()
+    : bytes_(0),
+      format_(WireLegacy),
+      in_flight_(0),
+      buffers_(nullptr),
+      batch_ns_(0),
+      snapshot_frames_(0),
+      snapshot_bytes_(0)
+{
+}
+
+// Размер массива буферов одной записи
+static const std::size_t WRITE_BUFFERS_SIZE =
+    MAX_WRITE_BATCH_BUFFERS * sizeof(boost::asio::const_buffer);
+
+SendQueue::~SendQueue() {
+    if (buffers_) {
+        FramePool::Free(buffers_, WRITE_BUFFERS_SIZE);
+    }
+    // Из общей глубины очередей уходит то, что сессия не успела отправить
+    Metrics::Get().RecordQueued(-static_cast<int64_t>(frames_.size()),
+                                -static_cast<int64_t>(bytes_));
+}
+
+SendQueue::PushResult SendQueue::Push(const SharedFrame& frame) {
+    Config& config = Config::Get();
+    std::size_t max_frames = config.send_queue_max_frames.load(std::memory_order_relaxed);
+    std::size_t max_bytes = config.send_queue_max_bytes.load(std::memory_order_relaxed);
+
+    if (frames_.full()) {
+        frames_.set_capacity(std::max<std::size_t>(
+            SEND_QUEUE_INITIAL_CAPACITY, frames_.capacity() * 2));
+    }
+    frames_.push_back(frame);
+    bytes_ += frame->Size();
+    Account(1, frame->Size());
+
+    if (frames_.size() > max_frames || bytes_ > max_bytes) {
+        Metrics& metrics = Metrics::Get();
+        metrics.RecordOverflow();
+
+        switch (config.slow_consumer_policy.load(std::memory_order_relaxed)) {
+        case DropOldest:
+            // Старые кадры уходят, пока очередь не влезет в пределы
+            while ((frames_.size() > max_frames || bytes_ > max_bytes)
+                   && frames_.size() > in_flight_ + 1) {
+                DropPending(frames_.begin() + in_flight_);
+            }
+            break;
+        case SkipToLatest:
+            // Остаются только пишущиеся сейчас кадры и самый новый
+            metrics.RecordSkip();
+            while (frames_.size() > in_flight_ + 1) {
+                DropPending(frames_.begin() + in_flight_);
+            }
+            break;
+        case Disconnect:
+            metrics.RecordDisconnect();
+            return Overflow;
+        }
+    }
+
+    return in_flight_ == 0 ? StartWrite : Queued;
+}
+
+void SendQueue::DropPending(boost::circular_buffer<SharedFrame>::iterator it) {
+    int64_t size = (*it)->Size();
+    bytes_ -= size;
+    Metrics::Get().RecordDrop(size);
+    frames_.erase(it);
+    Account(-1, -size);
+}
+
+void SendQueue::SetWireFormat(WireFormat format) {
+    format_ = format;
+}
+
+bool SendQueue::WriteInProgress() const {
+    return in_flight_ > 0;
+}
+
+bool SendQueue::Empty() const {
+    return frames_.empty();
+}
+
+std::size_t SendQueue::Frames() const {
+    return frames_.size();
+}
+
+std::size_t SendQueue::Bytes() const {
+    return bytes_;
+}
+
+std::size_t SendQueue::SnapshotFrames() const {
+    return snapshot_frames_.load(std::memory_order_relaxed);
+}
+
+std::size_t SendQueue::SnapshotBytes() const {
+    return snapshot_bytes_.load(std::memory_order_relaxed);
+}
+
+void SendQueue::Account(int64_t frames, int64_t bytes) {
+    // Писатель один (strand сессии), атомарность нужна только читателям
+    snapshot_frames_.store(frames_.size(), std::memory_order_relaxed);
+    snapshot_bytes_.store(bytes_, std::memory_order_relaxed);
+    Metrics::Get().RecordQueued(frames, bytes);
+}
+
+ConstBufferSpan SendQueue::PrepareBatch() {
+    std::size_t count = 0;
+    std::size_t nbuffers = 0;
+    std::size_t bytes = 0;
+    bool traced = false;
+
+    if (!buffers_) {
+        buffers_ = static_cast<boost::asio::const_buffer*>(
+            FramePool::Allocate(WRITE_BUFFERS_SIZE));
+    }
+
+    for (const auto& frame : frames_) {
+        std::size_t size = frame->WireSize(format_);
+        std::size_t trailer_size = frame->TrailerSize(format_);
+        std::size_t per_frame = trailer_size > 0 ? 3 : 2;
+        if (nbuffers + per_frame > MAX_WRITE_BATCH_BUFFERS
+            || (count > 0 && bytes + size > MAX_WRITE_BATCH_BYTES)) {
+            break;
+        }
+        buffers_[nbuffers++] =
+            boost::asio::buffer(frame->Header(format_), frame->HeaderSize(format_));
+        buffers_[nbuffers++] =
+            boost::asio::buffer(frame->Payload(), frame->PayloadSize());
+        if (trailer_size > 0) {
+            buffers_[nbuffers++] = boost::asio::buffer(Frame::Trailer(), trailer_size);
+        }
+        bytes += size;
+        ++count;
+        traced = traced || frame->TraceId() != 0;
+    }
+
+    in_flight_ = count;
+    batch_ns_ = traced ? Metrics::NowNs() : 0;
+    Metrics::Get().RecordFlush(count, bytes);
+
+    return ConstBufferSpan(buffers_, buffers_ + nbuffers);
+}
+
+void SendQueue::ConsumeBatch() {
+    Metrics& metrics = Metrics::Get();
+    int64_t now = Metrics::NowNs();
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < in_flight_; ++i) {
+        bytes += frames_[i]->Size();
+        int64_t broadcast_ns = frames_[i]->BroadcastNs();
+        if (broadcast_ns != 0) {
+            metrics.RecordBroadcastToWrite(now - broadcast_ns);
+        }
+        if (batch_ns_ != 0 && frames_[i]->TraceId() != 0) {
+            Trace(*frames_[i], now);
+        }
+    }
+    bytes_ -= bytes;
+    frames_.erase_begin(in_flight_);
+    Account(-static_cast<int64_t>(in_flight_), -static_cast<int64_t>(bytes));
+    in_flight_ = 0;
+
+    // Массив буферов нужен только на время записи
+    FramePool::Free(buffers_, WRITE_BUFFERS_SIZE);
+    buffers_ = nullptr;
+}
+
+void SendQueue::Trace(const Frame& frame, int64_t now) {
+    // Сессию в трассе обозначает адрес ее очереди
+    uint64_t session = reinterpret_cast<uintptr_t>(this);
+    if (frame.BroadcastNs() != 0) {
+        Tracer::Span("queued", frame.TraceId(), frame.RoomId(), session,
+                     frame.BroadcastNs(), batch_ns_);
+    }
+    Tracer::Span("write", frame.TraceId(), frame.RoomId(), session, batch_ns_, now);
+}
@@ -0,0 +1,98 @@
+// SendQueue.hpp
+#ifndef SENDQUEUE_HPP
+#define SENDQUEUE_HPP
+
+#include <boost/asio.hpp>
+#include <boost/circular_buffer.hpp>
+#include "Frame.hpp"
+#include "Config.hpp"
+#include "Metrics.hpp"
+#include "FramePool.hpp"
+#include "defs.hpp"
+
+/**
+   Последовательность буферов поверх массива без копирования,
+   чтобы async_write не копировал std::vector буферов на каждую запись
+*/
+class ConstBufferSpan {
+public:
+    typedef boost::asio::const_buffer value_type;
+    typedef const boost::asio::const_buffer* const_iterator;
+
+    ConstBufferSpan(const_iterator begin, const_iterator end)
+        : begin_(begin), end_(end) {}
+    const_iterator begin() const { return begin_; }
+    const_iterator end() const { return end_; }
+
+private:
+    const_iterator begin_;
+    const_iterator end_;
+};
+
+/**
+   Очередь отправки одной сессии. Пока идет запись, новые кадры
+   накапливаются, а следующая запись забирает их все разом
+   одной gather-записью (writev).
+   Очередь ограничена по кадрам и байтам (Config), при переполнении
+   применяется slow_consumer_policy. Кадры, которые уже пишутся
+   в сокет, никогда не выбрасываются.
+   Кадры лежат в кольцевом буфере, который только растет: в отличие
+   от deque, он не выделяет и не освобождает память на ходу.
+   Молчащая сессия не держит ничего: кольцо выделяется с первым
+   кадром, а массив буферов записи берется из FramePool только
+   на время записи.
+   Не потокобезопасна: использовать только из strand сессии.
+*/
+class SendQueue {
+public:
+    enum PushResult {
+        Queued,         // кадр в очереди, запись уже идет
+        StartWrite,     // кадр в очереди, запись нужно запустить
+        Overflow        // предел превышен, участника нужно отключить
+    };
+
+    SendQueue();
+    ~SendQueue();
+
+    PushResult Push(const SharedFrame& frame);
+
+    // Формат кадров сессии: каждый кадр уходит буферами заголовка
+    // этого формата, payload и (для v1) синхромаркера
+    void SetWireFormat(WireFormat format);
+
+    bool WriteInProgress() const;
+    bool Empty() const;
+    std::size_t Frames() const;
+    std::size_t Bytes() const;
+    // То же, но читать можно из любого потока (админ-сокет)
+    std::size_t SnapshotFrames() const;
+    std::size_t SnapshotBytes() const;
+
+    // Забирает в запись кадры из начала очереди
+    ConstBufferSpan PrepareBatch();
+    // Запись пачки завершилась, отправленные кадры больше не нужны;
+    // для каждого из них учитывается задержка от рассылки до записи,
+    // а для трассируемых (Tracer) пишутся отрезки queued и write
+    void ConsumeBatch();
+
+private:
+    // Выкидывает неотправленный кадр, следующий за пишущимися
+    void DropPending(boost::circular_buffer<SharedFrame>::iterator it);
+    // Изменение глубины очереди: в снимок сессии и в общие метрики
+    void Account(int64_t frames, int64_t bytes);
+    // Отрезки трассы кадра, записанного пачкой, начатой в batch_ns_
+    void Trace(const Frame& frame, int64_t now);
+
+    boost::circular_buffer<SharedFrame> frames_;
+    std::size_t bytes_;
+    WireFormat format_;
+    // Сколько кадров из начала очереди сейчас пишется в сокет
+    std::size_t in_flight_;
+    boost::asio::const_buffer* buffers_;
+    // Начало текущей записи, если в пачке есть трассируемый кадр, иначе 0
+    int64_t batch_ns_;
+    std::atomic<std::size_t> snapshot_frames_;
+    std::atomic<std::size_t> snapshot_bytes_;
+};
+
+#endif // SENDQUEUE_HPP
@@ -1,20 +1,26 @@
 // Server.cpp
 #include "Server.hpp"
+#include "Handoff.hpp"
 
-Server::Server(boost::asio::io_service& io_service,
-               boost::asio::io_service::strand& strand,
+Server::Server(IoServicePool& pool, RoomRegistry& registry,
                const tcp::endpoint& endpoint)
-    : io_service_(io_service), strand_(strand), acceptor_(io_service, endpoint)
+    : pool_(pool),
+      registry_(registry),
+      acceptor_(pool.GetIoService())
 {
+    // Порт мог достаться от предыдущего процесса при перезапуске
+    Handoff::Get().Open(acceptor_, endpoint);
     Run();
 }
 
 void Server::Run() {
-    std::shared_ptr<PersonInRoom> new_participant(
-        new PersonInRoom(io_service_, strand_, room_));
+    // Каждая новая сессия живет в следующем io_service пула
+    std::shared_ptr<PersonInRoom> new_participant =
+        PersonInRoom::Create(pool_.GetIoService(), registry_);
+    // Акцептор обслуживает единственную операцию за раз, strand ему не нужен
     acceptor_.async_accept(
         new_participant->Socket(),
-        strand_.wrap(boost::bind(&Server::OnAccept, this, new_participant, _1)));
+        boost::bind(&Server::OnAccept, this, new_participant, _1));
 }
 
 void Server::OnAccept(
@@ -28,5 +34,8 @@ void Server::OnAccept(
         LOG_ERR("Error: " << error.message());
     }
 
-    Run();
+    // Акцептор закрыт: порт передан новому процессу
+    if (acceptor_.is_open()) {
+        Run();
+    }
 }
@@ -0,0 +1,52 @@
+// SessionSlab.cpp
+#include <new>
+#include "SessionSlab.hpp"
+
+// Блоки выравниваются как для любого объекта
+static const std::size_t SLAB_ALIGN = alignof(std::max_align_t);
+
+SessionSlab::SessionSlab(std::size_t chunk)
+    : chunk_(chunk),
+      block_size_(0),
+      free_(nullptr)
+{
+}
+
+void* SessionSlab::Allocate(std::size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (block_size_ == 0) {
+        block_size_ = (size + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+    }
+    if (size > block_size_) {
+        return ::operator new(size);
+    }
+
+    if (!free_) {
+        // Новый кусок слэба нарезается на блоки
+        char* chunk = static_cast<char*>(::operator new(chunk_ * block_size_));
+        chunks_.push_back(chunk);
+        for (std::size_t i = chunk_; i > 0; --i) {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + (i - 1) * block_size_);
+            block->next = free_;
+            free_ = block;
+        }
+    }
+
+    FreeBlock* block = free_;
+    free_ = block->next;
+    return block;
+}
+
+void SessionSlab::Free(void* pointer, std::size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (size > block_size_) {
+        ::operator delete(pointer);
+        return;
+    }
+
+    FreeBlock* block = static_cast<FreeBlock*>(pointer);
+    block->next = free_;
+    free_ = block;
+}
@@ -0,0 +1,69 @@
+// SessionSlab.hpp
+#ifndef SESSIONSLAB_HPP
+#define SESSIONSLAB_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "defs.hpp"
+
+/**
+   Слэб блоков одного размера: память выделяется кусками по chunk
+   блоков, освобожденные блоки возвращаются в список свободных и
+   отдаются следующим сессиям. Размер блока задает первое выделение,
+   запросы другого размера уходят в кучу.
+   Потокобезопасен: сессии создает акцептор, а разрушаются они
+   в рабочих потоках.
+*/
+class SessionSlab {
+public:
+    explicit SessionSlab(std::size_t chunk);
+    SessionSlab(const SessionSlab&) = delete;
+    SessionSlab& operator=(const SessionSlab&) = delete;
+
+    void* Allocate(std::size_t size);
+    void Free(void* block, std::size_t size);
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::mutex mutex_;
+    std::size_t chunk_;
+    std::size_t block_size_;
+    FreeBlock* free_;
+    std::vector<void*> chunks_;
+};
+
+/**
+   STL-аллокатор поверх SessionSlab, для std::allocate_shared:
+   объект сессии и его счетчик ссылок лежат в одном блоке слэба
+*/
+template <typename T>
+class SlabAllocator {
+public:
+    typedef T value_type;
+
+    explicit SlabAllocator(SessionSlab& slab) : slab_(&slab) {}
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>& other) : slab_(other.slab_) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(slab_->Allocate(sizeof(T) * n));
+    }
+    void deallocate(T* pointer, std::size_t n) {
+        slab_->Free(pointer, sizeof(T) * n);
+    }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U>& other) const { return slab_ == other.slab_; }
+    template <typename U>
+    bool operator!=(const SlabAllocator<U>& other) const { return slab_ != other.slab_; }
+
+private:
+    template <typename> friend class SlabAllocator;
+    SessionSlab* slab_;
+};
+
+#endif // SESSIONSLAB_HPP
@@ -0,0 +1,143 @@
+// ShmClient.cpp
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "ShmClient.hpp"
+
+ShmClient::ShmClient()
+    : socket_(-1),
+      server_event_(-1),
+      client_event_(-1),
+      region_(nullptr),
+      region_size_(0),
+      ring_bytes_(0),
+      scratch_(FRAME_V2_HEADER_SIZE + MAX_PACK_SIZE + FRAME_SEQ_SIZE)
+{
+}
+
+ShmClient::~ShmClient() {
+    if (region_) {
+        ::munmap(region_, region_size_);
+    }
+    for (int fd : {socket_, server_event_, client_event_}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+void ShmClient::Connect(const std::string& path) {
+    socket_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (socket_ < 0
+        || ::connect(socket_, reinterpret_cast<struct sockaddr*>(&address),
+                     sizeof(address)) != 0) {
+        throw std::runtime_error("shm connect " + path + ": " + std::strerror(errno));
+    }
+
+    // Одно сообщение: ShmHello и три дескриптора
+    ShmHello hello;
+    int fds[3] = {-1, -1, -1};
+    struct iovec iov = {&hello, sizeof(hello)};
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t received = ::recvmsg(socket_, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (received != static_cast<ssize_t>(sizeof(hello)) || !cmsg
+        || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        throw std::runtime_error("shm handshake failed");
+    }
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    server_event_ = fds[1];
+    client_event_ = fds[2];
+    if (hello.magic != SHM_HELLO_MAGIC || hello.ring_bytes == 0
+        || (hello.ring_bytes & (hello.ring_bytes - 1)) != 0) {
+        ::close(fds[0]);
+        throw std::runtime_error("shm handshake: bad hello");
+    }
+
+    ring_bytes_ = hello.ring_bytes;
+    std::size_t ring_size = ShmRing::RegionSize(ring_bytes_);
+    region_size_ = 2 * ring_size;
+    void* region = ::mmap(nullptr, region_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fds[0], 0);
+    ::close(fds[0]);
+    if (region == MAP_FAILED) {
+        throw std::runtime_error(std::string("shm mmap: ") + std::strerror(errno));
+    }
+    region_ = region;
+    // Первое кольцо - от клиента к серверу, второе - обратно
+    out_.Attach(region_, ring_bytes_, false);
+    in_.Attach(static_cast<unsigned char*>(region_) + ring_size, ring_bytes_, false);
+}
+
+int ShmClient::EventFd() const {
+    return client_event_;
+}
+
+bool ShmClient::Send(const unsigned char* frame, std::size_t size) {
+    if (!out_.Write(frame, FRAME_V2_HEADER_SIZE, frame + FRAME_V2_HEADER_SIZE,
+                    size - FRAME_V2_HEADER_SIZE)) {
+        return false;
+    }
+    if (out_.WakeReader()) {
+        Wake();
+    }
+    return true;
+}
+
+const unsigned char* ShmClient::Receive(std::size_t& size) {
+    std::size_t available = in_.Available();
+    if (available < FRAME_V2_HEADER_SIZE) {
+        return nullptr;
+    }
+    FrameV2Header header;
+    if (!DecodeFrameV2Header(in_.Peek(FRAME_V2_HEADER_SIZE, scratch_.data()), header)) {
+        throw std::runtime_error("shm ring: malformed frame");
+    }
+    size = FRAME_V2_HEADER_SIZE + header.length;
+    if (available < size) {
+        return nullptr;
+    }
+    return in_.Peek(size, scratch_.data());
+}
+
+void ShmClient::Release(std::size_t size) {
+    if (in_.Consume(size)) {
+        Wake();
+    }
+}
+
+bool ShmClient::PrepareWait(std::size_t space) {
+    if (!in_.WaitData()) {
+        return false;
+    }
+    return space == 0 || out_.WaitSpace(space);
+}
+
+void ShmClient::ClearEvent() {
+    uint64_t count;
+    while (::read(client_event_, &count, sizeof(count)) > 0) {
+    }
+}
+
+void ShmClient::Wake() {
+    uint64_t one = 1;
+    if (::write(server_event_, &one, sizeof(one)) < 0) {
+        throw std::runtime_error(std::string("shm eventfd: ") + std::strerror(errno));
+    }
+}
@@ -0,0 +1,58 @@
+// ShmClient.hpp
+#ifndef SHMCLIENT_HPP
+#define SHMCLIENT_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "ShmRing.hpp"
+#include "FrameV2.hpp"
+
+/**
+   Клиентская сторона локального транспорта (ShmSession): подключение
+   к --shm-socket сервера, прием колец и eventfd (ShmHello в Protocol.hpp)
+   и обмен кадрами v2 через кольца. Сама ничего не ждет: для цикла
+   событий клиента есть EventFd, который становится читаемым, когда
+   сервер положил кадры или освободил место. Однопоточная.
+*/
+class ShmClient {
+public:
+    ShmClient();
+    ~ShmClient();
+    ShmClient(const ShmClient&) = delete;
+    ShmClient& operator=(const ShmClient&) = delete;
+
+    // Исключение std::runtime_error, если подключиться не удалось
+    void Connect(const std::string& path);
+    int EventFd() const;
+
+    // Кладет кадр v2 (заголовок и payload подряд) в кольцо к серверу;
+    // false - места нет, повторить после пробуждения
+    bool Send(const unsigned char* frame, std::size_t size);
+    // Следующий целый кадр от сервера или nullptr. Кадр остается
+    // в кольце (или во внутреннем буфере) до Release(size)
+    const unsigned char* Receive(std::size_t& size);
+    void Release(std::size_t size);
+
+    // Перед ожиданием EventFd. space - сколько места нужно в кольце
+    // к серверу (0 - не нужно). false - ждать не надо, кадры или место
+    // уже есть
+    bool PrepareWait(std::size_t space);
+    // Сбрасывает счетчик EventFd после пробуждения
+    void ClearEvent();
+
+private:
+    void Wake();
+
+    int socket_;
+    int server_event_;
+    int client_event_;
+    void* region_;
+    std::size_t region_size_;
+    std::size_t ring_bytes_;
+    ShmRing out_;
+    ShmRing in_;
+    std::vector<unsigned char> scratch_;
+};
+
+#endif // SHMCLIENT_HPP
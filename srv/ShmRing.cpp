@@ -0,0 +1,107 @@
+// ShmRing.cpp
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include "ShmRing.hpp"
+
+std::size_t ShmRing::RegionSize(std::size_t capacity) {
+    return sizeof(ShmRingHeader) + capacity;
+}
+
+ShmRing::ShmRing()
+    : header_(nullptr),
+      data_(nullptr),
+      capacity_(0),
+      mask_(0)
+{
+}
+
+void ShmRing::Attach(void* region, std::size_t capacity, bool init) {
+    if (init) {
+        header_ = new (region) ShmRingHeader;
+        header_->head.store(0);
+        header_->tail.store(0);
+        header_->data_waiting.store(0);
+        header_->space_waiting.store(0);
+    } else {
+        header_ = static_cast<ShmRingHeader*>(region);
+    }
+    data_ = static_cast<unsigned char*>(region) + sizeof(ShmRingHeader);
+    capacity_ = capacity;
+    mask_ = capacity - 1;
+}
+
+bool ShmRing::Write(const unsigned char* first, std::size_t first_size,
+                    const unsigned char* second, std::size_t second_size)
+{
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    if (capacity_ - (head - tail) < first_size + second_size) {
+        return false;
+    }
+
+    const unsigned char* parts[2] = {first, second};
+    std::size_t sizes[2] = {first_size, second_size};
+    for (int i = 0; i < 2; ++i) {
+        std::size_t offset = head & mask_;
+        std::size_t chunk = std::min(sizes[i], capacity_ - offset);
+        std::memcpy(data_ + offset, parts[i], chunk);
+        std::memcpy(data_, parts[i] + chunk, sizes[i] - chunk);
+        head += sizes[i];
+    }
+    // seq_cst: запись head упорядочена с проверкой флага в WakeReader
+    header_->head.store(head);
+    return true;
+}
+
+bool ShmRing::WakeReader() {
+    return header_->data_waiting.load() != 0
+        && header_->data_waiting.exchange(0) != 0;
+}
+
+bool ShmRing::WaitSpace(std::size_t size) {
+    header_->space_waiting.store(1);
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    if (capacity_ - (head - header_->tail.load()) < size) {
+        return true;
+    }
+    // Место уже есть, спать не придется
+    header_->space_waiting.store(0, std::memory_order_relaxed);
+    return false;
+}
+
+std::size_t ShmRing::Used() const {
+    return header_->head.load(std::memory_order_relaxed)
+        - header_->tail.load(std::memory_order_relaxed);
+}
+
+std::size_t ShmRing::Available() const {
+    return header_->head.load(std::memory_order_acquire)
+        - header_->tail.load(std::memory_order_relaxed);
+}
+
+const unsigned char* ShmRing::Peek(std::size_t size, unsigned char* scratch) const {
+    std::size_t offset = header_->tail.load(std::memory_order_relaxed) & mask_;
+    if (offset + size <= capacity_) {
+        return data_ + offset;
+    }
+    std::size_t chunk = capacity_ - offset;
+    std::memcpy(scratch, data_ + offset, chunk);
+    std::memcpy(scratch + chunk, data_, size - chunk);
+    return scratch;
+}
+
+bool ShmRing::Consume(std::size_t size) {
+    header_->tail.store(header_->tail.load(std::memory_order_relaxed) + size);
+    return header_->space_waiting.load() != 0
+        && header_->space_waiting.exchange(0) != 0;
+}
+
+bool ShmRing::WaitData() {
+    header_->data_waiting.store(1);
+    if (header_->head.load() == header_->tail.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    header_->data_waiting.store(0, std::memory_order_relaxed);
+    return false;
+}
@@ -0,0 +1,68 @@
+// ShmRing.hpp
+#ifndef SHMRING_HPP
+#define SHMRING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+   Кольцо байт с одним писателем и одним читателем (SPSC) в общей
+   памяти двух процессов. По кольцу подряд идут кадры v2 (FrameV2.hpp),
+   кадр может переходить через конец кольца.
+   head - сколько байт записано за все время, tail - сколько прочитано,
+   оба только растут; емкость - степень двойки.
+   Сторона, которой нечего делать (читателю - нет данных, писателю -
+   места), выставляет флаг ожидания и засыпает на своем eventfd, а
+   другая сторона, продвинув свой счетчик, будит ее, только если флаг
+   выставлен: пока обе заняты, системных вызовов нет вовсе. Флаг
+   ставится до повторной проверки счетчика, а снимается будящей
+   стороной, поэтому пробуждение не теряется.
+*/
+struct ShmRingHeader {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> data_waiting;
+    std::atomic<uint32_t> space_waiting;
+};
+
+class ShmRing {
+public:
+    // Размер области кольца емкостью capacity: заголовок и данные
+    static std::size_t RegionSize(std::size_t capacity);
+
+    ShmRing();
+    // region - RegionSize(capacity) байт общей памяти; init - обнулить
+    // заголовок (это делает создающая сторона)
+    void Attach(void* region, std::size_t capacity, bool init);
+
+    // Писатель. Кладет кадр из двух частей (заголовок и payload) целиком
+    // или не кладет вовсе; false - не хватает места
+    bool Write(const unsigned char* first, std::size_t first_size,
+               const unsigned char* second, std::size_t second_size);
+    // После записей: true - читатель спит и его нужно разбудить
+    bool WakeReader();
+    // Перед сном: true - места под size байт по-прежнему нет, можно спать
+    bool WaitSpace(std::size_t size);
+    // Сколько байт записано и еще не прочитано (из любого потока)
+    std::size_t Used() const;
+
+    // Читатель. Сколько байт можно прочитать; больше емкости бывает,
+    // только если другая сторона испортила счетчики
+    std::size_t Available() const;
+    // size байт с начала непрочитанного: указатель в кольцо, а если
+    // они переходят через конец, - их копия в scratch
+    const unsigned char* Peek(std::size_t size, unsigned char* scratch) const;
+    // Освобождает size байт; true - писатель ждет места, его нужно разбудить
+    bool Consume(std::size_t size);
+    // Перед сном: true - данных по-прежнему нет, можно спать
+    bool WaitData();
+
+private:
+    ShmRingHeader* header_;
+    unsigned char* data_;
+    std::size_t capacity_;
+    std::size_t mask_;
+};
+
+#endif // SHMRING_HPP
@@ -0,0 +1,33 @@
+// ShmServer.cpp
+#include "ShmServer.hpp"
+
+ShmServer::ShmServer(IoServicePool& pool, RoomRegistry& registry,
+                     const boost::asio::local::stream_protocol::endpoint& endpoint)
+    : pool_(pool),
+      registry_(registry),
+      acceptor_(pool.GetIoService(), endpoint)
+{
+    Run();
+}
+
+void ShmServer::Run() {
+    // Сессии, как и TCP-сессии, раздаются по io_service пула по очереди
+    std::shared_ptr<ShmSession> session(
+        new ShmSession(pool_.GetIoService(), registry_));
+    acceptor_.async_accept(
+        session->GetSocket(),
+        boost::bind(&ShmServer::OnAccept, this, session, _1));
+}
+
+void ShmServer::OnAccept(std::shared_ptr<ShmSession> session,
+                         const boost::system::error_code& error)
+{
+    if (!error) {
+        LOG_ERR("Shared memory client accepted");
+        session->Start();
+    } else {
+        LOG_ERR("Error: " << error.message());
+    }
+
+    Run();
+}
@@ -0,0 +1,29 @@
+// ShmServer.hpp
+#ifndef SHMSERVER_HPP
+#define SHMSERVER_HPP
+
+#include <memory>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "IoServicePool.hpp"
+#include "ShmSession.hpp"
+#include "RoomRegistry.hpp"
+
+// Unix-сокет для клиентов на той же машине: каждое подключение
+// становится сессией ShmSession с кольцами в общей памяти
+class ShmServer {
+public:
+    ShmServer(IoServicePool& pool, RoomRegistry& registry,
+              const boost::asio::local::stream_protocol::endpoint& endpoint);
+
+private:
+    void Run();
+    void OnAccept(std::shared_ptr<ShmSession> session,
+                  const boost::system::error_code& error);
+
+    IoServicePool& pool_;
+    RoomRegistry& registry_;
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+};
+
+#endif // SHMSERVER_HPP
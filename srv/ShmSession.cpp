@@ -0,0 +1,506 @@
+// ShmSession.cpp
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ShmSession.hpp"
+#include "Tracer.hpp"
+
+ShmSession::ShmSession(boost::asio::io_service& io_service, RoomRegistry& registry)
+    : socket_(io_service),
+      strand_(io_service),
+      registry_(registry),
+      worker_(registry.Pool().IndexOf(io_service)),
+      started_(false),
+      closed_(false),
+      draining_(false),
+      region_(nullptr),
+      region_size_(0),
+      event_(io_service),
+      client_event_(-1),
+      event_count_(0),
+      socket_byte_(0),
+      scratch_(FRAME_V2_HEADER_SIZE + MAX_PACK_SIZE + FRAME_SEQ_SIZE),
+      has_fingerprint_(false),
+      backlog_bytes_(0),
+      snapshot_frames_(0),
+      snapshot_bytes_(0)
+{
+}
+
+ShmSession::~ShmSession() {
+    if (region_) {
+        ::munmap(region_, region_size_);
+    }
+    if (client_event_ >= 0) {
+        ::close(client_event_);
+    }
+    if (started_) {
+        Metrics::Get().RecordSessionEnd();
+    }
+}
+
+ParticipantStats ShmSession::Stats() const {
+    // Кольца появляются в Setup, до входа в какую-либо комнату
+    return ParticipantStats{
+        "shm", worker_, snapshot_frames_.load(std::memory_order_relaxed),
+        snapshot_bytes_.load(std::memory_order_relaxed) + out_.Used()};
+}
+
+ShmSession::Socket& ShmSession::GetSocket() {
+    return socket_;
+}
+
+std::size_t ShmSession::Worker() const {
+    return worker_;
+}
+
+void ShmSession::Drain() {
+    strand_.post(boost::bind(&ShmSession::DrainImpl, shared_from_this()));
+}
+
+void ShmSession::DrainImpl() {
+    if (draining_ || closed_) {
+        return;
+    }
+    draining_ = true;
+    DeliverImpl();
+    for (auto& room : rooms_) {
+        room.second->Leave(shared_from_this());
+        registry_.Release(room.second);
+    }
+    rooms_.clear();
+    // Кадры, уже лежащие в кольце, клиент дочитает и после закрытия
+    if (backlog_.empty() && !closed_) {
+        Close();
+    }
+}
+
+void ShmSession::Start() {
+    started_ = true;
+    Metrics::Get().RecordAccept();
+    strand_.dispatch(boost::bind(&ShmSession::StartImpl, shared_from_this()));
+}
+
+void ShmSession::StartImpl() {
+    if (!Setup()) {
+        LOG_MSG("Shared memory session setup failed: " << std::strerror(errno));
+        Close();
+        return;
+    }
+    WaitEvent();
+    WaitSocket();
+}
+
+bool ShmSession::Setup() {
+    std::size_t ring_size = ShmRing::RegionSize(SHM_RING_BYTES);
+    int memfd = ::memfd_create("chat_shm", MFD_CLOEXEC);
+    if (memfd < 0) {
+        return false;
+    }
+    region_size_ = 2 * ring_size;
+    void* region = MAP_FAILED;
+    if (::ftruncate(memfd, region_size_) == 0) {
+        region = ::mmap(nullptr, region_size_, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    }
+    int server_event = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    client_event_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (region == MAP_FAILED || server_event < 0 || client_event_ < 0) {
+        if (server_event >= 0) {
+            ::close(server_event);
+        }
+        ::close(memfd);
+        return false;
+    }
+    region_ = region;
+    in_.Attach(region_, SHM_RING_BYTES, true);
+    out_.Attach(static_cast<unsigned char*>(region_) + ring_size, SHM_RING_BYTES, true);
+    event_.assign(server_event);
+
+    // Кольца и оба eventfd уходят клиенту одним сообщением
+    ShmHello hello{SHM_HELLO_MAGIC, SHM_RING_BYTES};
+    int fds[3] = {memfd, server_event, client_event_};
+    struct iovec iov = {&hello, sizeof(hello)};
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    std::memset(&control, 0, sizeof(control));
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent = ::sendmsg(socket_.native_handle(), &msg, MSG_NOSIGNAL);
+    // Отображение остается, дескриптор memfd больше не нужен
+    ::close(memfd);
+    return sent == static_cast<ssize_t>(sizeof(hello));
+}
+
+void ShmSession::WaitEvent() {
+    // После Drain кольцо клиента не читается: ждем только, когда он
+    // освободит место в своем
+    if (!draining_ && !in_.WaitData()) {
+        // Клиент пишет без пауз: следующая порция - после других
+        // обработчиков потока, а не в этом же вызове
+        strand_.post(MakeAllocHandler(
+            event_memory_,
+            boost::bind(&ShmSession::OnEvent, shared_from_this(),
+                        boost::system::error_code())));
+        return;
+    }
+    event_.async_read_some(
+        boost::asio::buffer(&event_count_, sizeof(event_count_)),
+        strand_.wrap(MakeAllocHandler(
+            event_memory_,
+            boost::bind(&ShmSession::OnEvent, shared_from_this(), _1))));
+}
+
+void ShmSession::OnEvent(const boost::system::error_code& error) {
+    if (closed_) {
+        return;
+    }
+    if (error) {
+        LOG_ERR("Shared memory event error: " << error.message());
+        Close();
+        return;
+    }
+
+    if (!draining_ && registry_.Draining()) {
+        // Сессия вне комнат узнает о перезапуске здесь
+        DrainImpl();
+    }
+
+    // Клиент либо положил кадры, либо освободил место в своем кольце
+    if (!draining_ && !ReadFrames()) {
+        return;
+    }
+    if (!backlog_.empty()) {
+        Flush();
+    }
+    if (draining_ && backlog_.empty()) {
+        Close();
+        return;
+    }
+    WaitEvent();
+}
+
+void ShmSession::WaitSocket() {
+    // Клиент ничего не шлет в сокет, чтение завершится с его закрытием
+    socket_.async_read_some(
+        boost::asio::buffer(&socket_byte_, 1),
+        strand_.wrap(MakeAllocHandler(
+            socket_memory_,
+            boost::bind(&ShmSession::OnSocket, shared_from_this(), _1))));
+}
+
+void ShmSession::OnSocket(const boost::system::error_code& error) {
+    if (closed_) {
+        return;
+    }
+    if (error) {
+        LOG_ERR("Shared memory client disconnected: " << error.message());
+        Close();
+        return;
+    }
+    WaitSocket();
+}
+
+bool ShmSession::ReadFrames() {
+    // За один вызов - не больше одного кольца, чтобы поток не застревал
+    // на клиенте, который пишет без остановки
+    std::size_t budget = SHM_RING_BYTES;
+    std::size_t frames = 0;
+    std::size_t bytes = 0;
+    bool wake = false;
+
+    while (bytes < budget) {
+        std::size_t available = in_.Available();
+        if (available > SHM_RING_BYTES) {
+            LOG_MSG("Shared memory client corrupted its ring, closing");
+            Close();
+            return false;
+        }
+        if (available < FRAME_V2_HEADER_SIZE) {
+            break;
+        }
+
+        unsigned char head[FRAME_V2_HEADER_SIZE];
+        std::memcpy(head, in_.Peek(FRAME_V2_HEADER_SIZE, scratch_.data()),
+                    FRAME_V2_HEADER_SIZE);
+        FrameV2Header header;
+        if (!DecodeFrameV2Header(head, header)) {
+            LOG_MSG("Shared memory client sent a malformed frame, closing");
+            Close();
+            return false;
+        }
+        std::size_t size = FRAME_V2_HEADER_SIZE + header.length;
+        if (available < size) {
+            break;
+        }
+        // Заголовок взят из копии: клиент мог изменить его после проверки
+        const unsigned char* frame = in_.Peek(size, scratch_.data());
+        const unsigned char* payload = frame + FRAME_V2_HEADER_SIZE;
+        if (!CheckFrameV2Crc(head, header, payload)) {
+            Metrics::Get().RecordCrcError();
+            LOG_MSG("Shared memory frame crc mismatch, closing");
+            Close();
+            return false;
+        }
+
+        HandleRoomOp(header.op, header.room, payload, header.length);
+        if (closed_) {
+            return false;
+        }
+        wake = in_.Consume(size) || wake;
+        ++frames;
+        bytes += size;
+    }
+
+    if (bytes > 0) {
+        Metrics::Get().RecordRead(bytes);
+    }
+    if (wake) {
+        Wake(client_event_);
+    }
+    return true;
+}
+
+void ShmSession::HandleRoomOp(uint8_t op, uint32_t room_id,
+                              const unsigned char* payload, std::size_t size)
+{
+    switch (op) {
+    case ROOM_MSG: {
+        std::shared_ptr<ChatRoom> room = JoinRoom(room_id);
+        if (room) {
+            room->Broadcast(payload, size, false);
+        }
+        break;
+    }
+    case ROOM_JOIN:
+        JoinRoom(room_id);
+        break;
+    case ROOM_LEAVE:
+        LeaveRoom(room_id);
+        break;
+    case ROOM_HELLO:
+        if (size != FINGERPRINT_SIZE || has_fingerprint_) {
+            LOG_ERR("Bad hello, payload size: " << size);
+            break;
+        }
+        std::copy(payload, payload + FINGERPRINT_SIZE, fingerprint_.begin());
+        has_fingerprint_ = true;
+        for (auto& room : rooms_) {
+            room.second->Register(shared_from_this(), fingerprint_);
+        }
+        break;
+    case ROOM_ROUTED: {
+        if (size < FINGERPRINT_SIZE) {
+            LOG_ERR("Routed frame without recipient, size: " << size);
+            break;
+        }
+        Fingerprint recipient;
+        std::copy(payload, payload + FINGERPRINT_SIZE, recipient.begin());
+        std::shared_ptr<ChatRoom> room = JoinRoom(room_id);
+        if (room) {
+            room->Route(recipient, payload + FINGERPRINT_SIZE, size - FINGERPRINT_SIZE,
+                        false);
+        }
+        break;
+    }
+    case ROOM_RESUME: {
+        if (size != FRAME_SEQ_SIZE) {
+            LOG_ERR("Bad resume, payload size: " << size);
+            break;
+        }
+        uint64_t last_seq = 0;
+        for (std::size_t i = 0; i < FRAME_SEQ_SIZE; ++i) {
+            last_seq |= static_cast<uint64_t>(payload[i]) << (i * 8);
+        }
+        JoinRoom(room_id, last_seq);
+        break;
+    }
+    default:
+        LOG_ERR("Unknown room op: " << static_cast<int>(op));
+        break;
+    }
+}
+
+std::shared_ptr<ChatRoom> ShmSession::JoinRoom(uint32_t room_id, uint64_t last_seq) {
+    auto it = rooms_.find(room_id);
+    if (it != rooms_.end()) {
+        if (last_seq != 0) {
+            it->second->Enter(shared_from_this(), "ParticipantNickname", last_seq);
+        }
+        return it->second;
+    }
+
+    if (rooms_.size() >= Config::Get().session_rooms_max.load(std::memory_order_relaxed)) {
+        LOG_ERR("Session is in too many rooms, join to " << room_id << " refused");
+        Metrics::Get().RecordRoomRejected();
+        return nullptr;
+    }
+    std::shared_ptr<ChatRoom> room = registry_.Get(room_id);
+    if (!room) {
+        return nullptr;
+    }
+    rooms_[room_id] = room;
+    room->Enter(shared_from_this(), "ParticipantNickname", last_seq);
+    if (has_fingerprint_) {
+        room->Register(shared_from_this(), fingerprint_);
+    }
+    return room;
+}
+
+void ShmSession::LeaveRoom(uint32_t room_id) {
+    auto it = rooms_.find(room_id);
+    if (it != rooms_.end()) {
+        it->second->Leave(shared_from_this());
+        registry_.Release(it->second);
+        rooms_.erase(it);
+    }
+}
+
+void ShmSession::OnMessage(const SharedFrame& frame) {
+    Deliver(&frame, &frame + 1);
+}
+
+void ShmSession::OnMessages(const std::vector<SharedFrame>& frames) {
+    Deliver(frames.begin(), frames.end());
+}
+
+template <typename Iterator>
+void ShmSession::Deliver(Iterator begin, Iterator end) {
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        schedule = inbox_.empty();
+        inbox_.insert(inbox_.end(), begin, end);
+    }
+
+    if (schedule) {
+        strand_.post(MakeAllocHandler(
+            deliver_memory_,
+            boost::bind(&ShmSession::DeliverImpl, shared_from_this())));
+    }
+}
+
+void ShmSession::DeliverImpl() {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        inbox_.swap(delivering_);
+    }
+
+    // Пока очередь пуста, кадр копируется сразу в кольцо клиента
+    Config& config = Config::Get();
+    bool wrote = false;
+    for (const auto& frame : delivering_) {
+        if (closed_) {
+            break;
+        }
+        if (backlog_.empty() && WriteFrame(frame)) {
+            wrote = true;
+            continue;
+        }
+        std::size_t size = frame->WireSize(WireV2);
+        if (backlog_.size() >= config.send_queue_max_frames.load(std::memory_order_relaxed)
+            || backlog_bytes_ + size > config.send_queue_max_bytes.load(std::memory_order_relaxed)) {
+            LOG_MSG("Slow shared memory consumer disconnected, queued: "
+                    << backlog_.size() << " frames");
+            Metrics::Get().RecordOverflow();
+            Metrics::Get().RecordDisconnect();
+            Close();
+            break;
+        }
+        backlog_.push_back(frame);
+        backlog_bytes_ += size;
+    }
+    delivering_.clear();
+    snapshot_frames_.store(backlog_.size(), std::memory_order_relaxed);
+    snapshot_bytes_.store(backlog_bytes_, std::memory_order_relaxed);
+
+    if (wrote && out_.WakeReader()) {
+        Wake(client_event_);
+    }
+    if (!backlog_.empty() && !closed_) {
+        Flush();
+    }
+}
+
+void ShmSession::Flush() {
+    bool wrote = false;
+    while (!backlog_.empty()) {
+        std::size_t size = backlog_.front()->WireSize(WireV2);
+        if (!WriteFrame(backlog_.front())) {
+            // Клиент разбудит нас, освободив место
+            if (out_.WaitSpace(size)) {
+                break;
+            }
+            continue;
+        }
+        backlog_bytes_ -= size;
+        backlog_.pop_front();
+        wrote = true;
+    }
+    snapshot_frames_.store(backlog_.size(), std::memory_order_relaxed);
+    snapshot_bytes_.store(backlog_bytes_, std::memory_order_relaxed);
+    if (wrote && out_.WakeReader()) {
+        Wake(client_event_);
+    }
+}
+
+bool ShmSession::WriteFrame(const SharedFrame& frame) {
+    int64_t start = frame->TraceId() != 0 ? Metrics::NowNs() : 0;
+    if (!out_.Write(frame->Header(WireV2), frame->HeaderSize(WireV2),
+                    frame->Payload(), frame->PayloadSize())) {
+        return false;
+    }
+    if (frame->BroadcastNs() != 0) {
+        Metrics::Get().RecordBroadcastToWrite(Metrics::NowNs() - frame->BroadcastNs());
+    }
+    if (start != 0) {
+        // Запись в кольцо - это копирование, отрезок write здесь короткий
+        uint64_t session = reinterpret_cast<uintptr_t>(this);
+        if (frame->BroadcastNs() != 0) {
+            Tracer::Span("queued", frame->TraceId(), frame->RoomId(), session,
+                         frame->BroadcastNs(), start);
+        }
+        Tracer::Span("write", frame->TraceId(), frame->RoomId(), session,
+                     start, Metrics::NowNs());
+    }
+    return true;
+}
+
+void ShmSession::Wake(int fd) {
+    uint64_t one = 1;
+    // eventfd не переполнится: счетчик обнуляет каждое чтение
+    if (::write(fd, &one, sizeof(one)) < 0) {
+        LOG_ERR("eventfd write failed: " << std::strerror(errno));
+    }
+}
+
+void ShmSession::Close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+    event_.close(ignored);
+    backlog_.clear();
+    backlog_bytes_ = 0;
+
+    for (auto& room : rooms_) {
+        room.second->Leave(shared_from_this());
+        registry_.Release(room.second);
+    }
+    rooms_.clear();
+}
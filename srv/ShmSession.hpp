@@ -0,0 +1,120 @@
+// ShmSession.hpp
+#ifndef SHMSESSION_HPP
+#define SHMSESSION_HPP
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "ChatRoom.hpp"
+#include "RoomRegistry.hpp"
+#include "ShmRing.hpp"
+#include "HandlerAllocator.hpp"
+
+/**
+   Сессия клиента на той же машине (бота, моста) через общую память
+   вместо TCP. При подключении к unix-сокету сессия создает memfd
+   с парой колец ShmRing и два eventfd и передает их клиенту
+   (ShmHello в Protocol.hpp). Дальше кадры v2 идут по кольцам: кадр
+   рассылки копируется прямо из общего Frame в кольцо клиента, без
+   сокета и системных вызовов, пока клиент не спит.
+   Для комнат это обычный Participant. Кадры клиента разбираются так
+   же, как у PersonInRoom (op из RoomOp), но сессия сразу говорит v2,
+   не входит в комнату по умолчанию сама и не ограничивается ведрами:
+   локальные клиенты свои. Если кольцо клиента полно, кадры ждут
+   в очереди сессии; сверх пределов send_queue_max_* сессия закрывается.
+   Все, кроме OnMessage(s), выполняется в strand сессии.
+*/
+class ShmSession : public Participant,
+                   public std::enable_shared_from_this<ShmSession>
+{
+public:
+    typedef boost::asio::local::stream_protocol::socket Socket;
+
+    ShmSession(boost::asio::io_service& io_service, RoomRegistry& registry);
+    ~ShmSession();
+
+    Socket& GetSocket();
+    // Соединение принято: создать кольца, отдать их клиенту и начать работу
+    void Start();
+    void OnMessage(const SharedFrame& frame) override;
+    void OnMessages(const std::vector<SharedFrame>& frames) override;
+    std::size_t Worker() const override;
+    // Очередь - кадры в ожидании места и байты в кольце клиента
+    ParticipantStats Stats() const override;
+    void Drain() override;
+
+private:
+    void StartImpl();
+    // Создает memfd и eventfd и отправляет их клиенту; false - не вышло
+    bool Setup();
+    // Засыпает на eventfd, если в кольце клиента нет кадров
+    void WaitEvent();
+    void OnEvent(const boost::system::error_code& error);
+    void WaitSocket();
+    void OnSocket(const boost::system::error_code& error);
+    // Разбирает все кадры кольца клиента; false - сессия закрыта
+    bool ReadFrames();
+    void HandleRoomOp(uint8_t op, uint32_t room_id,
+                      const unsigned char* payload, std::size_t size);
+    std::shared_ptr<ChatRoom> JoinRoom(uint32_t room_id, uint64_t last_seq = 0);
+    void LeaveRoom(uint32_t room_id);
+    template <typename Iterator>
+    void Deliver(Iterator begin, Iterator end);
+    void DeliverImpl();
+    // Кладет в кольцо клиента очередь сессии, сколько поместится
+    void Flush();
+    bool WriteFrame(const SharedFrame& frame);
+    void Wake(int fd);
+    void Close();
+    // Перезапуск: выйти из комнат, не читать кольцо клиента и закрыться,
+    // когда очередь сессии целиком ляжет в его кольцо
+    void DrainImpl();
+
+    Socket socket_;
+    boost::asio::io_service::strand strand_;
+    RoomRegistry& registry_;
+    std::size_t worker_;
+    bool started_;
+    bool closed_;
+    bool draining_;
+
+    // Общая память: кольцо от клиента и кольцо к клиенту
+    void* region_;
+    std::size_t region_size_;
+    ShmRing in_;
+    ShmRing out_;
+    // eventfd сессии (его пишет клиент) и клиента (его пишем мы)
+    boost::asio::posix::stream_descriptor event_;
+    int client_event_;
+    uint64_t event_count_;
+    char socket_byte_;
+    // Кадр, перешедший через конец кольца, собирается здесь
+    std::vector<unsigned char> scratch_;
+
+    std::unordered_map<uint32_t, std::shared_ptr<ChatRoom>> rooms_;
+    bool has_fingerprint_;
+    Fingerprint fingerprint_;
+
+    // Кадры, которым не хватило места в кольце клиента
+    std::deque<SharedFrame> backlog_;
+    std::size_t backlog_bytes_;
+    // Размер backlog_ для Stats из чужого потока
+    std::atomic<std::size_t> snapshot_frames_;
+    std::atomic<std::size_t> snapshot_bytes_;
+
+    // Входящие кадры от комнат, как у PersonInRoom
+    std::mutex inbox_mutex_;
+    std::vector<SharedFrame> inbox_;
+    std::vector<SharedFrame> delivering_;
+
+    HandlerMemory event_memory_;
+    HandlerMemory socket_memory_;
+    HandlerMemory deliver_memory_;
+};
+
+#endif // SHMSESSION_HPP
@@ -0,0 +1,72 @@
+// StatsServer.cpp
+#include <sstream>
+#include "StatsServer.hpp"
+#include "Handoff.hpp"
+
+// TCP-порт передается новому процессу при перезапуске,
+// unix-сокет новый процесс создает сам
+static void OpenAcceptor(boost::asio::ip::tcp::acceptor& acceptor,
+                         const boost::asio::ip::tcp::endpoint& endpoint)
+{
+    Handoff::Get().Open(acceptor, endpoint);
+}
+
+static void OpenAcceptor(boost::asio::local::stream_protocol::acceptor& acceptor,
+                         const boost::asio::local::stream_protocol::endpoint& endpoint)
+{
+    acceptor.open(endpoint.protocol());
+    acceptor.bind(endpoint);
+    acceptor.listen();
+}
+
+template <typename Protocol>
+StatsServer<Protocol>::StatsServer(boost::asio::io_service& io_service,
+                                   const typename Protocol::endpoint& endpoint)
+    : acceptor_(io_service)
+{
+    OpenAcceptor(acceptor_, endpoint);
+    Accept();
+}
+
+template <typename Protocol>
+void StatsServer<Protocol>::Accept() {
+    std::shared_ptr<Socket> socket(new Socket(acceptor_.get_executor()));
+    acceptor_.async_accept(
+        *socket, boost::bind(&StatsServer::OnAccept, this, socket, _1));
+}
+
+template <typename Protocol>
+void StatsServer<Protocol>::OnAccept(std::shared_ptr<Socket> socket,
+                                     const boost::system::error_code& error)
+{
+    if (!error) {
+        // Снимок счетчиков целиком, пишется одним async_write
+        std::ostringstream out;
+        Metrics::Get().Dump(out);
+        std::shared_ptr<std::string> text(new std::string(out.str()));
+        boost::asio::async_write(
+            *socket, boost::asio::buffer(*text),
+            boost::bind(&StatsServer::OnWrite, socket, text, _1));
+    } else {
+        LOG_ERR("Stats accept error: " << error.message());
+    }
+
+    if (acceptor_.is_open()) {
+        Accept();
+    }
+}
+
+template <typename Protocol>
+void StatsServer<Protocol>::OnWrite(std::shared_ptr<Socket> socket,
+                                    std::shared_ptr<std::string> /* text */,
+                                    const boost::system::error_code& /* error */)
+{
+    // text держал буфер записи живым до этого момента; ошибка записи
+    // ничего не меняет: соединение закрывается в любом случае
+    boost::system::error_code ignored;
+    socket->shutdown(Socket::shutdown_both, ignored);
+    socket->close(ignored);
+}
+
+template class StatsServer<boost::asio::ip::tcp>;
+template class StatsServer<boost::asio::local::stream_protocol>;
@@ -0,0 +1,41 @@
+// StatsServer.hpp
+#ifndef STATSSERVER_HPP
+#define STATSSERVER_HPP
+
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+/**
+   Отдельный локальный сокет со счетчиками сервера. Каждое подключение
+   получает текущий Metrics::Dump ("имя значение" построчно), после чего
+   соединение закрывается, так что снять метрики можно, например,
+   через nc 127.0.0.1 PORT или nc -U PATH.
+   Protocol - boost::asio::ip::tcp или boost::asio::local::stream_protocol.
+*/
+template <typename Protocol>
+class StatsServer {
+public:
+    StatsServer(boost::asio::io_service& io_service,
+                const typename Protocol::endpoint& endpoint);
+
+private:
+    typedef typename Protocol::socket Socket;
+
+    void Accept();
+    void OnAccept(std::shared_ptr<Socket> socket,
+                  const boost::system::error_code& error);
+    static void OnWrite(std::shared_ptr<Socket> socket,
+                        std::shared_ptr<std::string> text,
+                        const boost::system::error_code& error);
+
+    typename Protocol::acceptor acceptor_;
+};
+
+typedef StatsServer<boost::asio::ip::tcp> TcpStatsServer;
+typedef StatsServer<boost::asio::local::stream_protocol> LocalStatsServer;
+
+#endif // STATSSERVER_HPP
@@ -0,0 +1,154 @@
+// TimingWheel.cpp
+#include <algorithm>
+#include "TimingWheel.hpp"
+
+TimerEntry::TimerEntry()
+    : prev_(nullptr),
+      next_(nullptr),
+      expires_(0)
+{
+}
+
+TimerEntry::~TimerEntry() {
+}
+
+bool TimerEntry::Armed() const {
+    return prev_ != nullptr;
+}
+
+boost::asio::io_service::id TimingWheel::id;
+
+TimingWheel::TimingWheel(boost::asio::io_service& io_service)
+    : boost::asio::io_service::service(io_service),
+      slots_(TIMER_WHEEL_SLOTS),
+      start_(std::chrono::steady_clock::now()),
+      processed_(0),
+      size_(0),
+      ticking_(false),
+      timer_(io_service)
+{
+    // Пустая ячейка - кольцо из одного заголовка
+    for (auto& head : slots_) {
+        head.prev_ = head.next_ = &head;
+    }
+}
+
+TimingWheel::~TimingWheel() {
+}
+
+void TimingWheel::shutdown() {
+    // io_service разрушается: отпускаем владельцев всех элементов
+    for (auto& head : slots_) {
+        while (head.next_ != &head) {
+            TimerEntry& entry = *head.next_;
+            Unlink(entry);
+            entry.owner_.reset();
+        }
+    }
+    size_ = 0;
+    boost::system::error_code ignored;
+    timer_.cancel(ignored);
+}
+
+uint64_t TimingWheel::CurrentTick() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_).count() / TIMER_WHEEL_TICK_MS;
+}
+
+void TimingWheel::Link(TimerEntry& entry, TimerEntry& head) {
+    entry.prev_ = &head;
+    entry.next_ = head.next_;
+    head.next_->prev_ = &entry;
+    head.next_ = &entry;
+}
+
+void TimingWheel::Unlink(TimerEntry& entry) {
+    entry.prev_->next_ = entry.next_;
+    entry.next_->prev_ = entry.prev_;
+    entry.prev_ = entry.next_ = nullptr;
+}
+
+void TimingWheel::Schedule(TimerEntry& entry, std::shared_ptr<void> owner,
+                           std::chrono::milliseconds after)
+{
+    if (entry.Armed()) {
+        Unlink(entry);
+        --size_;
+    }
+    if (!ticking_) {
+        StartTicking();
+    }
+
+    // Округляем вверх: элемент не срабатывает раньше срока
+    uint64_t ticks = (after.count() + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+    entry.expires_ = std::max(CurrentTick() + ticks, processed_ + 1);
+    entry.owner_ = std::move(owner);
+    Link(entry, slots_[entry.expires_ % TIMER_WHEEL_SLOTS]);
+    ++size_;
+}
+
+void TimingWheel::Cancel(TimerEntry& entry) {
+    if (entry.Armed()) {
+        Unlink(entry);
+        --size_;
+        entry.owner_.reset();
+    }
+}
+
+std::size_t TimingWheel::Size() const {
+    return size_;
+}
+
+void TimingWheel::StartTicking() {
+    // Пока колесо стояло, обрабатывать было нечего
+    processed_ = CurrentTick();
+    ticking_ = true;
+    timer_.expires_after(std::chrono::milliseconds(TIMER_WHEEL_TICK_MS));
+    timer_.async_wait(MakeAllocHandler(
+        timer_memory_, boost::bind(&TimingWheel::OnTick, this, _1)));
+}
+
+void TimingWheel::OnTick(const boost::system::error_code& error) {
+    if (error) {
+        ticking_ = false;
+        return;
+    }
+
+    // Обрабатываем все тики до текущего, даже если поток отстал
+    uint64_t now = CurrentTick();
+    while (processed_ < now) {
+        ++processed_;
+        Head& head = slots_[processed_ % TIMER_WHEEL_SLOTS];
+
+        // Сработавшие элементы сначала переносим в отдельный список:
+        // OnTimer может перевзвести свой элемент в эту же ячейку
+        Head expired;
+        expired.prev_ = expired.next_ = &expired;
+        TimerEntry* entry = head.next_;
+        while (entry != &head) {
+            TimerEntry* next = entry->next_;
+            if (entry->expires_ <= processed_) {
+                Unlink(*entry);
+                Link(*entry, expired);
+            }
+            entry = next;
+        }
+
+        while (expired.next_ != &expired) {
+            TimerEntry& fired = *expired.next_;
+            Unlink(fired);
+            --size_;
+            // Владелец живет, пока идет OnTimer
+            std::shared_ptr<void> owner = std::move(fired.owner_);
+            fired.OnTimer();
+        }
+    }
+
+    if (size_ == 0) {
+        ticking_ = false;
+        return;
+    }
+    timer_.expires_at(timer_.expiry() + std::chrono::milliseconds(TIMER_WHEEL_TICK_MS));
+    timer_.async_wait(MakeAllocHandler(
+        timer_memory_, boost::bind(&TimingWheel::OnTick, this, _1)));
+}
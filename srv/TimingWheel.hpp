@@ -0,0 +1,92 @@
+// TimingWheel.hpp
+#ifndef TIMINGWHEEL_HPP
+#define TIMINGWHEEL_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "HandlerAllocator.hpp"
+#include "defs.hpp"
+
+class TimingWheel;
+
+/**
+   Элемент колеса: встраивается в объект, которому нужен тайм-аут.
+   Пока элемент взведен, колесо держит owner, переданный в Schedule,
+   так что объект не разрушится раньше срабатывания или отмены.
+*/
+class TimerEntry {
+public:
+    TimerEntry();
+    TimerEntry(const TimerEntry&) = delete;
+    TimerEntry& operator=(const TimerEntry&) = delete;
+
+    bool Armed() const;
+
+    // Вызывается из потока io_service колеса, элемент уже снят
+    virtual void OnTimer() = 0;
+
+protected:
+    virtual ~TimerEntry();
+
+private:
+    friend class TimingWheel;
+
+    TimerEntry* prev_;
+    TimerEntry* next_;
+    uint64_t expires_;
+    std::shared_ptr<void> owner_;
+};
+
+/**
+   Хешированное колесо таймеров, одно на io_service (сервис asio,
+   use_service<TimingWheel>). Один steady_timer тикает раз в
+   TIMER_WHEEL_TICK_MS, пока в колесе есть элементы; элемент лежит
+   в ячейке номер (тик срабатывания % TIMER_WHEEL_SLOTS), длинные
+   тайм-ауты просто переживают несколько оборотов. Schedule и Cancel -
+   O(1), без выделения памяти и без системных вызовов.
+   Колесо не потокобезопасно: вызывать только из потока своего
+   io_service (в IoServicePool у каждого io_service ровно один поток).
+*/
+class TimingWheel : public boost::asio::io_service::service {
+public:
+    static boost::asio::io_service::id id;
+
+    explicit TimingWheel(boost::asio::io_service& io_service);
+    ~TimingWheel();
+
+    // Взводит (или перевзводит) элемент на срок не меньше after
+    void Schedule(TimerEntry& entry, std::shared_ptr<void> owner,
+                  std::chrono::milliseconds after);
+    void Cancel(TimerEntry& entry);
+
+    std::size_t Size() const;
+
+private:
+    void shutdown() override;
+
+    uint64_t CurrentTick() const;
+    void Link(TimerEntry& entry, TimerEntry& head);
+    static void Unlink(TimerEntry& entry);
+    void StartTicking();
+    void OnTick(const boost::system::error_code& error);
+
+    // Заголовки списков ячеек; сами они в списках не участвуют
+    struct Head : TimerEntry {
+        void OnTimer() override {}
+    };
+
+    std::vector<Head> slots_;
+    std::chrono::steady_clock::time_point start_;
+    // Последний обработанный тик
+    uint64_t processed_;
+    std::size_t size_;
+    bool ticking_;
+    boost::asio::steady_timer timer_;
+    HandlerMemory timer_memory_;
+};
+
+#endif // TIMINGWHEEL_HPP
@@ -0,0 +1,30 @@
+// TokenBucket.cpp
+#include <algorithm>
+#include "TokenBucket.hpp"
+
+static const int64_t NS_PER_SECOND = 1000000000;
+
+TokenBucket::TokenBucket()
+    : full_at_ns_(0)
+{
+}
+
+int64_t TokenBucket::Take(uint64_t cost, uint64_t rate, int64_t now_ns) {
+    if (rate == 0) {
+        return 0;
+    }
+
+    // Каждый токен отодвигает момент наполнения на 1/rate секунды,
+    // полное ведро - это момент в прошлом
+    int64_t cost_ns = static_cast<int64_t>(cost * NS_PER_SECOND / rate);
+    int64_t full_at = full_at_ns_.load(std::memory_order_relaxed);
+    int64_t next;
+    do {
+        next = std::max(full_at, now_ns) + cost_ns;
+    } while (!full_at_ns_.compare_exchange_weak(full_at, next,
+                                                std::memory_order_relaxed));
+
+    // Ведро пусто, когда до наполнения больше секунды
+    int64_t wait = next - now_ns - NS_PER_SECOND;
+    return wait > 0 ? wait : 0;
+}
@@ -0,0 +1,30 @@
+// TokenBucket.hpp
+#ifndef TOKENBUCKET_HPP
+#define TOKENBUCKET_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/**
+   Ведро токенов со скоростью rate токенов в секунду и емкостью
+   в одну секунду (rate токенов). Вместо числа токенов хранится
+   момент, когда ведро снова будет полным (GCRA): это одно атомарное
+   поле, так что ведро комнаты делят потоки всех ее участников
+   без мьютекса.
+   Take списывает токены в долг: кадры уже прочитаны и должны уйти,
+   а пока долг не погашен, отправитель просто не читает дальше.
+*/
+class TokenBucket {
+public:
+    TokenBucket();
+
+    // Списывает cost токенов в момент now_ns (Metrics::NowNs).
+    // Возвращает, сколько наносекунд ждать погашения долга,
+    // 0 - токены еще есть или rate == 0 (без ограничения)
+    int64_t Take(uint64_t cost, uint64_t rate, int64_t now_ns);
+
+private:
+    std::atomic<int64_t> full_at_ns_;
+};
+
+#endif // TOKENBUCKET_HPP
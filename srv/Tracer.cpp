@@ -0,0 +1,197 @@
+// Tracer.cpp
+#include <chrono>
+#include <cinttypes>
+#include <unistd.h>
+#include "Tracer.hpp"
+#include "Config.hpp"
+#include "Log.hpp"
+
+Tracer& Tracer::Get() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer()
+    : enabled_(false),
+      next_trace_(0),
+      dropped_(0),
+      max_bytes_(0),
+      file_(nullptr),
+      file_bytes_(0),
+      pid_(::getpid()),
+      stop_(false)
+{
+}
+
+Tracer::~Tracer() {
+    Stop();
+}
+
+void Tracer::Start(const std::string& path, std::size_t max_bytes) {
+    path_ = path;
+    max_bytes_ = max_bytes;
+    Open();
+    if (!file_) {
+        LOG_MSG("Cannot open trace file " << path_);
+        return;
+    }
+    enabled_ = true;
+    thread_ = std::thread(&Tracer::Run, this);
+}
+
+void Tracer::Stop() {
+    enabled_ = false;
+    stop_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (file_) {
+        Drain();
+        Close();
+    }
+}
+
+uint64_t Tracer::Sample() {
+    Tracer& tracer = Get();
+    if (!tracer.enabled_.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    // Счетчик у каждого потока свой: общий атомарный счетчик
+    // на каждый кадр был бы лишней точкой столкновения потоков
+    static thread_local std::size_t count = 0;
+    std::size_t every = Config::Get().trace_sample.load(std::memory_order_relaxed);
+    if (every == 0 || ++count < every) {
+        return 0;
+    }
+    count = 0;
+    return tracer.next_trace_.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void Tracer::Span(const char* name, uint64_t trace, uint32_t room,
+                  uint64_t session, int64_t begin_ns, int64_t end_ns)
+{
+    Tracer& tracer = Get();
+    if (!tracer.enabled_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    Buffer* buffer = ThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    if (buffer->spans.size() >= TRACE_BUFFER_SPANS) {
+        tracer.dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->spans.push_back(
+        TraceSpan{name, trace, session, room, buffer->tid, begin_ns, end_ns});
+}
+
+Tracer::Buffer* Tracer::ThreadBuffer() {
+    static thread_local std::shared_ptr<Buffer> buffer;
+    if (!buffer) {
+        Tracer& tracer = Get();
+        buffer = std::make_shared<Buffer>();
+        std::lock_guard<std::mutex> lock(tracer.buffers_mutex_);
+        buffer->tid = tracer.buffers_.size() + 1;
+        tracer.buffers_.push_back(buffer);
+    }
+    return buffer.get();
+}
+
+void Tracer::Run() {
+    while (!stop_) {
+        Drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_FLUSH_MS));
+    }
+}
+
+bool Tracer::Drain() {
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        buffers = buffers_;
+    }
+
+    bool any = false;
+    for (auto& buffer : buffers) {
+        {
+            // Емкость векторов ходит по кругу, память не выделяется
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            buffer->spans.swap(writing_);
+        }
+        for (const auto& span : writing_) {
+            Write(span);
+            any = true;
+        }
+        writing_.clear();
+    }
+
+    uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        LOG_MSG("Tracer: " << dropped << " spans dropped");
+    }
+    if (any) {
+        std::fflush(file_);
+    }
+    return any;
+}
+
+void Tracer::Write(const TraceSpan& span) {
+    if (file_bytes_ >= max_bytes_) {
+        Rotate();
+    }
+    if (!file_) {
+        return;
+    }
+
+    // Отрезок - пара асинхронных событий с одним id: у получателей
+    // отрезки одного кадра идут параллельно и не вкладываются друг в друга
+    char id[48];
+    if (span.session != 0) {
+        snprintf(id, sizeof(id), "%" PRIu64 ".%" PRIx64, span.trace, span.session);
+    } else {
+        snprintf(id, sizeof(id), "%" PRIu64, span.trace);
+    }
+    char text[512];
+    int size = snprintf(
+        text, sizeof(text),
+        ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"b\",\"id\":\"%s\","
+        "\"pid\":%d,\"tid\":%u,\"ts\":%" PRId64 ".%03" PRId64 ","
+        "\"args\":{\"trace\":%" PRIu64 ",\"room\":%u}}"
+        ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"e\",\"id\":\"%s\","
+        "\"pid\":%d,\"tid\":%u,\"ts\":%" PRId64 ".%03" PRId64 "}",
+        span.name, id, pid_, span.tid, span.begin_ns / 1000, span.begin_ns % 1000,
+        span.trace, span.room,
+        span.name, id, pid_, span.tid, span.end_ns / 1000, span.end_ns % 1000);
+    if (size > 0) {
+        std::fwrite(text, 1, size, file_);
+        file_bytes_ += size;
+    }
+}
+
+void Tracer::Open() {
+    file_ = std::fopen(path_.c_str(), "w");
+    if (!file_) {
+        return;
+    }
+    // Первое событие - имя процесса, остальные дописываются через запятую
+    int size = std::fprintf(
+        file_, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+        "\"args\":{\"name\":\"chat_server\"}}", pid_);
+    file_bytes_ = size > 0 ? size : 0;
+}
+
+void Tracer::Close() {
+    // Файл без закрывающей скобки (процесс убит) просмотрщики тоже читают
+    std::fputs("\n]\n", file_);
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+void Tracer::Rotate() {
+    Close();
+    for (int i = TRACE_FILES - 1; i > 1; --i) {
+        std::rename((path_ + "." + std::to_string(i - 1)).c_str(),
+                    (path_ + "." + std::to_string(i)).c_str());
+    }
+    std::rename(path_.c_str(), (path_ + ".1").c_str());
+    Open();
+}
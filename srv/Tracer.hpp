@@ -0,0 +1,93 @@
+// Tracer.hpp
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "defs.hpp"
+
+// Отрезок пути кадра: от begin_ns до end_ns (Metrics::NowNs)
+struct TraceSpan {
+    const char* name;   // строковый литерал
+    uint64_t trace;
+    // Получатель (0 - сам кадр до рассылки) и комната
+    uint64_t session;
+    uint32_t room;
+    uint32_t tid;
+    int64_t begin_ns;
+    int64_t end_ns;
+};
+
+/**
+   Выборочная трассировка кадров. Каждый Config::trace_sample-й кадр,
+   прочитанный у клиента, получает номер трассы (Frame::TraceId), и его
+   путь записывается отрезками:
+     read->broadcast  от чтения у отправителя до рассылки комнатой
+     queued           от рассылки до начала записи получателю
+     write            запись получателю, от начала до завершения
+   Отрезки получателей различаются по id "трасса.сессия".
+   Как и Logger, рабочий поток только кладет отрезок в свой буфер,
+   а фоновый поток раз в TRACE_FLUSH_MS дописывает их в файл в формате
+   Chrome trace event (JSON-массив асинхронных событий b/e), который
+   открывается в chrome://tracing или ui.perfetto.dev. Файл больше
+   предела переименовывается в PATH.1 (старые - в PATH.2 ...), всего
+   хранится TRACE_FILES файлов.
+*/
+class Tracer {
+public:
+    static Tracer& Get();
+    ~Tracer();
+
+    // Включает трассировку в файл path с ротацией по max_bytes
+    void Start(const std::string& path, std::size_t max_bytes);
+    // Дописывает накопленное и закрывает файл (при завершении процесса)
+    void Stop();
+
+    // Номер трассы для нового кадра, 0 - кадр не трассируется
+    static uint64_t Sample();
+    static void Span(const char* name, uint64_t trace, uint32_t room,
+                     uint64_t session, int64_t begin_ns, int64_t end_ns);
+
+private:
+    // Отрезки одного потока; мьютекс делят только этот поток и фоновый
+    struct Buffer {
+        std::mutex mutex;
+        std::vector<TraceSpan> spans;
+        uint32_t tid;
+    };
+
+    Tracer();
+    static Buffer* ThreadBuffer();
+    void Run();
+    // Забирает буферы потоков и пишет их в файл; false - писать нечего
+    bool Drain();
+    void Write(const TraceSpan& span);
+    void Open();
+    void Close();
+    void Rotate();
+
+    std::atomic<bool> enabled_;
+    std::atomic<uint64_t> next_trace_;
+    std::atomic<uint64_t> dropped_;
+
+    std::mutex buffers_mutex_;
+    std::vector<std::shared_ptr<Buffer>> buffers_;
+    std::vector<TraceSpan> writing_;
+
+    std::string path_;
+    std::size_t max_bytes_;
+    std::FILE* file_;
+    std::size_t file_bytes_;
+    int pid_;
+
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
+
+#endif // TRACER_HPP
@@ -31,3 +31,86 @@
 #define READ_QUEUE_SIZE 32
 #define SYNC_MARKER_SIZE 32
 #define READ_TIMEOUT 5
+// Через сколько секунд клиент переподключается после обрыва связи
+#define RECONNECT_DELAY 1
+// Тайм-аут бездействия сессии в секундах, 0 - без ограничения
+#define IDLE_TIMEOUT 0
+// Ограничение входящих кадров по умолчанию, в секунду: для сессии
+// и для комнаты в целом, 0 - без ограничения
+#define SESSION_FRAMES_PER_SEC 0
+#define SESSION_BYTES_PER_SEC 0
+#define ROOM_FRAMES_PER_SEC 0
+#define ROOM_BYTES_PER_SEC 0
+// Молчащее соединение входит в комнату по умолчанию через столько
+// миллисекунд: переподключившийся клиент успевает прислать ROOM_RESUME
+#define DEFAULT_ROOM_JOIN_DELAY_MS 100
+// Колесо таймеров: шаг в миллисекундах и число ячеек (степень двойки)
+#define TIMER_WHEEL_TICK_MS 100
+#define TIMER_WHEEL_SLOTS 512
+// Общий буфер приема рабочего потока: туда читается все, что пришло
+// в сокет сессии, и из него разбираются все целые кадры
+#define READ_BUFFER_SIZE 65536
+// Буфер сессии под кадр, начало которого пришло в прошлом чтении:
+// должен вмещать самый большой кадр и место для следующего чтения
+#define READ_PENDING_CAPACITY 32768
+// Одна gather-запись в сокет собирается не больше чем из
+// MAX_WRITE_BATCH_BUFFERS буферов (64 - предел iovec в asio)
+// и не больше MAX_WRITE_BATCH_BYTES байт (но минимум один кадр)
+#define MAX_WRITE_BATCH_BUFFERS 64
+#define MAX_WRITE_BATCH_BYTES 262144
+// Пределы очереди отправки одного участника по умолчанию
+#define SEND_QUEUE_MAX_FRAMES 1024
+#define SEND_QUEUE_MAX_BYTES 8388608
+// Емкость очереди отправки при первом кадре, дальше удваивается по мере надобности
+#define SEND_QUEUE_INITIAL_CAPACITY 16
+// История комнаты (RoomLog): сегменты до 64 МБ, хранится не больше 1 ГБ
+// и не дольше 7 суток, запись индекса - на каждые 64 КБ сегмента.
+// Место под сегмент выделяется по HISTORY_SEGMENT_INITIAL_BYTES
+// и удваивается по мере записи.
+// При входе участнику отдаются HISTORY_RECENT последних кадров
+#define HISTORY_SEGMENT_BYTES 67108864
+#define HISTORY_SEGMENT_INITIAL_BYTES 65536
+#define HISTORY_RETENTION_BYTES 1073741824
+#define HISTORY_RETENTION_SECONDS 604800
+#define HISTORY_INDEX_INTERVAL 65536
+#define HISTORY_RECENT 100
+// Пределы числа комнат: на узле и у одной сессии. Пустая комната
+// выселяется из памяти, ее журнал закрывается
+#define ROOMS_MAX 4096
+#define SESSION_ROOMS_MAX 32
+// Наибольшая операция, память под которую сессия держит у себя
+// (HandlerAllocator.hpp), более крупные берутся из кучи. Запись
+// из сопрограммы (make COROUTINES=1) немного больше 512 байт
+#define HANDLER_MEMORY_SIZE 1024
+// Сколько свободных блоков кадров поток отдает в общий пул за раз
+#define FRAME_POOL_BATCH 64
+// Сколько сессий выделяется в слэбе за раз
+#define SESSION_SLAB_CHUNK 64
+// Федерация: виртуальных точек узла на кольце хешей, пауза перед
+// повторным подключением к соседу (мс) и предел очереди отправки
+// соседу в байтах, сверх него связь рвется и устанавливается заново
+#define FEDERATION_VNODES 64
+#define PEER_RECONNECT_MS 1000
+#define PEER_QUEUE_MAX_BYTES 67108864
+// Емкость каждого из двух колец локального транспорта (степень двойки)
+#define SHM_RING_BYTES 1048576
+// Перезапуск (Handoff.hpp): сколько слушающих сокетов можно передать,
+// сколько секунд старый процесс ждет ухода сессий по умолчанию
+// и как часто (мс) проверяет, остались ли они
+#define HANDOFF_MAX_SOCKETS 64
+#define DRAIN_TIMEOUT_SEC 30
+#define DRAIN_POLL_MS 100
+// Трассировка кадров (Tracer.hpp): трассируется один кадр из TRACE_SAMPLE,
+// файл ротируется по TRACE_FILE_BYTES байт, хранится TRACE_FILES файлов.
+// Фоновый поток забирает отрезки раз в TRACE_FLUSH_MS мс, сверх
+// TRACE_BUFFER_SPANS отрезков за это время поток их выбрасывает
+#define TRACE_SAMPLE 1000
+#define TRACE_FILE_BYTES 67108864
+#define TRACE_FILES 4
+#define TRACE_FLUSH_MS 100
+#define TRACE_BUFFER_SPANS 65536
+// Подробность логов, оставляемая при компиляции (см. Logger.hpp).
+// Во время работы уровень можно только понизить (--log-level),
+// hex-дампы пишутся для одного вызова из LOG_HEX_SAMPLE
+#define LOG_COMPILE_LEVEL (DBG_MSG > 0 ? LOG_LEVEL_TRACE : LOG_LEVEL_INFO)
+#define LOG_HEX_SAMPLE 64
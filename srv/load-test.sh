@@ -0,0 +1,62 @@
+#!/bin/bash
+# Воспроизводимый нагрузочный тест chat_server: одна и та же нагрузка
+# chat_bench, результат - одна строка JSON в load-test.jsonl.
+# Задержку меряем на чистом прогоне, системные вызовы - на втором прогоне
+# под strace -c (strace сам замедляет сервер, поэтому прогоны разные).
+# Выделения памяти за время нагрузки - по счетчику heap_allocations сервера.
+#
+#   ./load-test.sh [label]      label - метка сборки, например epoll-callbacks
+#   THREADS=4 ./load-test.sh    рабочих потоков сервера (1 по умолчанию)
+set -eu -o pipefail
+
+LABEL=${1:-epoll-callbacks}
+SCRIPT_DIR=$(dirname $(realpath $0))
+PORT=${PORT:-8898}
+STATS_PORT=${STATS_PORT:-8899}
+THREADS=${THREADS:-1}
+OUT=${OUT:-$SCRIPT_DIR/load-test.jsonl}
+BENCH_ARGS=${BENCH_ARGS:-"--sessions 1000 --senders 20 --rate 100 --size 1570 --max-size 4096 --duration 10"}
+
+WORK=$(mktemp -d)
+trap 'kill $(jobs -p) 2>/dev/null || true; rm -rf $WORK' EXIT
+cd $SCRIPT_DIR
+
+# Значение счетчика сервера по имени
+stat() {
+    exec 3<>/dev/tcp/127.0.0.1/$STATS_PORT
+    awk -v name=$1 '$1 == name { print $2 }' <&3
+    exec 3<&-
+}
+
+run() {
+    # $1 - префикс команды сервера (пусто или strace)
+    rm -rf $WORK/history
+    $1 ./chat_server --threads $THREADS --history-dir $WORK/history --stats-port $STATS_PORT \
+       $PORT > $WORK/server.log 2>&1 &
+    local tracer=$!
+    sleep 1
+    local allocations=$(stat heap_allocations)
+    ./chat_bench $BENCH_ARGS --json 127.0.0.1 $PORT | grep '^{' > $WORK/bench.json
+    ALLOCATIONS=$(( $(stat heap_allocations) - allocations ))
+    # Останавливаем сам сервер, а не strace: тот допишет сводку сам
+    pkill -TERM -f "chat_server --threads $THREADS --history-dir $WORK/history" || true
+    wait $tracer || true
+}
+
+run ""
+BENCH=$(cat $WORK/bench.json)
+HEAP=$ALLOCATIONS
+
+SYSCALLS=null
+if command -v strace > /dev/null; then
+    run "strace -f -c -o $WORK/strace.txt"
+    # Итоговая строка strace -c: "100.00 time seconds usecs/call calls errors total"
+    SYSCALLS=$(awk '
+        $NF == "total" { total = $4 }
+        $1 ~ /^[0-9.]+$/ && $NF != "total" { top = top sep "\"" $NF "\":" $4; sep = "," }
+        END { printf "{\"total\":%d,\"by_call\":{%s}}", total, top }' $WORK/strace.txt)
+else
+    echo "strace not found, syscall counts skipped" >&2
+fi
+
+echo "{\"label\":\"$LABEL\",\"heap_allocations\":$HEAP,\"syscalls\":$SYSCALLS,\"bench\":$BENCH}" | tee -a $OUT
@@ -0,0 +1,383 @@
+// test_frames.cpp
+// Кадры: CRC32C обеими реализациями, разбор потока v2 и поиск
+// следующего кадра после сбоя, совместимость заголовков v1 и v2,
+// синхромаркер v1 у кадров из истории
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Crc32c.hpp"
+#include "FrameV2.hpp"
+#include "Frame.hpp"
+#include "RoomLog.hpp"
+#include "Log.hpp"
+
+typedef std::vector<unsigned char> Bytes;
+
+// Кадр потока, как его видит получатель
+struct Parsed {
+    uint8_t op;
+    uint32_t room;
+    std::string payload;
+};
+
+static Bytes ToBytes(const std::string& text) {
+    return Bytes(text.begin(), text.end());
+}
+
+static void AppendFrameV2(Bytes& stream, uint8_t op, uint32_t room,
+                          const std::string& payload)
+{
+    std::size_t offset = stream.size();
+    stream.resize(offset + FRAME_V2_HEADER_SIZE);
+    stream.insert(stream.end(), payload.begin(), payload.end());
+    EncodeFrameV2Header(stream.data() + offset, op, room,
+                        stream.data() + offset + FRAME_V2_HEADER_SIZE, payload.size());
+}
+
+// Разбор целого потока v2 тем же способом, что у клиента и сессии:
+// заголовок, crc, а при ошибке - поиск следующего magic
+static std::vector<Parsed> ParseV2(const Bytes& stream, std::size_t& resyncs) {
+    std::vector<Parsed> frames;
+    const unsigned char* frame = stream.data();
+    const unsigned char* end = frame + stream.size();
+    resyncs = 0;
+    while (end - frame >= static_cast<std::ptrdiff_t>(FRAME_V2_HEADER_SIZE)) {
+        FrameV2Header header;
+        if (!DecodeFrameV2Header(frame, header)) {
+            ++resyncs;
+            frame = FindFrameV2(frame + 1, end);
+            continue;
+        }
+        if (end - frame < static_cast<std::ptrdiff_t>(FRAME_V2_HEADER_SIZE + header.length)) {
+            break;
+        }
+        const unsigned char* payload = frame + FRAME_V2_HEADER_SIZE;
+        if (!CheckFrameV2Crc(frame, header, payload)) {
+            ++resyncs;
+            frame = FindFrameV2(frame + 1, end);
+            continue;
+        }
+        frames.push_back(Parsed{header.op, header.room,
+                                std::string(payload, payload + header.length)});
+        frame = payload + header.length;
+    }
+    return frames;
+}
+
+static bool Expect(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "  " << what << std::endl;
+    }
+    return condition;
+}
+
+bool TestCrc32cVectors() {
+    // Векторы CRC32C из RFC 3720 (iSCSI), B.4
+    Bytes zeros(32, 0x00);
+    Bytes ones(32, 0xFF);
+    Bytes ascending(32);
+    for (std::size_t i = 0; i < ascending.size(); ++i) {
+        ascending[i] = static_cast<unsigned char>(i);
+    }
+    Bytes check = ToBytes("123456789");
+    struct Vector {
+        const Bytes* data;
+        uint32_t crc;
+    } vectors[] = {
+        {&zeros, 0x8A9136AA},
+        {&ones, 0x62A8AB43},
+        {&ascending, 0x46DD794E},
+        {&check, 0xE3069283}
+    };
+
+    bool ok = true;
+    for (const auto& vector : vectors) {
+        const Bytes& data = *vector.data;
+        ok &= Expect(Crc32cSoftware(data.data(), data.size()) == vector.crc,
+                     "table crc differs from the vector");
+        ok &= Expect(Crc32c(data.data(), data.size()) == vector.crc,
+                     "crc differs from the vector");
+        if (Crc32cHardwareSupported()) {
+            ok &= Expect(Crc32cHardware(data.data(), data.size()) == vector.crc,
+                         "sse4.2 crc differs from the vector");
+        }
+    }
+    if (!Crc32cHardwareSupported()) {
+        std::cout << "  no SSE4.2, hardware path skipped" << std::endl;
+    }
+    return ok;
+}
+
+bool TestCrc32cPaths() {
+    // Невыровненные начала, хвосты короче 8 байт и CRC по частям
+    Bytes data(300);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>(i * 131 + 7);
+    }
+    bool ok = true;
+    for (std::size_t offset = 0; offset < 8; ++offset) {
+        for (std::size_t size = 0; size + offset <= 100; ++size) {
+            const unsigned char* block = data.data() + offset;
+            uint32_t expected = Crc32cSoftware(block, size);
+            if (Crc32cHardwareSupported()) {
+                ok &= Expect(Crc32cHardware(block, size) == expected,
+                             "sse4.2 and table crc differ");
+            }
+            std::size_t half = size / 3;
+            uint32_t chained = Crc32c(block + half, size - half, Crc32c(block, half));
+            ok &= Expect(chained == expected, "chained crc differs");
+        }
+    }
+    return ok;
+}
+
+bool TestV2Parse() {
+    Bytes stream;
+    AppendFrameV2(stream, ROOM_MSG, 1, "first");
+    AppendFrameV2(stream, ROOM_SEQ_MSG, 2, std::string(FRAME_SEQ_SIZE, '\x01') + "second");
+    AppendFrameV2(stream, ROOM_JOIN, 0xDEADBEEF, "");
+
+    std::size_t resyncs;
+    std::vector<Parsed> frames = ParseV2(stream, resyncs);
+    bool ok = Expect(frames.size() == 3 && resyncs == 0, "clean stream is not parsed");
+    if (!ok) {
+        return false;
+    }
+    ok &= Expect(frames[0].op == ROOM_MSG && frames[0].room == 1
+                 && frames[0].payload == "first", "first frame differs");
+    ok &= Expect(frames[1].op == ROOM_SEQ_MSG && frames[1].payload.size() == 14,
+                 "seq frame differs");
+    ok &= Expect(frames[2].op == ROOM_JOIN && frames[2].room == 0xDEADBEEF
+                 && frames[2].payload.empty(), "join frame differs");
+
+    // Хвост неполного кадра ждет продолжения, а не считается сбоем
+    Bytes partial(stream.begin(), stream.end() - 3);
+    frames = ParseV2(partial, resyncs);
+    ok &= Expect(frames.size() == 2 && resyncs == 0, "partial frame is not kept");
+    return ok;
+}
+
+bool TestV2Resync() {
+    Bytes stream;
+    AppendFrameV2(stream, ROOM_MSG, 1, "before");
+    // Мусор, в котором есть первый байт magic
+    Bytes garbage = {0x01, FRAME_V2_MAGIC_0, 0x02, 0x03, FRAME_V2_MAGIC_0, 0x00};
+    stream.insert(stream.end(), garbage.begin(), garbage.end());
+    AppendFrameV2(stream, ROOM_MSG, 1, "after garbage");
+    // Испорченный payload: crc не сходится
+    std::size_t broken = stream.size();
+    AppendFrameV2(stream, ROOM_MSG, 1, "broken");
+    stream[broken + FRAME_V2_HEADER_SIZE] ^= 0x40;
+    AppendFrameV2(stream, ROOM_MSG, 1, "after crc");
+    // Длина больше MAX_PACK_SIZE: заголовок отвергается сразу
+    std::size_t oversized = stream.size();
+    AppendFrameV2(stream, ROOM_MSG, 1, "oversized");
+    stream[oversized + 9] = 0xFF;
+    AppendFrameV2(stream, ROOM_MSG, 1, "last");
+
+    std::size_t resyncs;
+    std::vector<Parsed> frames = ParseV2(stream, resyncs);
+    std::vector<std::string> expected = {"before", "after garbage", "after crc", "last"};
+    bool ok = Expect(frames.size() == expected.size(), "lost frames after resync");
+    for (std::size_t i = 0; ok && i < frames.size(); ++i) {
+        ok &= Expect(frames[i].payload == expected[i], "wrong frame after resync");
+    }
+    ok &= Expect(resyncs == 3, "unexpected number of resyncs");
+
+    // Первый байт magic в конце диапазона может быть началом кадра
+    Bytes tail = {0x00, 0x01, FRAME_V2_MAGIC_0};
+    ok &= Expect(FindFrameV2(tail.data(), tail.data() + tail.size()) == tail.data() + 2,
+                 "split magic is skipped");
+    Bytes none = {0x00, FRAME_V2_MAGIC_0, 0x00};
+    ok &= Expect(FindFrameV2(none.data(), none.data() + none.size()) == none.data() + 3,
+                 "magic found in garbage");
+    return ok;
+}
+
+bool TestV2Limits() {
+    unsigned char header[FRAME_V2_HEADER_SIZE];
+    FrameV2Header decoded;
+    bool ok = true;
+
+    auto with_length = [&header](uint8_t op, std::size_t length) {
+        EncodeFrameV2Header(header, op, 0, nullptr, 0);
+        header[8] = static_cast<unsigned char>(length & 0xFF);
+        header[9] = static_cast<unsigned char>((length >> 8) & 0xFF);
+        return header;
+    };
+
+    ok &= Expect(DecodeFrameV2Header(with_length(ROOM_MSG, MAX_PACK_SIZE), decoded),
+                 "ROOM_MSG of MAX_PACK_SIZE is rejected");
+    ok &= Expect(!DecodeFrameV2Header(with_length(ROOM_MSG, MAX_PACK_SIZE + 1), decoded),
+                 "ROOM_MSG over MAX_PACK_SIZE is accepted");
+    ok &= Expect(!DecodeFrameV2Header(
+                     with_length(ROOM_ROUTED, MAX_PACK_SIZE + FRAME_SEQ_SIZE), decoded),
+                 "seq prefix is allowed on ROOM_ROUTED");
+    ok &= Expect(DecodeFrameV2Header(
+                     with_length(ROOM_SEQ_MSG, MAX_PACK_SIZE + FRAME_SEQ_SIZE), decoded),
+                 "ROOM_SEQ_MSG with seq prefix is rejected");
+    ok &= Expect(!DecodeFrameV2Header(
+                     with_length(ROOM_SEQ_MSG, MAX_PACK_SIZE + FRAME_SEQ_SIZE + 1), decoded),
+                 "oversized ROOM_SEQ_MSG is accepted");
+    ok &= Expect(DecodeFrameV2Header(
+                     with_length(PEER_RELAY, MAX_PACK_SIZE + FRAME_SEQ_SIZE + PEER_FLAGS_SIZE),
+                     decoded),
+                 "PEER_RELAY with seq and flags is rejected");
+    ok &= Expect(DecodeFrameV2Header(
+                     with_length(PEER_FORWARD, MAX_PACK_SIZE + PEER_FLAGS_SIZE), decoded)
+                 && !DecodeFrameV2Header(
+                     with_length(PEER_FORWARD, MAX_PACK_SIZE + PEER_FLAGS_SIZE + 1), decoded),
+                 "PEER_FORWARD flags limit differs");
+
+    with_length(ROOM_MSG, 0)[2] = FRAME_V2_VERSION + 1;
+    ok &= Expect(!DecodeFrameV2Header(header, decoded), "foreign version is accepted");
+    return ok;
+}
+
+bool TestNegotiation() {
+    bool ok = true;
+
+    // Сервер узнает v2 по первым двум байтам: ни один заголовок v1,
+    // с комнатой или без, не должен начинаться с magic
+    for (std::size_t length = 0; length <= MAX_PACK_SIZE + SYNC_MARKER_SIZE; ++length) {
+        for (uint16_t flag : {uint16_t(0), ROOM_FRAME_FLAG}) {
+            uint16_t value = static_cast<uint16_t>(length) | flag;
+            unsigned char v1[2] = {static_cast<unsigned char>(value & 0xFF),
+                                   static_cast<unsigned char>(value >> 8)};
+            if (IsFrameV2(v1)) {
+                std::cerr << "  v1 length " << length << " looks like v2" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // Один кадр в трех форматах: маркер v1 возвращается только в v1
+    std::string text = "hello";
+    Bytes bytes = ToBytes(text);
+    SharedFrame frame = Frame::Make(7, bytes.data(), bytes.size(), true);
+    std::size_t size = text.size();
+
+    ok &= Expect(frame->PayloadSize() == size, "sync marker stored in payload");
+    const unsigned char* legacy = frame->Header(WireLegacy);
+    std::size_t legacy_length = legacy[0] | (legacy[1] << 8);
+    ok &= Expect(legacy_length == size + SYNC_MARKER_SIZE
+                 && frame->WireSize(WireLegacy) == 2 + size + SYNC_MARKER_SIZE,
+                 "v1 frame lost its sync marker");
+    const unsigned char* room = frame->Header(WireRoom);
+    std::size_t room_length = room[0] | (room[1] << 8);
+    ok &= Expect(room_length == (ROOM_FRAME_FLAG | (size + SYNC_MARKER_SIZE))
+                 && room[2] == ROOM_MSG && room[3] == 7,
+                 "room frame header differs");
+    ok &= Expect(frame->WireSize(WireV2) == FRAME_V2_HEADER_SIZE + size
+                 && frame->TrailerSize(WireV2) == 0,
+                 "v2 frame carries the sync marker");
+
+    FrameV2Header header;
+    const unsigned char* v2 = frame->Header(WireV2);
+    ok &= Expect(IsFrameV2(v2) && DecodeFrameV2Header(v2, header)
+                 && header.op == ROOM_MSG && header.room == 7
+                 && CheckFrameV2Crc(v2, header, frame->Payload()),
+                 "v2 header does not decode");
+
+    // С номером кадр v2 становится ROOM_SEQ_MSG, crc покрывает и номер
+    frame->AssignSeq(0x0102030405060708ULL);
+    Bytes wire(frame->Header(WireV2), frame->Header(WireV2) + frame->HeaderSize(WireV2));
+    wire.insert(wire.end(), frame->Payload(), frame->Payload() + frame->PayloadSize());
+    std::size_t resyncs;
+    std::vector<Parsed> frames = ParseV2(wire, resyncs);
+    ok &= Expect(frames.size() == 1 && frames[0].op == ROOM_SEQ_MSG
+                 && frames[0].payload.size() == FRAME_SEQ_SIZE + size
+                 && frames[0].payload[0] == 0x08
+                 && frames[0].payload.substr(FRAME_SEQ_SIZE) == text,
+                 "seq frame does not parse");
+
+    // Payload без маркера (от сессий v2) уходит в v1 как есть,
+    // даже если сам кончается нулями
+    Bytes zeros = bytes;
+    zeros.resize(zeros.size() + SYNC_MARKER_SIZE, 0);
+    SharedFrame plain = Frame::Make(0, zeros.data(), zeros.size(), false);
+    ok &= Expect(plain->PayloadSize() == zeros.size()
+                 && plain->TrailerSize(WireLegacy) == 0
+                 && plain->WireSize(WireLegacy) == 2 + zeros.size(),
+                 "sync marker guessed from the payload");
+    return ok;
+}
+
+bool TestV1History() {
+    char dir[] = "/tmp/test_frames.XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cerr << "  mkdtemp: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Кадр v1 с маркером и кадр v2 без него: после журнала (и его
+    // повторного открытия) v1 получает их той же длины, что и вживую
+    std::string text(1600, 'x');
+    Bytes bytes = ToBytes(text);
+    SharedFrame frames[] = {
+        Frame::Make(3, bytes.data(), bytes.size(), true),
+        Frame::Make(3, bytes.data(), bytes.size(), false),
+    };
+    {
+        RoomLog log(dir, RoomLogOptions());
+        for (const auto& frame : frames) {
+            log.Append(frame->Payload(), frame->PayloadSize(), frame->SyncMarker());
+        }
+    }
+    std::vector<SharedFrame> replayed;
+    {
+        RoomLog log(dir, RoomLogOptions());
+        log.Replay(1, log.NextSeq(),
+                   [&replayed](uint64_t, const unsigned char* payload, std::size_t size,
+                               bool sync_marker) {
+                       replayed.push_back(Frame::Make(3, payload, size, sync_marker));
+                   });
+    }
+    std::filesystem::remove_all(dir);
+
+    bool ok = Expect(replayed.size() == 2, "history lost frames");
+    for (std::size_t i = 0; ok && i < replayed.size(); ++i) {
+        const unsigned char* live = frames[i]->Header(WireLegacy);
+        const unsigned char* stored = replayed[i]->Header(WireLegacy);
+        ok &= Expect(std::memcmp(live, stored, 2) == 0
+                     && replayed[i]->WireSize(WireLegacy) == frames[i]->WireSize(WireLegacy),
+                     "v1 length differs after history");
+    }
+    ok = ok && Expect((replayed[0]->Header(WireLegacy)[0]
+                       | (replayed[0]->Header(WireLegacy)[1] << 8))
+                      == 1600 + SYNC_MARKER_SIZE,
+                      "v1 history frame lost its sync marker");
+    return ok;
+}
+
+int main() {
+    // Сообщения журнала о сегментах здесь только мешают
+    Logger::SetLevel(LOG_LEVEL_ERROR);
+
+    struct Test {
+        const char* name;
+        bool (*run)();
+    };
+    const Test tests[] = {
+        {"CRC32C Vectors", TestCrc32cVectors},
+        {"CRC32C Paths", TestCrc32cPaths},
+        {"V2 Parse", TestV2Parse},
+        {"V2 Resync", TestV2Resync},
+        {"V2 Limits", TestV2Limits},
+        {"V1/V2 Negotiation", TestNegotiation},
+        {"V1 History", TestV1History},
+    };
+
+    bool passed = true;
+    for (const auto& test : tests) {
+        bool result = test.run();
+        std::cout << "Test " << test.name << ": " << (result ? "PASSED" : "FAILED")
+                  << std::endl;
+        passed = passed && result;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+// test_roomlog.cpp
+// Журнал комнаты (RoomLog): дозапись и чтение, восстановление после
+// падения, перечитывание индекса, удаление старых сегментов
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "RoomLog.hpp"
+#include "Log.hpp"
+
+typedef std::vector<std::pair<uint64_t, std::string>> Frames;
+
+// Заголовок записи в .log, как в RoomLog.cpp
+const std::size_t RECORD_HEADER_SIZE = 24;
+
+static std::string MakeDir() {
+    char dir[] = "/tmp/test_roomlog.XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cerr << "mkdtemp: " << std::strerror(errno) << std::endl;
+        std::exit(1);
+    }
+    return dir;
+}
+
+static std::string Payload(uint64_t n) {
+    // Разные размеры, чтобы записи по-разному ложились на выравнивание
+    return std::string(1 + n * 37 % 300, static_cast<char>('a' + n % 26));
+}
+
+static Frames ReadAll(const RoomLog& log, uint64_t from, uint64_t to) {
+    Frames frames;
+    log.Replay(from, to, [&frames](uint64_t seq, const unsigned char* payload,
+                                   std::size_t size, bool) {
+        frames.push_back(std::make_pair(
+            seq, std::string(reinterpret_cast<const char*>(payload), size)));
+    });
+    return frames;
+}
+
+// Кадры from..to-1 из Payload подряд
+static bool Expect(const Frames& frames, uint64_t from, uint64_t to) {
+    if (frames.size() != to - from) {
+        std::cerr << "  expected " << to - from << " frames, got " << frames.size()
+                  << std::endl;
+        return false;
+    }
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i].first != from + i || frames[i].second != Payload(from + i)) {
+            std::cerr << "  frame " << from + i << " differs" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool AppendAll(RoomLog& log, uint64_t from, uint64_t to) {
+    for (uint64_t n = from; n < to; ++n) {
+        std::string payload = Payload(n);
+        uint64_t seq = log.Append(reinterpret_cast<const unsigned char*>(payload.data()),
+                                  payload.size(), false);
+        if (seq != n) {
+            std::cerr << "  append " << n << " returned " << seq << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<std::string> Files(const std::string& dir, const char* ext) {
+    std::vector<std::string> files;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() == ext) {
+            files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static RoomLogOptions SmallSegments() {
+    RoomLogOptions options;
+    options.segment_bytes = 4096;
+    options.index_interval = 512;
+    return options;
+}
+
+// Смещение конца записей в файле сегмента
+static std::size_t RecordsEnd(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+    std::size_t pos = 0;
+    while (pos + RECORD_HEADER_SIZE <= data.size()) {
+        uint32_t size;
+        std::memcpy(&size, data.data() + pos, sizeof(size));
+        if (size == 0) {
+            break;
+        }
+        pos += (RECORD_HEADER_SIZE + size + 7) & ~static_cast<std::size_t>(7);
+    }
+    return pos;
+}
+
+static void Patch(const std::string& path, std::size_t pos, const void* data,
+                  std::size_t size)
+{
+    int fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0 || pwrite(fd, data, size, pos) != static_cast<ssize_t>(size)) {
+        std::cerr << "  cannot patch " << path << std::endl;
+    }
+    close(fd);
+}
+
+bool TestAppendReplay() {
+    std::string dir = MakeDir();
+    RoomLog log(dir, SmallSegments());
+    bool result = log.FirstSeq() == 1 && log.NextSeq() == 1
+        && AppendAll(log, 1, 201)
+        && log.NextSeq() == 201
+        && Files(dir, ".log").size() > 1
+        && Expect(ReadAll(log, 1, 201), 1, 201)
+        && Expect(ReadAll(log, 57, 143), 57, 143)
+        && Expect(ReadAll(log, 200, 500), 200, 201)
+        && ReadAll(log, 201, 300).empty();
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+bool TestLazyCreate() {
+    std::string root = MakeDir();
+    std::string dir = root + "/room";
+    bool result;
+    {
+        // Журнал, в который не писали, не создает ни каталога, ни файлов
+        RoomLog log(dir, SmallSegments());
+        result = log.FirstSeq() == 1 && log.NextSeq() == 1
+            && ReadAll(log, 1, 10).empty()
+            && !std::filesystem::exists(dir)
+            && AppendAll(log, 1, 4)
+            && Files(dir, ".log").size() == 1;
+    }
+    {
+        RoomLog log(dir, SmallSegments());
+        result = result && log.NextSeq() == 4 && Expect(ReadAll(log, 1, 4), 1, 4);
+    }
+    std::filesystem::remove_all(root);
+    return result;
+}
+
+bool TestSegmentGrowth() {
+    std::string dir = MakeDir();
+    RoomLogOptions options;
+    options.segment_bytes = 1 << 20;
+    bool result;
+    {
+        RoomLog log(dir, options);
+        // Сегмент начинается с малого и растет, не разбиваясь на новые
+        result = AppendAll(log, 1, 2);
+        std::size_t initial = std::filesystem::file_size(Files(dir, ".log").at(0));
+        result = result && initial == HISTORY_SEGMENT_INITIAL_BYTES
+            && AppendAll(log, 2, 2001)
+            && Files(dir, ".log").size() == 1;
+        std::size_t grown = std::filesystem::file_size(Files(dir, ".log").at(0));
+        result = result && grown > initial && grown <= options.segment_bytes
+            && Expect(ReadAll(log, 1, 2001), 1, 2001);
+    }
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+bool TestReopen() {
+    std::string dir = MakeDir();
+    bool result;
+    {
+        RoomLog log(dir, SmallSegments());
+        result = AppendAll(log, 1, 151);
+    }
+    {
+        // Номера продолжаются, индекс перечитан с диска
+        RoomLog log(dir, SmallSegments());
+        result = result && log.NextSeq() == 151
+            && Expect(ReadAll(log, 1, 151), 1, 151)
+            && Expect(ReadAll(log, 100, 120), 100, 120)
+            && AppendAll(log, 151, 181);
+    }
+    {
+        RoomLog log(dir, SmallSegments());
+        result = result && Expect(ReadAll(log, 1, 181), 1, 181);
+    }
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+bool TestOwnerSeq() {
+    std::string dir = MakeDir();
+    // Кадры под номерами чужого журнала: с 5, затем пропуск до 30
+    auto append_at = [](RoomLog& log, uint64_t from, uint64_t to) {
+        for (uint64_t n = from; n < to; ++n) {
+            std::string payload = Payload(n);
+            if (log.Append(reinterpret_cast<const unsigned char*>(payload.data()),
+                           payload.size(), false, n) != n) {
+                std::cerr << "  append at " << n << " failed" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    };
+    bool result;
+    {
+        RoomLog log(dir, SmallSegments());
+        std::string stale = Payload(0);
+        result = append_at(log, 5, 20) && append_at(log, 30, 40)
+            && log.Append(reinterpret_cast<const unsigned char*>(stale.data()),
+                          stale.size(), false, 35) == 0
+            && log.FirstSeq() == 5 && log.NextSeq() == 40;
+    }
+    {
+        // Сегмент после пропуска начинается со своего номера
+        RoomLog log(dir, SmallSegments());
+        Frames frames = ReadAll(log, 1, 100);
+        Frames head(frames.begin(), frames.begin() + std::min<std::size_t>(15, frames.size()));
+        Frames tail(frames.begin() + head.size(), frames.end());
+        result = result && log.NextSeq() == 40
+            && Expect(head, 5, 20) && Expect(tail, 30, 40)
+            && AppendAll(log, 40, 45);
+    }
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+bool TestBrokenIndex() {
+    std::string dir = MakeDir();
+    bool result;
+    {
+        RoomLog log(dir, SmallSegments());
+        result = AppendAll(log, 1, 101);
+    }
+    // Запись индекса указывает не на тот кадр: индекс обрезается
+    // на ней, а остаток сегмента досканируется
+    for (const auto& index : Files(dir, ".idx")) {
+        uint64_t entry[2] = {7, 8};
+        std::ofstream(index, std::ios::binary | std::ios::app)
+            .write(reinterpret_cast<const char*>(entry), sizeof(entry));
+    }
+    std::filesystem::remove(Files(dir, ".idx").at(0));
+    {
+        RoomLog log(dir, SmallSegments());
+        result = result && log.NextSeq() == 101
+            && Expect(ReadAll(log, 1, 101), 1, 101)
+            && Expect(ReadAll(log, 33, 77), 33, 77)
+            && AppendAll(log, 101, 111)
+            && Expect(ReadAll(log, 95, 111), 95, 111);
+    }
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+bool TestTornTail() {
+    std::string dir = MakeDir();
+    bool result;
+    {
+        RoomLog log(dir, SmallSegments());
+        result = AppendAll(log, 1, 61);
+    }
+    std::string active = Files(dir, ".log").back();
+    std::size_t end = RecordsEnd(active);
+
+    // Падение посреди записи: заголовок и часть payload на месте,
+    // а длина, которая пишется последней, - еще нет
+    unsigned char torn[RECORD_HEADER_SIZE + 16];
+    std::memset(torn, 0x5A, sizeof(torn));
+    std::memset(torn, 0, 4);
+    uint64_t next = 61;
+    std::memcpy(torn + 8, &next, sizeof(next));
+    Patch(active, end, torn, sizeof(torn));
+    {
+        RoomLog log(dir, SmallSegments());
+        result = result && log.NextSeq() == 61
+            && Expect(ReadAll(log, 1, 61), 1, 61)
+            && AppendAll(log, 61, 71);
+    }
+    // Хвост от прежней жизни сегмента: длина есть, номер чужой
+    end = RecordsEnd(Files(dir, ".log").back());
+    uint32_t size = 16;
+    uint64_t stale = 5;
+    std::memset(torn, 0x5A, sizeof(torn));
+    std::memcpy(torn, &size, sizeof(size));
+    std::memcpy(torn + 8, &stale, sizeof(stale));
+    Patch(Files(dir, ".log").back(), end, torn, sizeof(torn));
+    {
+        RoomLog log(dir, SmallSegments());
+        result = result && log.NextSeq() == 71
+            && Expect(ReadAll(log, 1, 71), 1, 71)
+            && AppendAll(log, 71, 81)
+            && Expect(ReadAll(log, 60, 81), 60, 81);
+    }
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+bool TestRetentionBytes() {
+    std::string dir = MakeDir();
+    RoomLogOptions options = SmallSegments();
+    options.retention_bytes = 3 * options.segment_bytes;
+    bool result;
+    {
+        RoomLog log(dir, options);
+        result = AppendAll(log, 1, 501);
+        // Активный сегмент и не больше retention_bytes закрытых
+        std::size_t sealed = 0;
+        std::vector<std::string> logs = Files(dir, ".log");
+        for (std::size_t i = 0; i + 1 < logs.size(); ++i) {
+            sealed += std::filesystem::file_size(logs[i]);
+        }
+        result = result && log.FirstSeq() > 1
+            && sealed <= options.retention_bytes
+            && Files(dir, ".idx").size() == logs.size()
+            && Expect(ReadAll(log, 1, 501), log.FirstSeq(), 501);
+    }
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+bool TestRetentionAge() {
+    std::string dir = MakeDir();
+    RoomLogOptions options = SmallSegments();
+    options.retention_seconds = 3600;
+    bool result;
+    {
+        RoomLog log(dir, options);
+        result = AppendAll(log, 1, 201);
+    }
+    // Все сегменты, кроме активного, как будто писались два часа назад
+    std::vector<std::string> logs = Files(dir, ".log");
+    struct timeval old[2] = {{std::time(nullptr) - 7200, 0}, {std::time(nullptr) - 7200, 0}};
+    for (std::size_t i = 0; i + 1 < logs.size(); ++i) {
+        utimes(logs[i].c_str(), old);
+    }
+    {
+        RoomLog log(dir, options);
+        uint64_t base = std::strtoull(
+            std::filesystem::path(logs.back()).stem().c_str(), nullptr, 10);
+        result = result && logs.size() > 1
+            && Files(dir, ".log").size() == 1
+            && log.FirstSeq() == base && log.NextSeq() == 201
+            && Expect(ReadAll(log, 1, 201), base, 201);
+    }
+    // Активный сегмент не удаляется, даже если он старый
+    utimes(Files(dir, ".log").back().c_str(), old);
+    {
+        RoomLog log(dir, options);
+        result = result && log.NextSeq() == 201 && AppendAll(log, 201, 211);
+    }
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+int main() {
+    // Сообщения журнала о сегментах здесь только мешают
+    Logger::SetLevel(LOG_LEVEL_ERROR);
+
+    struct Test {
+        const char* name;
+        bool (*run)();
+    };
+    const Test tests[] = {
+        {"Append Replay", TestAppendReplay},
+        {"Lazy Create", TestLazyCreate},
+        {"Segment Growth", TestSegmentGrowth},
+        {"Reopen", TestReopen},
+        {"Owner Seq", TestOwnerSeq},
+        {"Broken Index", TestBrokenIndex},
+        {"Torn Tail", TestTornTail},
+        {"Retention Bytes", TestRetentionBytes},
+        {"Retention Age", TestRetentionAge},
+    };
+
+    bool passed = true;
+    for (const auto& test : tests) {
+        bool result = test.run();
+        std::cout << "Test " << test.name << ": " << (result ? "PASSED" : "FAILED")
+                  << std::endl;
+        passed = passed && result;
+    }
+    return passed ? 0 : 1;
+}